@@ -19,6 +19,59 @@ extern int32_t ece391_open (const uint8_t* filename);
 extern int32_t ece391_close (int32_t fd);
 extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
+/* Maps an open file read-only; returns its length and sets *start */
+extern int32_t ece391_mmap (int32_t fd, uint8_t** start);
+extern int32_t ece391_truncate (int32_t fd, uint32_t length);
+/* Fills buf with directory records; returns bytes filled, 0 at the end */
+extern int32_t ece391_getdents (int32_t fd, void* buf, int32_t nbytes);
+
+/* Buffer list for ece391_readv and ece391_writev */
+typedef struct {
+	void* base;
+	uint32_t len;
+} ece391_iovec_t;
+
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+/* Returns the new position; directories count in entries */
+extern int32_t ece391_lseek (int32_t fd, int32_t offset, int32_t whence);
+/* Read or write at offset without moving the file position */
+extern int32_t ece391_pread (int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
+extern int32_t ece391_pwrite (int32_t fd, const void* buf, int32_t nbytes, uint32_t offset);
+extern int32_t ece391_readv (int32_t fd, const ece391_iovec_t* iov, int32_t iovcnt);
+extern int32_t ece391_writev (int32_t fd, const ece391_iovec_t* iov, int32_t iovcnt);
+extern int32_t ece391_sync (void);
+extern int32_t ece391_fsync (int32_t fd);
+/* Paths are separated by slashes and start at the root directory */
+extern int32_t ece391_mkdir (const uint8_t* dirname);
+/* Maps the file system image read-only; returns its length and sets *start */
+extern int32_t ece391_fsmap (uint8_t** start);
+/* Returns the new process's pid in the caller and 0 in the new process */
+extern int32_t ece391_fork (void);
+/* Move the end of the heap, which starts after the program; both return -1 on failure.
+   brk returns the new end (the current one for NULL), sbrk the old one. */
+extern int32_t ece391_brk (void* addr);
+extern int32_t ece391_sbrk (int32_t increment);
+/* Shared memory named by key, up to 256 KB; attach returns its size and sets *start */
+extern int32_t ece391_shm_create (uint32_t key, uint32_t size);
+extern int32_t ece391_shm_attach (uint32_t key, uint8_t** start);
+extern int32_t ece391_shm_detach (uint32_t key);
+
+/* Record returned by ece391_getdents; step to the next one with rec_len */
+typedef struct {
+	uint32_t inode;
+	uint32_t size;
+	uint16_t rec_len;
+	uint8_t type;
+	uint8_t name_len;
+	char name[0]; /* NUL terminated */
+} __attribute__((packed)) ece391_dirent_t;
+
+#define ECE391_TYPE_RTC 0
+#define ECE391_TYPE_DIR 1
+#define ECE391_TYPE_FILE 2
 
 #endif /* ECE391SYSCALL_H */
 
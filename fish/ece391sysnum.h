@@ -11,5 +11,23 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_MMAP    12
+#define SYS_TRUNCATE    13
+#define SYS_GETDENTS    14
+#define SYS_LSEEK    15
+#define SYS_PREAD    16
+#define SYS_PWRITE    17
+#define SYS_READV    18
+#define SYS_WRITEV    19
+#define SYS_SYNC    20
+#define SYS_FSYNC    21
+#define SYS_MKDIR    22
+#define SYS_FSMAP    23
+#define SYS_FORK    24
+#define SYS_BRK    25
+#define SYS_SBRK    26
+#define SYS_SHM_CREATE    27
+#define SYS_SHM_ATTACH    28
+#define SYS_SHM_DETACH    29
 
 #endif /* ECE391SYSNUM_H */
@@ -8,6 +8,7 @@
 uint8_t *vmem_base_addr;
 uint8_t *mp1_set_video_mode (void);
 void add_frames(uint8_t *, uint8_t *, int32_t);
+int32_t frame_getc(int32_t, uint8_t *, int32_t, int32_t *, uint8_t *);
 void ece391_memset(void* memory, char c, int n);
 int32_t ece391_memcpy(void* dest, const void* src, int32_t n);
 
@@ -80,9 +81,10 @@ void
 add_frames(uint8_t *f0, uint8_t *f1, int32_t rtc_fd)
 {
     int32_t row, col, offset = 40, eof0 = 0, eof1 = 0, num_bytes;
-    int32_t fd0, fd1;
+    int32_t fd0, fd1, len0, len1, pos0 = 0, pos1 = 0;
     struct mp1_blink_struct blink_struct;
     uint8_t c0 = '0', c1 = '0';
+    uint8_t *map0 = NULL, *map1 = NULL;
 
     blink_struct.on_length = 15;
     blink_struct.off_length = 15;
@@ -96,12 +98,18 @@ add_frames(uint8_t *f0, uint8_t *f1, int32_t rtc_fd)
         ece391_halt(-1);
     }
 
+    /* Scan the frames in place when possible; map stays NULL otherwise */
+    len0 = ece391_mmap(fd0, &map0);
+    len1 = ece391_mmap(fd1, &map1);
+    if(len0 < 0) map0 = NULL;
+    if(len1 < 0) map1 = NULL;
+
     while(eof0 == 0 || eof1 == 0) {
         col = 0;
         while(1) {
 
             if(c0 != '\n') {
-                num_bytes = ece391_read(fd0, &c0, 1);
+                num_bytes = frame_getc(fd0, map0, len0, &pos0, &c0);
                 if(num_bytes == 0) {
                     c0 = '\n';
                     eof0 = 1;
@@ -109,7 +117,7 @@ add_frames(uint8_t *f0, uint8_t *f1, int32_t rtc_fd)
             }
 
             if(c1 != '\n') {
-                num_bytes = ece391_read(fd1, &c1, 1);
+                num_bytes = frame_getc(fd1, map1, len1, &pos1, &c1);
                 if(num_bytes == 0) {
                     c1 = '\n';
                     eof1 = 1;
@@ -148,6 +156,22 @@ add_frames(uint8_t *f0, uint8_t *f1, int32_t rtc_fd)
     }
 }
 
+/* Next character of a frame file, from its mapping or with a read call */
+int32_t
+frame_getc(int32_t fd, uint8_t *map, int32_t len, int32_t *pos, uint8_t *c)
+{
+    if(map == NULL) {
+        return ece391_read(fd, c, 1);
+    }
+
+    if(*pos >= len) {
+        return 0;
+    }
+
+    *c = map[(*pos)++];
+    return 1;
+}
+
 uint8_t*
 mp1_set_video_mode (void)
 {
@@ -0,0 +1,482 @@
+#include "ata.h"
+#include "../kernel/scheduling.h"
+#include "../kernel/tasks.h"
+
+static uint32_t ata_disk_sectors; // 0 until ata_init finds the disk
+
+// DMA state, set up by ata_dma_init
+static uint32_t ata_dma_on;
+static uint32_t ata_bm_base; // bus master registers of the primary channel
+static ata_prd_t ata_prd __attribute__((aligned(8))); // one entry: requests never cross 64 KB
+static ata_request_t * ata_queue_head; // in flight
+static ata_request_t * ata_queue_tail;
+
+/*
+ * int32_t ata_wait(uint32_t want)
+ *   DESCRIPTION: Polls the status register until the drive is not busy and, if want is
+ *				  non-zero, has those status bits set
+ *	 INPUTS: want - status bits to wait for (ATA_SR_DRQ, ATA_SR_DRDY or 0)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 when ready, -1 on a drive error or timeout
+ *   SIDE EFFECTS: none
+ */
+
+static int32_t
+ata_wait(uint32_t want)
+{
+	uint32_t status, i;
+
+	// The status is not valid for 400 ns after a command; four reads of the
+	// alternate status register take about that long
+	for (i = 0; i < 4; i++) inb(ATA_CTRL);
+
+	for (i = 0; i < ATA_TIMEOUT; i++) {
+		status = inb(ATA_REG_STATUS);
+		if (status & ATA_SR_BSY) continue;
+		if (status & (ATA_SR_ERR | ATA_SR_DF)) return -1;
+		if ((status & want) == want) return 0;
+	}
+
+	return -1;
+}
+
+/*
+ * void ata_command(uint32_t lba, uint32_t count, uint32_t command)
+ *   DESCRIPTION: Selects the disk and issues an LBA28 command
+ *	 INPUTS: lba - first sector
+ *			 count - number of sectors, 1 to ATA_MAX_SECTORS
+ *			 command - the ATA command byte
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: starts the command
+ */
+
+static void
+ata_command(uint32_t lba, uint32_t count, uint32_t command)
+{
+	outb(ATA_DRIVE_SLAVE_LBA | ((lba >> 24) & 0x0F), ATA_REG_DRIVE);
+	outb(count & 0xFF, ATA_REG_SECCOUNT);
+	outb(lba & 0xFF, ATA_REG_LBA0);
+	outb((lba >> 8) & 0xFF, ATA_REG_LBA1);
+	outb((lba >> 16) & 0xFF, ATA_REG_LBA2);
+	outb(command, ATA_REG_COMMAND);
+}
+
+/*
+ * int32_t ata_init(void)
+ *   DESCRIPTION: Looks for the file system disk with IDENTIFY and reads its size
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the disk is present, -1 otherwise
+ *   SIDE EFFECTS: turns off drive interrupts on the primary channel
+ */
+
+int32_t
+ata_init(void)
+{
+	uint16_t identify[ATA_IDENTIFY_WORDS];
+	uint32_t i;
+
+	ata_disk_sectors = 0;
+	outb(ATA_CTRL_NIEN, ATA_CTRL);
+
+	outb(ATA_DRIVE_SLAVE_LBA, ATA_REG_DRIVE);
+	outb(0, ATA_REG_SECCOUNT);
+	outb(0, ATA_REG_LBA0);
+	outb(0, ATA_REG_LBA1);
+	outb(0, ATA_REG_LBA2);
+	outb(ATA_CMD_IDENTIFY, ATA_REG_COMMAND);
+
+	// A status of 0 (or a floating bus) means no drive; non-zero LBA1/LBA2 means ATAPI
+	if (inb(ATA_REG_STATUS) == 0 || inb(ATA_REG_STATUS) == 0xFF) return -1;
+	if (ata_wait(0) == -1 || inb(ATA_REG_LBA1) || inb(ATA_REG_LBA2)) return -1;
+	if (ata_wait(ATA_SR_DRQ) == -1) return -1;
+
+	for (i = 0; i < ATA_IDENTIFY_WORDS; i++)
+		identify[i] = inw(ATA_REG_DATA);
+
+	ata_disk_sectors = identify[ATA_IDENTIFY_LBA28_LO] | (identify[ATA_IDENTIFY_LBA28_HI] << 16);
+	if (ata_disk_sectors == 0) return -1;
+
+	printf("ATA disk: %d sectors\n", ata_disk_sectors);
+	return 0;
+}
+
+/*
+ * uint32_t ata_sectors(void)
+ *   DESCRIPTION: Size of the file system disk
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of sectors, 0 if there is no disk
+ *   SIDE EFFECTS: none
+ */
+
+uint32_t
+ata_sectors(void)
+{
+	return ata_disk_sectors;
+}
+
+/*
+ * int32_t ata_pio_transfer(uint32_t lba, uint32_t count, void * buf, uint32_t write)
+ *   DESCRIPTION: Moves sectors with programmed I/O, polling the drive. Writes are followed by
+ *				  a cache flush.
+ *	 INPUTS: lba - first sector
+ *			 count - number of sectors
+ *			 buf - count * ATA_SECTOR_SIZE bytes to fill or send
+ *			 write - non-zero to write
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: none
+ */
+
+static int32_t
+ata_pio_transfer(uint32_t lba, uint32_t count, void * buf, uint32_t write)
+{
+	uint16_t * data = buf;
+	uint32_t chunk, sector, i;
+
+	for (; count > 0; count -= chunk, lba += chunk) {
+		chunk = count > ATA_MAX_SECTORS ? ATA_MAX_SECTORS : count;
+		if (ata_wait(ATA_SR_DRDY) == -1) return -1;
+		ata_command(lba, chunk, write ? ATA_CMD_WRITE : ATA_CMD_READ);
+
+		for (sector = 0; sector < chunk; sector++) {
+			if (ata_wait(ATA_SR_DRQ) == -1) return -1;
+			for (i = 0; i < ATA_SECTOR_SIZE / 2; i++) {
+				if (write) outw(*data++, ATA_REG_DATA);
+				else *data++ = inw(ATA_REG_DATA);
+			}
+		}
+
+		if (write) {
+			outb(ATA_CMD_FLUSH, ATA_REG_COMMAND);
+			if (ata_wait(0) == -1) return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * int32_t ata_pio(uint32_t lba, uint32_t count, void * buf, uint32_t write)
+ *   DESCRIPTION: Programmed I/O for transfers DMA cannot take. Once DMA is running this waits
+ *				  for the request queue to drain and keeps the drive's interrupt off meanwhile.
+ *	 INPUTS: lba - first sector
+ *			 count - number of sectors
+ *			 buf - count * ATA_SECTOR_SIZE bytes to fill or send
+ *			 write - non-zero to write
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: interrupts are off for the whole transfer once DMA is running
+ */
+
+static int32_t
+ata_pio(uint32_t lba, uint32_t count, void * buf, uint32_t write)
+{
+	uint32_t flags;
+	int32_t ret;
+
+	if (!ata_dma_on) return ata_pio_transfer(lba, count, buf, write);
+
+	cli_and_save(flags);
+	while (ata_queue_head != NULL)
+		asm volatile("sti; hlt; cli");
+
+	outb(ATA_CTRL_NIEN, ATA_CTRL);
+	ret = ata_pio_transfer(lba, count, buf, write);
+	outb(0, ATA_CTRL);
+
+	restore_flags(flags);
+	return ret;
+}
+
+/*
+ * int32_t ata_dma_start(ata_request_t * req)
+ *   DESCRIPTION: Programs the bus master and the drive for a request
+ *	 INPUTS: req - the request at the head of the queue
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if the transfer started, -1 if the drive is not ready
+ *   SIDE EFFECTS: IRQ 14 fires when the transfer ends
+ */
+
+static int32_t
+ata_dma_start(ata_request_t * req)
+{
+	if (ata_wait(ATA_SR_DRDY) == -1) return -1;
+
+	ata_prd.addr = (uint32_t) req->buf;
+	ata_prd.bytes = req->count * ATA_SECTOR_SIZE; // 64 KB wraps to 0, as the format wants
+	ata_prd.flags = PRD_EOT;
+
+	outb(0, ata_bm_base + BM_REG_COMMAND);
+	outl((uint32_t) &ata_prd, ata_bm_base + BM_REG_PRDT);
+	outb(BM_ST_ERR | BM_ST_IRQ, ata_bm_base + BM_REG_STATUS); // write one to clear
+
+	ata_command(req->lba, req->count, req->write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA);
+	outb((req->write ? 0 : BM_CMD_READ) | BM_CMD_START, ata_bm_base + BM_REG_COMMAND);
+
+	return 0;
+}
+
+/*
+ * void ata_dma_finish(int8_t status)
+ *   DESCRIPTION: Completes the request at the head of the queue and wakes its submitter
+ *	 INPUTS: status - 0 or -1
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: called with interrupts off
+ */
+
+static void
+ata_dma_finish(int8_t status)
+{
+	ata_request_t * req = ata_queue_head;
+
+	ata_queue_head = req->next;
+	if (ata_queue_head == NULL) ata_queue_tail = NULL;
+
+	req->status = status;
+	req->done = 1;
+	if (req->was_scheduled) schedule_task(req->waiter);
+}
+
+/*
+ * void ata_dma_next(void)
+ *   DESCRIPTION: Starts the request at the head of the queue, failing any the drive refuses
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: called with interrupts off
+ */
+
+static void
+ata_dma_next(void)
+{
+	while (ata_queue_head != NULL && ata_dma_start(ata_queue_head) == -1)
+		ata_dma_finish(-1);
+}
+
+/*
+ * int32_t ata_dma(uint32_t lba, uint32_t count, void * buf, uint32_t write)
+ *   DESCRIPTION: Queues a DMA transfer and sleeps until IRQ 14 completes it. The caller, a
+ *				  task task_sleepable accepts, is unscheduled meanwhile so other tasks get the CPU,
+ *				  and scheduled again on completion.
+ *	 INPUTS: lba - first sector
+ *			 count - number of sectors
+ *			 buf - identity mapped kernel buffer inside one 64 KB region
+ *			 write - non-zero to write
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: may switch tasks
+ */
+
+static int32_t
+ata_dma(uint32_t lba, uint32_t count, void * buf, uint32_t write)
+{
+	ata_request_t req;
+	uint32_t flags;
+
+	req.lba = lba;
+	req.count = count;
+	req.buf = buf;
+	req.write = write;
+	req.done = 0;
+	req.status = -1;
+	req.waiter = task_sleepable();
+	req.was_scheduled = req.waiter >= 0 && task_scheduled(req.waiter);
+	req.next = NULL;
+
+	cli_and_save(flags);
+
+	if (ata_queue_tail != NULL) {
+		ata_queue_tail->next = &req;
+		ata_queue_tail = &req;
+	} else {
+		ata_queue_head = ata_queue_tail = &req;
+		ata_dma_next();
+	}
+
+	// Checked with interrupts off so the wake-up cannot slip in before we sleep
+	while (!req.done) {
+		unschedule_task(req.waiter);
+		asm volatile("sti; hlt; cli");
+	}
+
+	restore_flags(flags);
+	return req.status;
+}
+
+/*
+ * uint32_t ata_dma_ok(void * buf, uint32_t count)
+ *   DESCRIPTION: Checks whether a transfer fits in the single PRD entry DMA uses, and
+ *				  whether the caller is a task that can sleep until it completes
+ *	 INPUTS: buf - the buffer
+ *			 count - number of sectors
+ *   OUTPUTS: none
+ *   RETURN VALUE: non-zero if DMA can do it
+ *   SIDE EFFECTS: none
+ */
+
+static uint32_t
+ata_dma_ok(void * buf, uint32_t count)
+{
+	uint32_t start = (uint32_t) buf, bytes = count * ATA_SECTOR_SIZE;
+
+	return ata_dma_on && bytes <= DMA_BOUNDARY && !(start & 1) && start + bytes <= DMA_MEM_END &&
+		start / DMA_BOUNDARY == (start + bytes - 1) / DMA_BOUNDARY && task_sleepable() != -1;
+}
+
+/*
+ * int32_t ata_dma_init(void)
+ *   DESCRIPTION: Finds the PCI IDE controller, enables bus mastering and IRQ 14. Transfers
+ *				  until now were polled; from here on they are queued and complete from the IRQ.
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 if DMA is on, -1 if there is no disk or no bus master controller
+ *   SIDE EFFECTS: transfers sleep the calling task, so this must run after tasks exist
+ */
+
+int32_t
+ata_dma_init(void)
+{
+	uint32_t dev, func, addr, class_reg;
+
+	if (ata_disk_sectors == 0) return -1;
+
+	for (dev = 0; dev < PCI_MAX_DEVICES; dev++) {
+		for (func = 0; func < PCI_MAX_FUNCTIONS; func++) {
+			addr = PCI_ENABLE | (dev << 11) | (func << 8);
+
+			outl(addr | PCI_REG_ID, PCI_CONFIG_ADDRESS);
+			if ((inl(PCI_CONFIG_DATA) & 0xFFFF) == PCI_NO_DEVICE) continue;
+
+			outl(addr | PCI_REG_CLASS, PCI_CONFIG_ADDRESS);
+			class_reg = inl(PCI_CONFIG_DATA);
+			if ((class_reg >> 16) != PCI_CLASS_IDE) continue;
+
+			outl(addr | PCI_REG_BAR4, PCI_CONFIG_ADDRESS);
+			ata_bm_base = inl(PCI_CONFIG_DATA) & PCI_BAR_IO_MASK;
+
+			outl(addr | PCI_REG_COMMAND, PCI_CONFIG_ADDRESS);
+			outl(inl(PCI_CONFIG_DATA) | PCI_CMD_IO | PCI_CMD_BUS_MASTER, PCI_CONFIG_DATA);
+			goto found;
+		}
+	}
+	return -1;
+
+found:
+	if (ata_bm_base == 0) return -1;
+
+	ata_queue_head = ata_queue_tail = NULL;
+	outb(0, ATA_CTRL);
+	enable_irq(ATA_IRQ_NUM);
+	ata_dma_on = 1;
+
+	printf("ATA DMA at 0x%#x\n", ata_bm_base);
+	return 0;
+}
+
+/*
+ * void ata_irq_handler(void)
+ *   DESCRIPTION: IRQ 14: completes the DMA request in flight and starts the next one
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: wakes the task that submitted the request
+ */
+
+void
+ata_irq_handler(void)
+{
+	uint32_t bm_status, status;
+
+	bm_status = inb(ata_bm_base + BM_REG_STATUS);
+	status = inb(ATA_REG_STATUS); // reading the status acknowledges the drive
+
+	if (ata_queue_head != NULL && (bm_status & BM_ST_IRQ)) {
+		outb(0, ata_bm_base + BM_REG_COMMAND);
+		outb(BM_ST_ERR | BM_ST_IRQ, ata_bm_base + BM_REG_STATUS);
+
+		ata_dma_finish(((bm_status & BM_ST_ERR) || (status & (ATA_SR_ERR | ATA_SR_DF))) ? -1 : 0);
+		ata_dma_next();
+	}
+
+	send_eoi(ATA_IRQ_NUM);
+}
+
+/*
+ * int32_t ata_flush(void)
+ *   DESCRIPTION: Makes the drive commit its write cache. DMA writes leave data in the cache;
+ *				  PIO writes already flush after each command.
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure or if there is no disk
+ *   SIDE EFFECTS: waits for queued DMA requests, then polls with interrupts off
+ */
+
+int32_t
+ata_flush(void)
+{
+	uint32_t flags;
+	int32_t ret;
+
+	if (ata_disk_sectors == 0) return -1;
+
+	cli_and_save(flags);
+	while (ata_queue_head != NULL)
+		asm volatile("sti; hlt; cli");
+
+	outb(ATA_CTRL_NIEN, ATA_CTRL);
+	ret = ata_wait(ATA_SR_DRDY);
+	if (ret == 0) {
+		outb(ATA_CMD_FLUSH, ATA_REG_COMMAND);
+		ret = ata_wait(0);
+	}
+	if (ata_dma_on) outb(0, ATA_CTRL);
+
+	restore_flags(flags);
+	return ret;
+}
+
+/*
+ * int32_t ata_read(uint32_t lba, uint32_t count, void * buf)
+ *   DESCRIPTION: Reads sectors from the disk, by DMA when the buffer allows it
+ *	 INPUTS: lba - first sector
+ *			 count - number of sectors
+ *			 buf - destination, count * ATA_SECTOR_SIZE bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: may sleep the calling task
+ */
+
+int32_t
+ata_read(uint32_t lba, uint32_t count, void * buf)
+{
+	if (lba + count > ata_disk_sectors || lba + count < lba) return -1;
+	if (count == 0) return 0;
+
+	if (ata_dma_ok(buf, count)) return ata_dma(lba, count, buf, 0);
+	return ata_pio(lba, count, buf, 0);
+}
+
+/*
+ * int32_t ata_write(uint32_t lba, uint32_t count, const void * buf)
+ *   DESCRIPTION: Writes sectors to the disk, by DMA when the buffer allows it
+ *	 INPUTS: lba - first sector
+ *			 count - number of sectors
+ *			 buf - source, count * ATA_SECTOR_SIZE bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: may sleep the calling task
+ */
+
+int32_t
+ata_write(uint32_t lba, uint32_t count, const void * buf)
+{
+	if (lba + count > ata_disk_sectors || lba + count < lba) return -1;
+	if (count == 0) return 0;
+
+	if (ata_dma_ok((void *) buf, count)) return ata_dma(lba, count, (void *) buf, 1);
+	return ata_pio(lba, count, (void *) buf, 1);
+}
@@ -0,0 +1,107 @@
+#ifndef _ATA_H_
+#define _ATA_H_
+
+#include "../lib/lib.h"
+#include "../lib/types.h"
+#include "i8259.h"
+
+// Primary channel. The boot disk is the master; the file system disk is the slave (qemu -hdb)
+#define ATA_IO_BASE 0x1F0
+#define ATA_CTRL 0x3F6
+
+#define ATA_REG_DATA (ATA_IO_BASE + 0)
+#define ATA_REG_ERROR (ATA_IO_BASE + 1)
+#define ATA_REG_SECCOUNT (ATA_IO_BASE + 2)
+#define ATA_REG_LBA0 (ATA_IO_BASE + 3)
+#define ATA_REG_LBA1 (ATA_IO_BASE + 4)
+#define ATA_REG_LBA2 (ATA_IO_BASE + 5)
+#define ATA_REG_DRIVE (ATA_IO_BASE + 6)
+#define ATA_REG_STATUS (ATA_IO_BASE + 7) // read
+#define ATA_REG_COMMAND (ATA_IO_BASE + 7) // write
+
+#define ATA_CMD_READ 0x20
+#define ATA_CMD_WRITE 0x30
+#define ATA_CMD_READ_DMA 0xC8
+#define ATA_CMD_WRITE_DMA 0xCA
+#define ATA_CMD_FLUSH 0xE7
+#define ATA_CMD_IDENTIFY 0xEC
+
+#define ATA_SR_BSY 0x80
+#define ATA_SR_DRDY 0x40
+#define ATA_SR_DF 0x20
+#define ATA_SR_DRQ 0x08
+#define ATA_SR_ERR 0x01
+
+#define ATA_CTRL_NIEN 0x02 // no interrupts; the PIO driver polls
+#define ATA_DRIVE_SLAVE_LBA 0xF0 // LBA addressing, slave, high LBA nibble in the low bits
+
+#define ATA_SECTOR_SIZE 512
+#define ATA_MAX_SECTORS 256 // per command; a sector count of 0 means 256
+#define ATA_LBA28_MAX 0x0FFFFFFF
+#define ATA_IDENTIFY_WORDS 256
+#define ATA_IDENTIFY_LBA28_LO 60 // words 60-61 hold the LBA28 sector count
+#define ATA_IDENTIFY_LBA28_HI 61
+#define ATA_TIMEOUT 1000000 // status polls before giving up
+
+#define ATA_IRQ_NUM 14 // primary channel
+
+// PCI configuration space, for finding the IDE controller's bus master registers
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+#define PCI_ENABLE 0x80000000
+#define PCI_MAX_DEVICES 32
+#define PCI_MAX_FUNCTIONS 8
+#define PCI_REG_ID 0x00
+#define PCI_REG_COMMAND 0x04
+#define PCI_REG_CLASS 0x08 // class, subclass, prog if, revision from high byte down
+#define PCI_REG_BAR4 0x20
+#define PCI_CLASS_IDE 0x0101 // mass storage, IDE
+#define PCI_CMD_IO 0x1
+#define PCI_CMD_BUS_MASTER 0x4
+#define PCI_NO_DEVICE 0xFFFF
+#define PCI_BAR_IO_MASK 0xFFFC
+
+// Bus master IDE registers, offsets from BAR4 (primary channel)
+#define BM_REG_COMMAND 0
+#define BM_REG_STATUS 2
+#define BM_REG_PRDT 4
+#define BM_CMD_START 0x01
+#define BM_CMD_READ 0x08 // device to memory
+#define BM_ST_ERR 0x02
+#define BM_ST_IRQ 0x04
+#define PRD_EOT 0x8000 // last entry of the table
+#define DMA_BOUNDARY 0x10000 // a PRD entry may not cross 64 KB
+#define DMA_MEM_END 0x800000 // buffers must be identity mapped kernel memory
+
+// One disk transfer. It lives on the submitter's kernel stack until it is done.
+typedef struct ata_request {
+	uint32_t lba;
+	uint32_t count;
+	void * buf;
+	uint8_t write;
+	volatile uint8_t done;
+	int8_t status; // 0 or -1, valid once done
+	int16_t waiter; // pid to wake on completion
+	uint8_t was_scheduled; // whether waiter was runnable before it slept, restored on completion
+	struct ata_request * next;
+} ata_request_t;
+
+// Entry of the physical region descriptor table
+typedef struct {
+	uint32_t addr;
+	uint16_t bytes; // 0 means 64 KB
+	uint16_t flags;
+} __attribute__((packed)) ata_prd_t;
+
+// Find the file system disk; 0 if it is there
+extern int32_t ata_init(void);
+// Switch from polled PIO to interrupt driven DMA, once tasks are running
+extern int32_t ata_dma_init(void);
+extern void ata_irq_handler(void);
+// Number of sectors on the disk, 0 if there is none
+extern uint32_t ata_sectors(void);
+extern int32_t ata_read(uint32_t lba, uint32_t count, void * buf);
+extern int32_t ata_write(uint32_t lba, uint32_t count, const void * buf);
+extern int32_t ata_flush(void);
+
+#endif
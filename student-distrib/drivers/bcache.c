@@ -0,0 +1,334 @@
+#include "bcache.h"
+
+static uint8_t bcache_data[BCACHE_BLOCKS][BCACHE_BLOCK_SIZE] __attribute__((aligned(BCACHE_BLOCK_SIZE)));
+static bcache_entry_t bcache[BCACHE_BLOCKS];
+static int16_t bcache_hash_head[BCACHE_HASH_SIZE];
+static int16_t bcache_lru_head; // most recently used
+static int16_t bcache_lru_tail; // least recently used, looked at first for reuse
+static uint32_t bcache_busy; // a task is inside the cache, possibly asleep on the disk
+
+/*
+ * void bcache_lock(void)
+ *   DESCRIPTION: waits for the cache to be free and takes it. Disk transfers sleep the task,
+ *				  so interrupts being off is not enough to keep the lists to ourselves.
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: called with interrupts off; lets them in while it waits
+ */
+
+static void
+bcache_lock(void)
+{
+	while (bcache_busy)
+		asm volatile("sti; hlt; cli");
+	bcache_busy = 1;
+}
+
+/*
+ * void bcache_lru_unlink(int16_t entry)
+ *   DESCRIPTION: removes an entry from the LRU list
+ *	 INPUTS: entry - the entry
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+
+static void
+bcache_lru_unlink(int16_t entry)
+{
+	if (bcache[entry].lru_prev != BCACHE_NONE) bcache[bcache[entry].lru_prev].lru_next = bcache[entry].lru_next;
+	else bcache_lru_head = bcache[entry].lru_next;
+
+	if (bcache[entry].lru_next != BCACHE_NONE) bcache[bcache[entry].lru_next].lru_prev = bcache[entry].lru_prev;
+	else bcache_lru_tail = bcache[entry].lru_prev;
+}
+
+/*
+ * void bcache_lru_touch(int16_t entry)
+ *   DESCRIPTION: moves an entry to the most recently used end of the LRU list
+ *	 INPUTS: entry - the entry
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+
+static void
+bcache_lru_touch(int16_t entry)
+{
+	bcache_lru_unlink(entry);
+
+	bcache[entry].lru_prev = BCACHE_NONE;
+	bcache[entry].lru_next = bcache_lru_head;
+	if (bcache_lru_head != BCACHE_NONE) bcache[bcache_lru_head].lru_prev = entry;
+	else bcache_lru_tail = entry;
+	bcache_lru_head = entry;
+}
+
+/*
+ * void bcache_unhash(int16_t entry)
+ *   DESCRIPTION: removes a valid entry from its hash chain
+ *	 INPUTS: entry - the entry
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: lookups of its block miss
+ */
+
+static void
+bcache_unhash(int16_t entry)
+{
+	int16_t *link = &bcache_hash_head[bcache[entry].block & BCACHE_HASH_MASK];
+
+	while (*link != entry)
+		link = &bcache[*link].hash_next;
+
+	*link = bcache[entry].hash_next;
+	bcache[entry].valid = 0;
+}
+
+/*
+ * int32_t bcache_write_back(int16_t entry)
+ *   DESCRIPTION: writes a dirty entry to the disk
+ *	 INPUTS: entry - the entry
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success (or if it was clean), -1 on a disk error
+ *   SIDE EFFECTS: the entry is clean on success
+ */
+
+static int32_t
+bcache_write_back(int16_t entry)
+{
+	if (!bcache[entry].valid || !bcache[entry].dirty) return 0;
+
+	if (ata_write(bcache[entry].block * BCACHE_SECTORS, BCACHE_SECTORS, bcache_data[entry]) == -1)
+		return -1;
+
+	bcache[entry].dirty = 0;
+	return 0;
+}
+
+/*
+ * int16_t bcache_lookup(uint32_t block, uint32_t read)
+ *   DESCRIPTION: finds the entry for a block, reusing the least recently used unpinned entry
+ *				  on a miss
+ *	 INPUTS: block - disk block number
+ *			 read - non-zero to read the block from disk on a miss, zero to clear it instead
+ *   OUTPUTS: none
+ *   RETURN VALUE: the pinned entry, BCACHE_NONE if every entry is pinned or the disk failed
+ *   SIDE EFFECTS: may write back the entry it reuses
+ */
+
+static int16_t
+bcache_lookup(uint32_t block, uint32_t read)
+{
+	int16_t entry;
+
+	for (entry = bcache_hash_head[block & BCACHE_HASH_MASK]; entry != BCACHE_NONE; entry = bcache[entry].hash_next) {
+		if (bcache[entry].block == block) {
+			if (!read) memset(bcache_data[entry], 0, BCACHE_BLOCK_SIZE);
+			bcache[entry].refs++;
+			bcache_lru_touch(entry);
+			return entry;
+		}
+	}
+
+	// Miss: walk from the cold end for an entry nobody holds
+	for (entry = bcache_lru_tail; entry != BCACHE_NONE; entry = bcache[entry].lru_prev) {
+		if (bcache[entry].refs == 0 && bcache_write_back(entry) == 0) break;
+	}
+	if (entry == BCACHE_NONE) return BCACHE_NONE;
+
+	if (bcache[entry].valid) bcache_unhash(entry);
+
+	if (read) {
+		if (ata_read(block * BCACHE_SECTORS, BCACHE_SECTORS, bcache_data[entry]) == -1) return BCACHE_NONE;
+	} else {
+		memset(bcache_data[entry], 0, BCACHE_BLOCK_SIZE);
+	}
+
+	bcache[entry].block = block;
+	bcache[entry].valid = 1;
+	bcache[entry].dirty = 0;
+	bcache[entry].refs = 1;
+	bcache[entry].hash_next = bcache_hash_head[block & BCACHE_HASH_MASK];
+	bcache_hash_head[block & BCACHE_HASH_MASK] = entry;
+	bcache_lru_touch(entry);
+
+	return entry;
+}
+
+/*
+ * void bcache_init(void)
+ *   DESCRIPTION: empties the buffer cache
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+
+void
+bcache_init(void)
+{
+	int16_t i;
+
+	for (i = 0; i < BCACHE_HASH_SIZE; i++)
+		bcache_hash_head[i] = BCACHE_NONE;
+
+	// Chain every entry into the LRU list, all equally cold
+	for (i = 0; i < BCACHE_BLOCKS; i++) {
+		bcache[i].valid = 0;
+		bcache[i].dirty = 0;
+		bcache[i].refs = 0;
+		bcache[i].lru_prev = i - 1;
+		bcache[i].lru_next = i + 1 < BCACHE_BLOCKS ? i + 1 : BCACHE_NONE;
+	}
+
+	bcache_lru_head = 0;
+	bcache_lru_tail = BCACHE_BLOCKS - 1;
+	bcache_busy = 0;
+}
+
+/*
+ * uint8_t * bcache_get(uint32_t block)
+ *   DESCRIPTION: returns the cached contents of a disk block, reading it on a miss. The
+ *				  buffer stays valid until the matching bcache_put.
+ *	 INPUTS: block - disk block number (BCACHE_BLOCK_SIZE bytes each)
+ *   OUTPUTS: none
+ *   RETURN VALUE: the buffer, NULL on a disk error or if every buffer is in use
+ *   SIDE EFFECTS: pins the buffer; may sleep on the disk
+ */
+
+uint8_t *
+bcache_get(uint32_t block)
+{
+	uint32_t flags;
+	int16_t entry;
+
+	// The scheduler may switch tasks inside a syscall, so keep the lists consistent
+	cli_and_save(flags);
+	bcache_lock();
+	entry = bcache_lookup(block, 1);
+	bcache_busy = 0;
+	restore_flags(flags);
+
+	return entry == BCACHE_NONE ? NULL : bcache_data[entry];
+}
+
+/*
+ * uint8_t * bcache_get_clear(uint32_t block)
+ *   DESCRIPTION: like bcache_get, but for a block about to be overwritten: the buffer is
+ *				  zeroed instead of read from disk
+ *	 INPUTS: block - disk block number
+ *   OUTPUTS: none
+ *   RETURN VALUE: the buffer, NULL if every buffer is in use
+ *   SIDE EFFECTS: pins the buffer; may sleep on the disk
+ */
+
+uint8_t *
+bcache_get_clear(uint32_t block)
+{
+	uint32_t flags;
+	int16_t entry;
+
+	// The scheduler may switch tasks inside a syscall, so keep the lists consistent
+	cli_and_save(flags);
+	bcache_lock();
+	entry = bcache_lookup(block, 0);
+	bcache_busy = 0;
+	restore_flags(flags);
+
+	return entry == BCACHE_NONE ? NULL : bcache_data[entry];
+}
+
+/*
+ * void bcache_put(uint8_t * buf)
+ *   DESCRIPTION: releases a buffer returned by bcache_get
+ *	 INPUTS: buf - the buffer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the buffer may be reused once nobody holds it
+ */
+
+void
+bcache_put(uint8_t * buf)
+{
+	uint32_t entry = (buf - bcache_data[0]) / BCACHE_BLOCK_SIZE;
+
+	if (entry < BCACHE_BLOCKS && bcache[entry].refs > 0)
+		bcache[entry].refs--;
+}
+
+/*
+ * void bcache_dirty(uint8_t * buf)
+ *   DESCRIPTION: marks a held buffer as changed, so it is written back before reuse
+ *	 INPUTS: buf - the buffer
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+
+void
+bcache_dirty(uint8_t * buf)
+{
+	uint32_t entry = (buf - bcache_data[0]) / BCACHE_BLOCK_SIZE;
+
+	if (entry < BCACHE_BLOCKS)
+		bcache[entry].dirty = 1;
+}
+
+/*
+ * int32_t bcache_sync(uint32_t block)
+ *   DESCRIPTION: writes one block to the disk if it is cached and dirty
+ *	 INPUTS: block - disk block number
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success (or if there was nothing to write), -1 on a disk error
+ *   SIDE EFFECTS: may sleep on the disk
+ */
+
+int32_t
+bcache_sync(uint32_t block)
+{
+	uint32_t flags;
+	int32_t ret = 0;
+	int16_t entry;
+
+	cli_and_save(flags);
+	bcache_lock();
+	for (entry = bcache_hash_head[block & BCACHE_HASH_MASK]; entry != BCACHE_NONE; entry = bcache[entry].hash_next) {
+		if (bcache[entry].block == block) {
+			ret = bcache_write_back(entry);
+			break;
+		}
+	}
+	bcache_busy = 0;
+	restore_flags(flags);
+
+	return ret;
+}
+
+/*
+ * int32_t bcache_flush(void)
+ *   DESCRIPTION: writes every dirty buffer to the disk
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if any write failed
+ *   SIDE EFFECTS: none
+ */
+
+int32_t
+bcache_flush(void)
+{
+	uint32_t flags;
+	int32_t ret = 0;
+	int16_t i;
+
+	cli_and_save(flags);
+	bcache_lock();
+	for (i = 0; i < BCACHE_BLOCKS; i++) {
+		if (bcache_write_back(i) == -1) ret = -1;
+	}
+	bcache_busy = 0;
+	restore_flags(flags);
+
+	return ret;
+}
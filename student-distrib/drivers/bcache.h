@@ -0,0 +1,33 @@
+#ifndef _BCACHE_H_
+#define _BCACHE_H_
+
+#include "../lib/lib.h"
+#include "../lib/types.h"
+#include "ata.h"
+
+#define BCACHE_BLOCK_SIZE 0x1000 // one file system block
+#define BCACHE_SECTORS (BCACHE_BLOCK_SIZE / ATA_SECTOR_SIZE)
+#define BCACHE_BLOCKS 64 // 256 KB of cached disk blocks
+#define BCACHE_HASH_SIZE 64
+#define BCACHE_HASH_MASK (BCACHE_HASH_SIZE - 1)
+#define BCACHE_NONE -1
+
+typedef struct {
+	uint32_t block; // disk block held, valid only when hashed
+	uint16_t refs; // callers between bcache_get and bcache_put; pinned while non-zero
+	uint8_t valid;
+	uint8_t dirty; // changed since it was read; written back before reuse
+	int16_t hash_next;
+	int16_t lru_prev; // LRU list, most recently used at the head
+	int16_t lru_next;
+} bcache_entry_t;
+
+extern void bcache_init(void);
+extern uint8_t * bcache_get(uint32_t block);
+extern uint8_t * bcache_get_clear(uint32_t block);
+extern void bcache_put(uint8_t * buf);
+extern void bcache_dirty(uint8_t * buf);
+extern int32_t bcache_sync(uint32_t block);
+extern int32_t bcache_flush(void);
+
+#endif
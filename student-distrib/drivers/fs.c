@@ -1,152 +1,1680 @@
 #include "fs.h"
+#include "../kernel/image_cache.h"
+#include "../kernel/swap.h"
+#include "bcache.h"
+#include "../kernel/tasks.h"
+#include "../kernel/scheduling.h"
+#include "../kernel/paging.h"
+#include "../kernel/lock.h"
+#include "../lib/lz4.h"
 
 static boot_block_t *boot_block;
 static uint32_t fs_end;
 static uint32_t num_directories;
 static uint32_t num_inodes;
+static uint32_t num_data_blocks;	// boot image blocks plus the free memory after them
+static inode_t *inodes;				// inode 0, right after the boot block
+static data_block_t *data_blocks;	// data block 0, right after the last inode (module only)
+
+// Disk backend: the boot block and inodes are read into RAM at mount, data blocks go through the bcache
+static uint32_t fs_on_disk;
+static uint32_t fs_indirect;		// the image uses the indirect block layout
+static uint32_t fs_data_start;		// disk block holding data block 0
+static data_block_t fs_disk_meta[FS_META_BLOCKS] __attribute__((aligned(FOUR_KB)));
+static uint32_t fs_meta_dirty[(FS_META_BLOCKS + BITS_PER_WORD - 1) / BITS_PER_WORD]; // changed since the last sync
+static int16_t fs_flusher_pid = -1;	// kernel task writing dirty blocks back, -1 until started
+static volatile uint32_t fs_flush_due;	// set by the PIT, cleared by the flusher
+
+// Allocation state of the writable layer, built once in fs_init
+static uint32_t block_bitmap[FS_MAX_BLOCKS / BITS_PER_WORD];	// set for data blocks in use
+static uint32_t inode_bitmap[FS_MAX_INODES / BITS_PER_WORD];	// set for inodes owned by a file
+static uint32_t fs_generation;		// bumped whenever blocks are freed, so read cursors refresh
+static uint16_t fs_inode_mmaps[FS_MAX_INODES];	// live mmaps of each file, which pin its blocks
+
+// Held by everything that changes the bitmaps, inodes or directories. Those changes read
+// and write blocks that may sleep on the disk, so turning interrupts off would not cover them.
+static lock_t fs_lock;
+
+// Compressed files are read one block at a time through these buffers. The last block
+// unpacked stays in fs_unpack_out, so small sequential reads decompress it only once.
+static uint8_t fs_unpack_in[FOUR_KB];
+static uint8_t fs_unpack_out[FOUR_KB];
+static lock_t fs_unpack_lock;		// held while a task uses the buffers, possibly asleep on the disk
+static uint32_t fs_unpack_inode = FS_NO_BLOCK;	// file and block held by fs_unpack_out
+static uint32_t fs_unpack_index;
+static uint32_t fs_unpack_generation;
+
+// Hashed index of the boot block directory, built once in fs_init
+static uint8_t dentry_hash_head[DENTRY_HASH_SIZE];	// first dentry in each bucket
+static uint8_t dentry_hash_next[MAX_DENTRIES];		// next dentry in the same bucket
+static uint32_t dentry_hash_val[MAX_DENTRIES];		// full hash, checked before comparing names
+static uint8_t dentry_name_len[MAX_DENTRIES];		// name length, at most FILENAME_LEN
+
+// Names looked up in subdirectories, direct mapped by directory and name hash
+static fs_dcache_t fs_dcache[DCACHE_SIZE];
+static uint32_t fs_dir_queue[FS_MAX_INODES];	// directories still to scan in fs_bitmap_build
+
+extern int (*rtc_driver[DRIVER_OPS]);
+extern int (*file_driver[DRIVER_OPS]);
+extern int (*dir_driver[DRIVER_OPS]);
+extern int (*terminal_driver[DRIVER_OPS]);
 
-extern int (*rtc_driver[4]);
-extern int (*file_driver[4]);
-extern int (*dir_driver[4]);
-extern int (*terminal_driver[4]);
+/*
+ * uint32_t fs_name_hash(const int8_t * name, uint32_t * len)
+ *   DESCRIPTION: FNV-1a hash of a filename, stopping at a NUL, at a slash (so it takes one
+ *				  component of a path) or after FILENAME_LEN + 1 bytes
+ *	 INPUTS: name - the name to hash
+ *			 len - filled with the name length (FILENAME_LEN + 1 means too long to exist)
+ *   OUTPUTS: none
+ *   RETURN VALUE: the hash of the name
+ *   SIDE EFFECTS: none
+ */
+
+static uint32_t
+fs_name_hash(const int8_t * name, uint32_t * len)
+{
+	uint32_t hash = 2166136261U;
+	uint32_t i;
+
+	for (i = 0; i <= FILENAME_LEN && name[i] != '\0' && name[i] != '/'; i++) {
+		hash ^= (uint8_t) name[i];
+		hash *= 16777619U;
+	}
+
+	*len = i;
+	return hash;
+}
+
+/*
+ * void fs_index_add(uint32_t i)
+ *   DESCRIPTION: Hashes one dentry of the boot block into the name index
+ *	 INPUTS: i - index of the dentry
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the dentry can be found by read_dentry_by_name
+ */
+
+static void
+fs_index_add(uint32_t i)
+{
+	int8_t name[FILENAME_LEN + 1];
+	uint32_t len, bucket;
+
+	// Stored names are not NUL terminated when they use all 32 bytes
+	memcpy(name, boot_block->dentry_directory[i].filename, FILENAME_LEN);
+	name[FILENAME_LEN] = '\0';
+
+	dentry_hash_val[i] = fs_name_hash(name, &len);
+	dentry_name_len[i] = len;
+
+	// Insert at the head so the chain is walked newest first
+	bucket = dentry_hash_val[i] & DENTRY_HASH_MASK;
+	dentry_hash_next[i] = dentry_hash_head[bucket];
+	dentry_hash_head[bucket] = i;
+}
+
+/*
+ * void fs_index_build()
+ *   DESCRIPTION: Hashes every dentry in the boot block into the name index
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: overwrites the dentry hash table
+ */
+
+static void
+fs_index_build()
+{
+	uint32_t i;
+
+	memset(dentry_hash_head, DENTRY_NONE, DENTRY_HASH_SIZE);
+
+	for (i = 0; i < num_directories; i++)
+		fs_index_add(i);
+}
+
+/*
+ * uint32_t fs_dentry_name_len(const dentry_t * dentry)
+ *   DESCRIPTION: Length of a stored name, which is not NUL terminated when it fills all
+ *				  FILENAME_LEN bytes
+ *	 INPUTS: dentry - the entry
+ *   OUTPUTS: none
+ *   RETURN VALUE: the length
+ *   SIDE EFFECTS: none
+ */
+
+static uint32_t
+fs_dentry_name_len(const dentry_t * dentry)
+{
+	uint32_t len;
+
+	for (len = 0; len < FILENAME_LEN && dentry->filename[len] != '\0'; len++);
+	return len;
+}
+
+/*
+ * uint32_t fs_is_subdir(const dentry_t * dentry)
+ *   DESCRIPTION: Checks whether an entry names a subdirectory. The root's "." entry is a
+ *				  directory too, but has no inode of its own.
+ *	 INPUTS: dentry - the entry
+ *   OUTPUTS: none
+ *   RETURN VALUE: non-zero for a subdirectory
+ *   SIDE EFFECTS: none
+ */
+
+static uint32_t
+fs_is_subdir(const dentry_t * dentry)
+{
+	if (dentry->filetype != DIRECTORY_TYPE || dentry->inode_index >= num_inodes) return 0;
+
+	return strncmp(dentry->filename, ".", 2) != 0 && strncmp(dentry->filename, "..", 3) != 0;
+}
+
+/*
+ * uint32_t fs_dir_entries(uint32_t dir)
+ *   DESCRIPTION: Number of entries in a directory
+ *	 INPUTS: dir - the directory's inode, FS_ROOT_DIR for the root
+ *   OUTPUTS: none
+ *   RETURN VALUE: the count
+ *   SIDE EFFECTS: none
+ */
+
+static uint32_t
+fs_dir_entries(uint32_t dir)
+{
+	if (dir == FS_ROOT_DIR) return num_directories;
+
+	return inodes[dir].length / sizeof(dentry_t);
+}
+
+/*
+ * int32_t fs_dir_entry(uint32_t dir, uint32_t index, dentry_t * dentry)
+ *   DESCRIPTION: Copies one entry of a directory
+ *	 INPUTS: dir - the directory's inode, FS_ROOT_DIR for the root
+ *			 index - which entry
+ *			 dentry - where to copy it
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 past the last entry or on a disk error
+ *   SIDE EFFECTS: may read the disk
+ */
+
+static int32_t
+fs_dir_entry(uint32_t dir, uint32_t index, dentry_t * dentry)
+{
+	if (dir == FS_ROOT_DIR) return read_dentry_by_index(index, dentry);
+
+	if (index >= fs_dir_entries(dir)) return -1;
+	return read_data(dir, index * sizeof(dentry_t), (uint8_t *) dentry, sizeof(dentry_t)) == sizeof(dentry_t) ? 0 : -1;
+}
+
+/*
+ * int32_t fs_dir_lookup(uint32_t dir, const int8_t * name, dentry_t * dentry)
+ *   DESCRIPTION: Finds one name in one directory. The root goes through the name index;
+ *				  a subdirectory is scanned once, after which the answer comes from the
+ *				  dcache until another name takes its slot.
+ *	 INPUTS: dir - the directory's inode, FS_ROOT_DIR for the root
+ *			 name - the name, ended by a NUL or a slash
+ *			 dentry - filled with the entry found
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the name is not there
+ *   SIDE EFFECTS: may read the disk
+ */
+
+static int32_t
+fs_dir_lookup(uint32_t dir, const int8_t * name, dentry_t * dentry)
+{
+	fs_dcache_t * slot;
+	uint32_t hash, len, i, count;
+	uint8_t curr;
+
+	// Names longer than FILENAME_LEN can never match, so fail before hashing them all
+	hash = fs_name_hash(name, &len);
+	if (len == 0 || len > FILENAME_LEN) return -1;
+
+	if (dir == FS_ROOT_DIR) {
+		// Walk only the bucket for this hash; an empty bucket is an immediate miss
+		for (curr = dentry_hash_head[hash & DENTRY_HASH_MASK]; curr != DENTRY_NONE; curr = dentry_hash_next[curr]) {
+			if (dentry_hash_val[curr] != hash || dentry_name_len[curr] != len) continue;
+
+			if (strncmp(name, boot_block->dentry_directory[curr].filename, len) == 0) {
+				//copy the whole needed bytes for the dentry
+				memcpy(dentry, &(boot_block->dentry_directory[curr]), sizeof(dentry_t));
+				return 0;
+			}
+		}
+		// Filename not found
+		return -1;
+	}
+
+	// Mix in the directory so the same name in different directories gets different slots
+	slot = &fs_dcache[(hash ^ (dir * 2654435761U)) & DCACHE_MASK];
+	if (slot->dir == dir && fs_dentry_name_len(&slot->dentry) == len &&
+		strncmp(name, slot->dentry.filename, len) == 0) {
+		memcpy(dentry, &slot->dentry, sizeof(dentry_t));
+		return 0;
+	}
+
+	count = fs_dir_entries(dir);
+	for (i = 0; i < count; i++) {
+		if (fs_dir_entry(dir, i, dentry) == -1) return -1;
+		if (fs_dentry_name_len(dentry) != len || strncmp(name, dentry->filename, len) != 0) continue;
+
+		slot->dir = dir;
+		memcpy(&slot->dentry, dentry, sizeof(dentry_t));
+		return 0;
+	}
+	return -1;
+}
+
+/*
+ * int32_t fs_path_walk(const int8_t * path, uint32_t * dir, const int8_t ** last)
+ *   DESCRIPTION: Resolves every component of a slash separated path but the last. Paths
+ *				  start at the root whether or not they begin with a slash; "." and ".."
+ *				  are followed without looking them up, and ".." at the root stays there.
+ *	 INPUTS: path - the path
+ *			 dir - filled with the directory holding the last component
+ *			 last - filled with the last component, ended by a NUL or a slash, or NULL
+ *					when the path names dir itself ("", "/", "a/..")
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if a directory on the way is missing or too deep
+ *   SIDE EFFECTS: may read the disk
+ */
+
+static int32_t
+fs_path_walk(const int8_t * path, uint32_t * dir, const int8_t ** last)
+{
+	uint32_t parents[FS_MAX_DEPTH];
+	uint32_t depth = 0, len;
+	const int8_t * next;
+	dentry_t dentry;
+
+	*dir = FS_ROOT_DIR;
+	*last = NULL;
+
+	while (1) {
+		while (*path == '/') path++;
+		if (*path == '\0') return 0;
+
+		fs_name_hash(path, &len);
+		if (len > FILENAME_LEN) return -1;
+		for (next = path + len; *next == '/'; next++);
+
+		if (len == 1 && path[0] == '.') {
+			// Stays in the same directory
+		} else if (len == 2 && path[0] == '.' && path[1] == '.') {
+			if (depth > 0) *dir = parents[--depth];
+		} else if (*next == '\0') {
+			*last = path;
+			return 0;
+		} else {
+			if (fs_dir_lookup(*dir, path, &dentry) == -1 || !fs_is_subdir(&dentry)) return -1;
+			if (depth == FS_MAX_DEPTH) return -1;
+
+			parents[depth++] = *dir;
+			*dir = dentry.inode_index;
+		}
+		path = next;
+	}
+}
+
+/*
+ * Bitmap helpers for the free block and free inode maps
+ */
+
+static uint32_t
+fs_bit_test(uint32_t * map, uint32_t i)
+{
+	return map[i / BITS_PER_WORD] & (1 << (i % BITS_PER_WORD));
+}
+
+static void
+fs_bit_set(uint32_t * map, uint32_t i)
+{
+	map[i / BITS_PER_WORD] |= 1 << (i % BITS_PER_WORD);
+}
+
+static void
+fs_bit_clear(uint32_t * map, uint32_t i)
+{
+	map[i / BITS_PER_WORD] &= ~(1 << (i % BITS_PER_WORD));
+}
+
+/*
+ * void fs_meta_mark(uint32_t block)
+ *   DESCRIPTION: Notes that the in-memory copy of a metadata block has changed
+ *	 INPUTS: block - 0 for the boot block, 1 + n for inode n
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the block is written at the next sync; nothing for a module
+ */
+
+static void
+fs_meta_mark(uint32_t block)
+{
+	if (fs_on_disk && block < FS_META_BLOCKS) fs_bit_set(fs_meta_dirty, block);
+}
+
+/*
+ * uint32_t fs_inode_blocks(uint32_t length)
+ *   DESCRIPTION: Number of data blocks a file of the given length uses
+ *	 INPUTS: length - file length in bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: the block count
+ *   SIDE EFFECTS: none
+ */
+
+static uint32_t
+fs_inode_blocks(uint32_t length)
+{
+	return length / FOUR_KB + (length % FOUR_KB != 0);
+}
+
+/*
+ * uint32_t fs_max_blocks()
+ *   DESCRIPTION: Largest number of data blocks one file can have in the mounted layout
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the block count
+ *   SIDE EFFECTS: none
+ */
+
+static uint32_t
+fs_max_blocks()
+{
+	return fs_indirect ? INODE_MAX_BLOCKS_INDIRECT : INODE_MAX_BLOCKS;
+}
+
+/*
+ * uint8_t * fs_block_get(uint32_t block)
+ *   DESCRIPTION: Returns the contents of a data block: in place for a module, through the
+ *				  buffer cache for a disk. Every call is paired with fs_block_put.
+ *	 INPUTS: block - index of the data block
+ *   OUTPUTS: none
+ *   RETURN VALUE: the block's 4 KB, NULL on a disk error
+ *   SIDE EFFECTS: may read the disk
+ */
+
+static uint8_t *
+fs_block_get(uint32_t block)
+{
+	if (fs_on_disk) return bcache_get(fs_data_start + block);
+
+	return data_blocks[block].byte;
+}
+
+/*
+ * uint8_t * fs_block_get_clear(uint32_t block)
+ *   DESCRIPTION: Like fs_block_get for a block about to be overwritten; the contents are
+ *				  zeroed rather than read
+ *	 INPUTS: block - index of the data block
+ *   OUTPUTS: none
+ *   RETURN VALUE: the block's 4 KB, NULL if the buffer cache is full
+ *   SIDE EFFECTS: none
+ */
+
+static uint8_t *
+fs_block_get_clear(uint32_t block)
+{
+	if (fs_on_disk) return bcache_get_clear(fs_data_start + block);
+
+	memset(data_blocks[block].byte, 0, FOUR_KB);
+	return data_blocks[block].byte;
+}
+
+/*
+ * void fs_block_put(uint8_t * data, uint32_t dirty)
+ *   DESCRIPTION: Releases a block from fs_block_get
+ *	 INPUTS: data - the block's contents
+ *			 dirty - non-zero if the caller changed it
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: a dirty disk block is written back later
+ */
+
+static void
+fs_block_put(uint8_t * data, uint32_t dirty)
+{
+	if (!fs_on_disk || data == NULL) return;
+
+	if (dirty) bcache_dirty(data);
+	bcache_put(data);
+}
+
+/*
+ * void fs_map_release(fs_map_t * map)
+ *   DESCRIPTION: Lets go of the table a map holds
+ *	 INPUTS: map - the map
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: a changed table is written back later
+ */
+
+static void
+fs_map_release(fs_map_t * map)
+{
+	fs_block_put((uint8_t *) map->entries, map->dirty);
+	map->entries = NULL;
+	map->dirty = 0;
+}
+
+/*
+ * uint32_t * fs_map_load(fs_map_t * map, uint32_t table, uint32_t first)
+ *   DESCRIPTION: Makes a map hold a table, releasing the one it held before
+ *	 INPUTS: map - the map
+ *			 table - data block of the table
+ *			 first - file block of its first entry, FS_NO_BLOCK for a table of tables
+ *   OUTPUTS: none
+ *   RETURN VALUE: the table's entries, NULL if table is not a data block or the disk failed
+ *   SIDE EFFECTS: may read the disk
+ */
+
+static uint32_t *
+fs_map_load(fs_map_t * map, uint32_t table, uint32_t first)
+{
+	if (map->entries != NULL && map->table == table) {
+		map->first = first;
+		return map->entries;
+	}
+
+	fs_map_release(map);
+	if (table >= num_data_blocks) return NULL;
+
+	map->entries = (uint32_t *) fs_block_get(table);
+	map->table = table;
+	map->first = first;
+	return map->entries;
+}
+
+/*
+ * uint32_t * fs_bmap_slot(uint32_t inode, uint32_t block, fs_map_t * map)
+ *   DESCRIPTION: Finds where the data block number of one block of a file is kept: in the
+ *				  inode, or in a table the map is left holding. A block in the same table as
+ *				  the last lookup costs nothing more.
+ *	 INPUTS: inode - the inode offset for the file
+ *			 block - index of the block within the file; its tables must exist
+ *			 map - table held between lookups, released by the caller
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the block number, NULL past the largest file or on a disk error
+ *   SIDE EFFECTS: may read the disk
+ */
+
+static uint32_t *
+fs_bmap_slot(uint32_t inode, uint32_t block, fs_map_t * map)
+{
+	inode_t * inode_addr = &inodes[inode];
+	uint32_t first, table, i;
+
+	if (!fs_indirect) return block < INODE_MAX_BLOCKS ? inode_addr->data + block : NULL;
+	if (block < INODE_DIRECT_BLOCKS) return inode_addr->data + block;
+
+	if (map->entries != NULL && block >= map->first && block - map->first < BLOCK_POINTERS)
+		return &map->entries[block - map->first];
+
+	if (block < INODE_DIRECT_BLOCKS + BLOCK_POINTERS) {
+		first = INODE_DIRECT_BLOCKS;
+		table = inode_addr->data[INODE_INDIRECT];
+	} else {
+		i = (block - INODE_DIRECT_BLOCKS - BLOCK_POINTERS) / BLOCK_POINTERS;
+		if (i >= BLOCK_POINTERS) return NULL;
+
+		first = INODE_DIRECT_BLOCKS + BLOCK_POINTERS + i * BLOCK_POINTERS;
+		if (fs_map_load(map, inode_addr->data[INODE_DOUBLE_INDIRECT], FS_NO_BLOCK) == NULL) return NULL;
+		table = map->entries[i];
+	}
+
+	if (fs_map_load(map, table, first) == NULL) return NULL;
+	return &map->entries[block - first];
+}
+
+/*
+ * uint32_t fs_bmap(uint32_t inode, uint32_t block, fs_map_t * map)
+ *   DESCRIPTION: Data block number of one block of a file
+ *	 INPUTS: inode - the inode offset for the file
+ *			 block - index of the block within the file
+ *			 map - table held between lookups, released by the caller
+ *   OUTPUTS: none
+ *   RETURN VALUE: the data block, FS_NO_BLOCK if it cannot be found
+ *   SIDE EFFECTS: may read the disk
+ */
+
+static uint32_t
+fs_bmap(uint32_t inode, uint32_t block, fs_map_t * map)
+{
+	uint32_t * slot = fs_bmap_slot(inode, block, map);
+
+	return slot == NULL ? FS_NO_BLOCK : *slot;
+}
+
+/*
+ * uint32_t fs_compressed(uint32_t inode)
+ *   DESCRIPTION: Checks whether a file's data blocks hold a packed stream
+ *	 INPUTS: inode - the inode offset for the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: non-zero if the file is compressed
+ *   SIDE EFFECTS: none
+ */
+
+static uint32_t
+fs_compressed(uint32_t inode)
+{
+	return inode < FS_MAX_INODES && (boot_block->compressed[inode / BITS_PER_WORD] & (1 << (inode % BITS_PER_WORD)));
+}
+
+/*
+ * int32_t fs_read_blocks(uint32_t inode, uint32_t offset, uint8_t * buf, uint32_t length)
+ *   DESCRIPTION: Copies bytes out of a file's data blocks, one memcpy per block touched, with
+ *				  no check against the file length. For a compressed file the offsets are
+ *				  into the packed stream.
+ *	 INPUTS: inode - the inode offset for the file
+ *			 offset - offset into the data blocks to start reading
+ *			 buf - buffer to copy into
+ *			 length - number of bytes to copy
+ *   OUTPUTS: none
+ *   RETURN VALUE: length on success, -1 if a block cannot be found or read
+ *   SIDE EFFECTS: may read the disk
+ */
+
+static int32_t
+fs_read_blocks(uint32_t inode, uint32_t offset, uint8_t * buf, uint32_t length)
+{
+	uint32_t block, block_offset, chunk, bytes_read, data_block;
+	fs_map_t map = { 0, 0, NULL, 0 };
+	uint8_t *data;
+
+	block = offset / FOUR_KB;
+	block_offset = offset % FOUR_KB;
+
+	// Copy the partial head block, then whole blocks, then the partial tail. The map keeps
+	// the current table, so only every BLOCK_POINTERS-th block pays for a table lookup.
+	for (bytes_read = 0; bytes_read < length; bytes_read += chunk) {
+		data_block = fs_bmap(inode, block, &map);
+		data = data_block < num_data_blocks ? fs_block_get(data_block) : NULL;
+		if (data == NULL) {
+			fs_map_release(&map);
+			return -1;
+		}
+
+		chunk = FOUR_KB - block_offset;
+		if (chunk > length - bytes_read) chunk = length - bytes_read;
+
+		memcpy(buf + bytes_read, data + block_offset, chunk);
+		fs_block_put(data, 0);
+
+		block++;
+		block_offset = 0;
+	}
+
+	fs_map_release(&map);
+	return bytes_read;
+}
+
+/*
+ * uint32_t fs_stored_blocks(uint32_t inode)
+ *   DESCRIPTION: Number of data blocks a file occupies: enough for its length, or for the
+ *				  packed stream of a compressed file, whose last table entry is its length
+ *	 INPUTS: inode - the inode offset for the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: the block count
+ *   SIDE EFFECTS: may read the disk
+ */
+
+static uint32_t
+fs_stored_blocks(uint32_t inode)
+{
+	uint32_t blocks = fs_inode_blocks(inodes[inode].length);
+	uint32_t end;
+
+	if (blocks != 0 && fs_compressed(inode)) {
+		if (fs_read_blocks(inode, (blocks - 1) * sizeof(uint32_t), (uint8_t *) &end, sizeof(end)) == -1)
+			return 0;
+		blocks = fs_inode_blocks(end);
+	}
+
+	if (blocks > fs_max_blocks()) blocks = fs_max_blocks();
+	return blocks;
+}
+
+/*
+ * int32_t fs_unpack(uint32_t inode, uint32_t block, uint32_t size)
+ *   DESCRIPTION: Leaves one block of a compressed file in fs_unpack_out, decompressing its
+ *				  chunk unless the block is already there. The caller holds fs_unpack_lock.
+ *	 INPUTS: inode - the inode offset for the file
+ *			 block - index of the block within the file
+ *			 size - bytes of the file in that block: FOUR_KB, less for the last one
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the chunk is corrupt or cannot be read
+ *   SIDE EFFECTS: may read the disk
+ */
+
+static int32_t
+fs_unpack(uint32_t inode, uint32_t block, uint32_t size)
+{
+	uint32_t bounds[2];
+	uint32_t start, end;
+
+	if (fs_unpack_inode == inode && fs_unpack_index == block && fs_unpack_generation == fs_generation)
+		return 0;
+	fs_unpack_inode = FS_NO_BLOCK;
+
+	// The chunk runs from the end of the one before it (or of the table) to its own end
+	if (block == 0) {
+		if (fs_read_blocks(inode, 0, (uint8_t *) &bounds[1], sizeof(uint32_t)) == -1) return -1;
+		bounds[0] = fs_inode_blocks(inodes[inode].length) * sizeof(uint32_t);
+	} else if (fs_read_blocks(inode, (block - 1) * sizeof(uint32_t), (uint8_t *) bounds, sizeof(bounds)) == -1) {
+		return -1;
+	}
+	start = bounds[0];
+	end = bounds[1];
+	if (end < start || end - start > size) return -1;
+
+	if (end - start == size) {
+		if (fs_read_blocks(inode, start, fs_unpack_out, size) == -1) return -1;
+	} else {
+		if (fs_read_blocks(inode, start, fs_unpack_in, end - start) == -1) return -1;
+		if (lz4_decompress(fs_unpack_in, end - start, fs_unpack_out, size) != size) return -1;
+	}
+
+	fs_unpack_inode = inode;
+	fs_unpack_index = block;
+	fs_unpack_generation = fs_generation;
+	return 0;
+}
+
+/*
+ * int32_t fs_read_packed(uint32_t inode, uint32_t offset, uint8_t * buf, uint32_t length)
+ *   DESCRIPTION: read_data for a compressed file: each block touched is decompressed, then
+ *				  the wanted part copied out a piece at a time through a stack buffer
+ *	 INPUTS: inode - the inode offset for the file
+ *			 offset - offset into the file, inside it
+ *			 buf - buffer to copy into
+ *			 length - number of bytes to copy, not past the end of the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: length on success, -1 on failure
+ *   SIDE EFFECTS: may sleep until another task is done decompressing
+ */
+
+static int32_t
+fs_read_packed(uint32_t inode, uint32_t offset, uint8_t * buf, uint32_t length)
+{
+	uint8_t bounce[FS_UNPACK_BOUNCE];
+	uint32_t file_length = inodes[inode].length;
+	uint32_t block, block_offset, chunk, size, bytes_read;
+	int32_t ret;
+
+	for (bytes_read = 0; bytes_read < length; bytes_read += chunk) {
+		block = (offset + bytes_read) / FOUR_KB;
+		block_offset = (offset + bytes_read) % FOUR_KB;
+
+		size = file_length - block * FOUR_KB;
+		if (size > FOUR_KB) size = FOUR_KB;
+
+		chunk = size - block_offset;
+		if (chunk > length - bytes_read) chunk = length - bytes_read;
+		if (chunk > FS_UNPACK_BOUNCE) chunk = FS_UNPACK_BOUNCE;
+
+		// buf may be a user page whose fault reads a compressed program, so it is written
+		// only after the buffers are let go
+		lock_acquire(&fs_unpack_lock);
+		ret = fs_unpack(inode, block, size);
+		if (ret == 0) memcpy(bounce, fs_unpack_out + block_offset, chunk);
+		lock_release(&fs_unpack_lock);
+
+		if (ret == -1) return -1;
+		memcpy(buf + bytes_read, bounce, chunk);
+	}
+
+	return bytes_read;
+}
+
+/*
+ * void fs_bitmap_mark(uint32_t inode)
+ *   DESCRIPTION: Marks an inode, and the data blocks and tables it uses, as allocated
+ *	 INPUTS: inode - the inode of a file or subdirectory
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: sets bits in both bitmaps
+ */
+
+static void
+fs_bitmap_mark(uint32_t inode)
+{
+	inode_t * inode_addr = &inodes[inode];
+	uint32_t b, blocks, block;
+	fs_map_t map = { 0, 0, NULL, 0 };
+
+	fs_bit_set(inode_bitmap, inode);
+
+	blocks = fs_stored_blocks(inode);
+	for (b = 0; b < blocks; b++) {
+		block = fs_bmap(inode, b, &map);
+		if (block < num_data_blocks) fs_bit_set(block_bitmap, block);
+
+		// The tables are in use too
+		if (map.entries != NULL) fs_bit_set(block_bitmap, map.table);
+	}
+	if (fs_indirect && blocks > INODE_DIRECT_BLOCKS + BLOCK_POINTERS &&
+		inode_addr->data[INODE_DOUBLE_INDIRECT] < num_data_blocks)
+		fs_bit_set(block_bitmap, inode_addr->data[INODE_DOUBLE_INDIRECT]);
+
+	fs_map_release(&map);
+}
+
+/*
+ * void fs_bitmap_build()
+ *   DESCRIPTION: Marks the inodes of every file and subdirectory reachable from the boot
+ *				  block, and the data blocks they use, as allocated. Everything else is free
+ *				  for new data. Directories are scanned breadth first from a queue, and an
+ *				  inode already marked is not followed again, so a loop in a corrupt image
+ *				  cannot hang the mount.
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: overwrites both bitmaps
+ */
+
+static void
+fs_bitmap_build()
+{
+	dentry_t dentry;
+	uint32_t i, count, dir = FS_ROOT_DIR, head = 0, tail = 0;
+
+	memset(block_bitmap, 0, sizeof(block_bitmap));
+	memset(inode_bitmap, 0, sizeof(inode_bitmap));
+
+	while (1) {
+		count = fs_dir_entries(dir);
+		for (i = 0; i < count && fs_dir_entry(dir, i, &dentry) == 0; i++) {
+			if (dentry.inode_index >= num_inodes || fs_bit_test(inode_bitmap, dentry.inode_index)) continue;
+
+			if (dentry.filetype == FILE_TYPE) {
+				fs_bitmap_mark(dentry.inode_index);
+			} else if (fs_is_subdir(&dentry)) {
+				fs_bitmap_mark(dentry.inode_index);
+				fs_dir_queue[tail++] = dentry.inode_index;
+			}
+		}
+
+		if (head == tail) break;
+		dir = fs_dir_queue[head++];
+	}
+}
+
+/*
+ * uint32_t fs_block_alloc(uint32_t hint, uint32_t want)
+ *   DESCRIPTION: Allocates a zeroed data block. The block right after hint is taken if it is
+ *				  free so files stay contiguous; otherwise the first free run of at least want
+ *				  blocks is used, falling back to the longest free run.
+ *	 INPUTS: hint - the file's previous data block, FS_NO_BLOCK if it has none
+ *			 want - how many blocks the caller is about to allocate in a row
+ *   OUTPUTS: none
+ *   RETURN VALUE: index of the block, FS_NO_BLOCK if the file system is full
+ *   SIDE EFFECTS: marks the block allocated; the caller holds fs_lock
+ */
+
+static uint32_t
+fs_block_alloc(uint32_t hint, uint32_t want)
+{
+	uint32_t i, run_start = 0, run_len = 0, best_start = FS_NO_BLOCK, best_len = 0;
+	uint8_t * data;
+
+	if (hint != FS_NO_BLOCK && hint + 1 < num_data_blocks && !fs_bit_test(block_bitmap, hint + 1)) {
+		best_start = hint + 1;
+	} else {
+		for (i = 0; i < num_data_blocks; i++) {
+			if (fs_bit_test(block_bitmap, i)) {
+				run_len = 0;
+				continue;
+			}
+
+			if (run_len++ == 0) run_start = i;
+			if (run_len > best_len) {
+				best_start = run_start;
+				best_len = run_len;
+			}
+			if (run_len >= want) break;
+		}
+	}
+
+	if (best_start == FS_NO_BLOCK) return FS_NO_BLOCK;
+
+	data = fs_block_get_clear(best_start);
+	if (data == NULL) return FS_NO_BLOCK;
+	fs_block_put(data, 1);
+
+	// Keep the image's own block count covering every block in use
+	if (fs_on_disk && best_start >= boot_block->data_block_num) {
+		boot_block->data_block_num = best_start + 1;
+		fs_meta_mark(0);
+	}
+
+	fs_bit_set(block_bitmap, best_start);
+	return best_start;
+}
+
+/*
+ * uint32_t fs_bmap_add(uint32_t inode, uint32_t block, uint32_t hint, uint32_t want, fs_map_t * map)
+ *   DESCRIPTION: Gives a file its next data block, along with any table that block is the
+ *				  first entry of. Tables are placed just ahead of the blocks they list.
+ *	 INPUTS: inode - the inode offset for the file
+ *			 block - index of the new block within the file, equal to its current block count
+ *			 hint - the file's previous data block, FS_NO_BLOCK if it has none
+ *			 want - how many blocks the caller is about to add in a row
+ *			 map - table held between lookups, released by the caller
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new data block, FS_NO_BLOCK if the file system is full
+ *   SIDE EFFECTS: nothing is left allocated on failure
+ */
+
+static uint32_t
+fs_bmap_add(uint32_t inode, uint32_t block, uint32_t hint, uint32_t want, fs_map_t * map)
+{
+	inode_t * inode_addr = &inodes[inode];
+	uint32_t new_tables[2], tables = 0, data, * slot, * top;
+
+	if (fs_indirect && block == INODE_DIRECT_BLOCKS) {
+		if ((hint = fs_block_alloc(hint, want + 1)) == FS_NO_BLOCK) return FS_NO_BLOCK;
+		inode_addr->data[INODE_INDIRECT] = new_tables[tables++] = hint;
+	} else if (fs_indirect && block >= INODE_DIRECT_BLOCKS + BLOCK_POINTERS &&
+		(block - INODE_DIRECT_BLOCKS - BLOCK_POINTERS) % BLOCK_POINTERS == 0) {
+		if (block == INODE_DIRECT_BLOCKS + BLOCK_POINTERS) {
+			if ((hint = fs_block_alloc(hint, want + 2)) == FS_NO_BLOCK) return FS_NO_BLOCK;
+			inode_addr->data[INODE_DOUBLE_INDIRECT] = new_tables[tables++] = hint;
+		}
+
+		if ((hint = fs_block_alloc(hint, want + 1)) == FS_NO_BLOCK) goto fail;
+		new_tables[tables++] = hint;
+
+		top = fs_map_load(map, inode_addr->data[INODE_DOUBLE_INDIRECT], FS_NO_BLOCK);
+		if (top == NULL) goto fail;
+		top[(block - INODE_DIRECT_BLOCKS - BLOCK_POINTERS) / BLOCK_POINTERS] = hint;
+		map->dirty = 1;
+	}
+
+	if ((data = fs_block_alloc(hint, want)) == FS_NO_BLOCK) goto fail;
+
+	if ((slot = fs_bmap_slot(inode, block, map)) == NULL) {
+		fs_bit_clear(block_bitmap, data);
+		goto fail;
+	}
+	*slot = data;
+	if (fs_indirect && block >= INODE_DIRECT_BLOCKS) map->dirty = 1;
+	return data;
+
+fail:
+	while (tables > 0) fs_bit_clear(block_bitmap, new_tables[--tables]);
+	return FS_NO_BLOCK;
+}
+
+/*
+ * void fs_blocks_free(uint32_t inode, uint32_t from, uint32_t to, fs_map_t * map)
+ *   DESCRIPTION: Frees the data blocks of a file from index to up to (not including) from,
+ *				  and every table left with nothing to list
+ *	 INPUTS: inode - the inode offset for the file
+ *			 from - the file's current block count
+ *			 to - the block count it is cut down to
+ *			 map - table held between lookups, released by the caller
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the inode still lists the blocks; the caller sets the new length
+ */
+
+static void
+fs_blocks_free(uint32_t inode, uint32_t from, uint32_t to, fs_map_t * map)
+{
+	inode_t * inode_addr = &inodes[inode];
+	uint32_t b, block;
+
+	for (b = from; b-- > to;) {
+		block = fs_bmap(inode, b, map);
+		if (block < num_data_blocks) fs_bit_clear(block_bitmap, block);
+
+		if (!fs_indirect || b < INODE_DIRECT_BLOCKS) continue;
+
+		// The map holds the table listing b; if b is its first entry the table is now empty
+		if (map->entries != NULL && b == map->first) {
+			block = map->table;
+			fs_map_release(map);
+			fs_bit_clear(block_bitmap, block);
+		}
+
+		if (b == INODE_DIRECT_BLOCKS + BLOCK_POINTERS && inode_addr->data[INODE_DOUBLE_INDIRECT] < num_data_blocks)
+			fs_bit_clear(block_bitmap, inode_addr->data[INODE_DOUBLE_INDIRECT]);
+	}
+}
+
+/*
+ * int32_t fs_resize(uint32_t inode, uint32_t length)
+ *   DESCRIPTION: Grows or shrinks a file to length bytes. New bytes read as zeros.
+ *	 INPUTS: inode - the inode offset for the file
+ *			 length - the new length
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the file system is full, the file too large, or blocks
+ *					it would free are mapped by mmap or the file system view
+ *   SIDE EFFECTS: allocates or frees data blocks; the caller holds fs_lock
+ */
+
+static int32_t
+fs_resize(uint32_t inode, uint32_t length)
+{
+	inode_t * inode_addr = &inodes[inode];
+	uint32_t old_blocks = fs_inode_blocks(inode_addr->length);
+	uint32_t new_blocks = fs_inode_blocks(length);
+	uint32_t b, hint = FS_NO_BLOCK;
+	fs_map_t map = { 0, 0, NULL, 0 };
+	uint8_t * data;
+
+	if (new_blocks > fs_max_blocks()) return -1;
+
+	// A block still mapped read-only into a process must not be handed to another file
+	if (new_blocks < old_blocks && (fs_inode_mmaps[inode] != 0 || paging_fs_mapped())) return -1;
+
+	if (old_blocks > 0) hint = fs_bmap(inode, old_blocks - 1, &map);
+
+	for (b = old_blocks; b < new_blocks; b++) {
+		hint = fs_bmap_add(inode, b, hint, new_blocks - b, &map);
+
+		if (hint == FS_NO_BLOCK) {
+			// Out of space: give back what this call took
+			fs_blocks_free(inode, b, old_blocks, &map);
+			fs_map_release(&map);
+			return -1;
+		}
+	}
+
+	if (new_blocks < old_blocks) {
+		fs_blocks_free(inode, old_blocks, new_blocks, &map);
+		fs_generation++;
+	}
+
+	// Clear the cut off tail of the last block so growing the file again reads zeros
+	if (length < inode_addr->length && length % FOUR_KB) {
+		b = fs_bmap(inode, new_blocks - 1, &map);
+		data = b < num_data_blocks ? fs_block_get(b) : NULL;
+		if (data != NULL) memset(data + length % FOUR_KB, 0, FOUR_KB - length % FOUR_KB);
+		fs_block_put(data, 1);
+	}
+
+	fs_map_release(&map);
+	inode_addr->length = length;
+	fs_meta_mark(1 + inode);
+	return 0;
+}
+
+/*
+ * int32_t fs_mount_disk()
+ *   DESCRIPTION: Reads the boot block and inodes of a file system image from the ATA disk.
+ *				  Data blocks stay on the disk and are read through the buffer cache.
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if there is no disk or it does not hold an image
+ *   SIDE EFFECTS: sets boot_block to the in-memory copy
+ */
+
+static int32_t
+fs_mount_disk()
+{
+	boot_block_t * disk_boot_block = (boot_block_t *) &fs_disk_meta[0];
+
+	if (ata_init() == -1) return -1;
+	bcache_init();
+
+	if (ata_read(0, BCACHE_SECTORS, disk_boot_block) == -1) return -1;
+
+	// The inodes have to fit in memory, and the image has to fit on the disk
+	if (disk_boot_block->inode_num > FS_DISK_MAX_INODES) return -1;
+	if ((1 + disk_boot_block->inode_num + disk_boot_block->data_block_num) * BCACHE_SECTORS > ata_sectors()) return -1;
+
+	if (disk_boot_block->inode_num &&
+		ata_read(BCACHE_SECTORS, disk_boot_block->inode_num * BCACHE_SECTORS, &fs_disk_meta[1]) == -1)
+		return -1;
+
+	boot_block = disk_boot_block;
+	fs_on_disk = 1;
+	return 0;
+}
+
+/*
+ * int32_t fs_init(module_t * mod)
+ *   DESCRIPTION: This function initializes the file system, sets up the pointers and information relating to it inside the file system file.
+ *				  Without a module the image is mounted from the ATA disk instead.
+ *	 INPUTS: A pointer to the module that holds the file system information, or NULL to use the disk
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if there is no file system
+ *   SIDE EFFECTS: file system pointers and numbers associated with the file system
+ */
+
+int32_t 
+fs_init(module_t *mod)
+{
+	uint32_t i;
+
+	if (mod != NULL) {
+		// Mod start passed from kernal.c and points to boot block
+		boot_block = (boot_block_t*) mod->mod_start;
+		fs_end = mod->mod_end;
+	} else if (fs_mount_disk() == -1) {
+		printf("No file system module or disk\n");
+		return -1;
+	}
+
+	if (boot_block->version != 0 && boot_block->version != FS_VERSION_INDIRECT) {
+		printf("Unknown file system version %d\n", boot_block->version);
+		return -1;
+	}
+	fs_indirect = boot_block->version == FS_VERSION_INDIRECT;
+
+	num_directories = boot_block->dir_entry_num;
+	num_inodes = boot_block->inode_num;
+
+	inodes = (inode_t *) (boot_block + 1);
+	data_blocks = (data_block_t *) (inodes + num_inodes);
+	fs_data_start = 1 + num_inodes;
+
+	// New files get the free memory after the image, up to FS_MEM_END, or the rest of the disk
+	num_data_blocks = boot_block->data_block_num;
+	if (fs_on_disk) {
+		num_data_blocks = ata_sectors() / BCACHE_SECTORS - fs_data_start;
+		// The end of the disk is the swap area (kernel/swap.c) when the image leaves room for it
+		if (num_data_blocks >= boot_block->data_block_num + SWAP_SLOTS) num_data_blocks -= SWAP_SLOTS;
+	} else if ((uint32_t) data_blocks < FS_MEM_END && (FS_MEM_END - (uint32_t) data_blocks) / FOUR_KB > num_data_blocks) {
+		num_data_blocks = (FS_MEM_END - (uint32_t) data_blocks) / FOUR_KB;
+	}
+	if (num_data_blocks > FS_MAX_BLOCKS) num_data_blocks = FS_MAX_BLOCKS;
+
+	if (num_directories > MAX_DENTRIES) num_directories = MAX_DENTRIES;
+	if (num_inodes > FS_MAX_INODES) num_inodes = FS_MAX_INODES;
+	for (i = 0; i < DCACHE_SIZE; i++) fs_dcache[i].dir = FS_ROOT_DIR;
+	fs_index_build();
+	fs_bitmap_build();
+
+	printf("Boot Block loaded at address: 0x%#x%s\n", (unsigned int)boot_block, fs_on_disk ? " (from disk)" : "");
+	printf("iNodes: %d\n", boot_block->inode_num);
+	printf("Dir Entries: %d\n", boot_block->dir_entry_num);
+	printf("Data Blocks: %d (%d with free space)\n", boot_block->data_block_num, num_data_blocks);
+	if (fs_indirect) printf("Indirect blocks: files up to %d blocks\n", INODE_MAX_BLOCKS_INDIRECT);
+	if (!fs_on_disk && num_data_blocks <= boot_block->data_block_num)
+		printf("No room after the image: the file system is full\n");
+	else if (!fs_on_disk)
+		printf("Writable space: %d KB (up to 0x%#x)\n", (num_data_blocks - boot_block->data_block_num) * FOUR_KB / 1024, FS_MEM_END);
+	return 0;
+}
+
+/*
+ * boot_block_t * fs_get_boot_block(void)
+ *   DESCRIPTION: Returns the boot block of the mounted file system
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the boot block
+ *   SIDE EFFECTS: none
+ */
+
+boot_block_t *
+fs_get_boot_block(void)
+{
+	return boot_block;
+}
+
+/*
+ * uint32_t fs_disk_end(void)
+ *   DESCRIPTION: First disk sector past the data blocks the file system may use; the rest of
+ *				  the disk is free for the swap area
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the sector, 0 if the file system is not on disk
+ *   SIDE EFFECTS: none
+ */
+
+uint32_t
+fs_disk_end(void)
+{
+	if (!fs_on_disk) return 0;
+
+	return (fs_data_start + num_data_blocks) * BCACHE_SECTORS;
+}
+
+/*
+ * uint32_t fs_image_length(void)
+ *   DESCRIPTION: Size of the in memory file system, from the boot block to the end of the
+ *				  last data block new files may use, so all of it can be mapped for reading
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: length in bytes, 0 if the file system is on disk and has no fixed address
+ *   SIDE EFFECTS: none
+ */
+
+uint32_t
+fs_image_length(void)
+{
+	if (fs_on_disk || boot_block == NULL) return 0;
+
+	return (uint32_t) (data_blocks + num_data_blocks) - (uint32_t) boot_block;
+}
+
+/*
+ * int32_t read_dentry_by_name (const int8_t* fname, dentry_t * dentry)
+ *   DESCRIPTION: This function reads a file, or a directory, by its path
+ *	 INPUTS: fname - the path of the file, slash separated from the root
+ 			 dentry - the directory entry	  
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success
+ *					-1 on failure
+ *   SIDE EFFECTS: a path naming a directory itself ("", ".", "a/") gets an entry called
+ *				  "." whose inode_index is the directory (FS_ROOT_DIR for the root)
+ */
+
+int32_t 
+read_dentry_by_name (const int8_t* fname, dentry_t * dentry)
+{
+	const int8_t * last;
+	uint32_t dir;
+
+	//check for dentry null
+	if(fname == NULL || dentry == NULL) return -1;
+
+	if (fs_path_walk(fname, &dir, &last) == -1) return -1;
+	if (last != NULL) return fs_dir_lookup(dir, last, dentry);
+
+	memset(dentry, 0, sizeof(dentry_t));
+	dentry->filename[0] = '.';
+	dentry->filetype = DIRECTORY_TYPE;
+	dentry->inode_index = dir;
+	return 0;
+}
+
+/*
+ * int32_t read_dentry_by_index(uint32_t index, dentry_t * dentry)
+ *   DESCRIPTION: This function reads a file based on an offset
+ *	 INPUTS: index - the index from the dir 
+ 			 dentry - the directory entry to copy into  
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success
+ *					-1 on failure
+ *   SIDE EFFECTS: none
+ */
+
+int32_t 
+read_dentry_by_index(uint32_t index, dentry_t * dentry)
+{
+
+	if (index < num_directories && index >= 0 && dentry != NULL) {
+		//should ask which index is passed in
+		memcpy(dentry, &(boot_block->dentry_directory[index]), sizeof(dentry_t));
+		return 0;
+	}
+	else { 
+		return -1;
+	}
+}
+
+/*
+ * int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length)
+ *   DESCRIPTION: This file reads the data from a file, one memcpy per data block touched.
+ *				  The blocks of a compressed file are decompressed on the way.
+ *	 INPUTS: inode - the inode offset for the file 
+ 			 offset - offset into a file to start reading
+ 			 buf - buffer to copy it into
+ 			 length - number of bytes to copy  
+ *   OUTPUTS: none
+ *   RETURN VALUE: # of bytes copied on success, 0 at or past the end of the file
+ *					-1 on failure
+ *   SIDE EFFECTS: none
+ */
+
+int32_t 
+read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length)
+{
+
+	uint32_t file_length;
+	inode_t *inode_addr;
+
+	if(inode >= num_inodes || buf == NULL)  // checking the parameter
+		return -1;
+
+	inode_addr = &inodes[inode]; // getting the address of the specific inode
+
+	file_length = inode_addr->length; // How many bytes of data are in this file
+
+	if (offset >= file_length) return 0;
+
+	// Never copy past the end of the file
+	if (length > file_length - offset) length = file_length - offset;
+
+	if (fs_compressed(inode)) return fs_read_packed(inode, offset, buf, length);
+	return fs_read_blocks(inode, offset, buf, length);
+}
+
+/*
+ * void fs_mmap_hold(uint32_t inode)
+ *   DESCRIPTION: Counts a new mmap of a file; its blocks are not freed while it has any
+ *	 INPUTS: inode - the inode offset for the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: truncating the file shorter fails until fs_mmap_drop
+ */
+
+void
+fs_mmap_hold(uint32_t inode)
+{
+	if (inode < FS_MAX_INODES) fs_inode_mmaps[inode]++;
+}
+
+/*
+ * void fs_mmap_drop(uint32_t inode)
+ *   DESCRIPTION: Forgets an mmap of a file counted by fs_mmap_hold
+ *	 INPUTS: inode - the inode offset for the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+
+void
+fs_mmap_drop(uint32_t inode)
+{
+	if (inode < FS_MAX_INODES && fs_inode_mmaps[inode] != 0) fs_inode_mmaps[inode]--;
+}
+
+/*
+ * uint8_t * fs_data_block(uint32_t inode, uint32_t block)
+ *   DESCRIPTION: Finds the data block that holds one 4 KB block of a file
+ *	 INPUTS: inode - the inode offset for the file
+ *			 block - index of the block within the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: address of the data block, NULL if the block is past the end of the file,
+ *					the file is compressed, or the file system is on disk, where blocks have
+ *					no fixed address
+ *   SIDE EFFECTS: none
+ */
+
+uint8_t *
+fs_data_block(uint32_t inode, uint32_t block)
+{
+	fs_map_t map = { 0, 0, NULL, 0 };
+	uint32_t data_block;
+
+	if (fs_on_disk || inode >= num_inodes || fs_compressed(inode) ||
+		block >= fs_inode_blocks(inodes[inode].length))
+		return NULL;
+
+	data_block = fs_bmap(inode, block, &map);
+	fs_map_release(&map);
+
+	return data_block < num_data_blocks ? data_blocks[data_block].byte : NULL;
+}
+
+/*
+ * int32_t fs_write_data(uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length)
+ *   DESCRIPTION: Writes data into a file, one memcpy per data block touched. The file grows
+ *				  to cover the write; a gap before offset reads as zeros.
+ *	 INPUTS: inode - the inode offset for the file
+ 			 offset - offset into the file to start writing
+ 			 buf - buffer to copy from
+ 			 length - number of bytes to copy
+ *   OUTPUTS: none
+ *   RETURN VALUE: # of bytes written on success
+ *					-1 on failure, or if the file is compressed
+ *   SIDE EFFECTS: allocates data blocks, drops cached program pages of the file; the caller
+ *				  holds fs_lock
+ */
+
+static int32_t
+fs_write_data(uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length)
+{
+	uint32_t block, block_offset, chunk, bytes_written, data_block;
+	inode_t *inode_addr;
+	fs_map_t map = { 0, 0, NULL, 0 };
+	uint8_t *data;
+
+	if (inode >= num_inodes || !fs_bit_test(inode_bitmap, inode) || fs_compressed(inode) || buf == NULL)
+		return -1;
+
+	if (offset + length < offset) return -1;
+
+	inode_addr = &inodes[inode];
+	if (offset + length > inode_addr->length && fs_resize(inode, offset + length) == -1)
+		return -1;
+
+	block = offset / FOUR_KB;
+	block_offset = offset % FOUR_KB;
+
+	for (bytes_written = 0; bytes_written < length; bytes_written += chunk) {
+		chunk = FOUR_KB - block_offset;
+		if (chunk > length - bytes_written) chunk = length - bytes_written;
+
+		// A whole block is replaced outright, with no need to read the old one
+		data_block = fs_bmap(inode, block, &map);
+		data = data_block >= num_data_blocks ? NULL :
+			chunk == FOUR_KB ? fs_block_get_clear(data_block) : fs_block_get(data_block);
+		if (data == NULL) break;
+
+		memcpy(data + block_offset, buf + bytes_written, chunk);
+		fs_block_put(data, 1);
+
+		block++;
+		block_offset = 0;
+	}
+
+	fs_map_release(&map);
+	image_cache_invalidate(inode);
+	if (bytes_written == 0 && length != 0) return -1;
+	return bytes_written;
+}
+
+/*
+ * int32_t write_data(uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length)
+ *   DESCRIPTION: fs_write_data under fs_lock
+ *	 INPUTS: inode - the inode offset for the file
+ 			 offset - offset into the file to start writing
+ 			 buf - buffer to copy from
+ 			 length - number of bytes to copy
+ *   OUTPUTS: none
+ *   RETURN VALUE: # of bytes written on success
+ *					-1 on failure, or if the file is compressed
+ *   SIDE EFFECTS: may sleep until another task is done changing the file system
+ */
+
+int32_t
+write_data(uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length)
+{
+	int32_t ret;
+
+	lock_acquire(&fs_lock);
+	ret = fs_write_data(inode, offset, buf, length);
+	lock_release(&fs_lock);
+
+	return ret;
+}
+
+/*
+ * int32_t fs_dentry_new(uint32_t dir, const int8_t * name, uint32_t filetype)
+ *   DESCRIPTION: Adds an entry for a new, empty inode to a directory. The root keeps its
+ *				  entries in the boot block, so it is limited to MAX_DENTRIES; a subdirectory
+ *				  grows by one dentry_t at its end.
+ *	 INPUTS: dir - the directory's inode, FS_ROOT_DIR for the root
+ *			 name - the new name, ended by a NUL or a slash
+ *			 filetype - FILE_TYPE or DIRECTORY_TYPE
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new inode on success
+ *					-1 if the name is bad or taken, or there is no free dentry or inode
+ *   SIDE EFFECTS: may write the directory's data blocks; the caller holds fs_lock
+ */
+
+static int32_t
+fs_dentry_new(uint32_t dir, const int8_t * name, uint32_t filetype)
+{
+	dentry_t dentry, *new_dentry;
+	uint32_t len, inode;
+
+	fs_name_hash(name, &len);
+	if (len == 0 || len > FILENAME_LEN) return -1;
+	if (strncmp(name, ".", len) == 0 || strncmp(name, "..", len) == 0) return -1;
+	if (dir == FS_ROOT_DIR && num_directories >= MAX_DENTRIES) return -1;
+	if (fs_dir_lookup(dir, name, &dentry) == 0) return -1;
+
+	for (inode = 0; inode < num_inodes && fs_bit_test(inode_bitmap, inode); inode++);
+	if (inode == num_inodes) return -1;
+
+	fs_bit_set(inode_bitmap, inode);
+	inodes[inode].length = 0;
+	boot_block->compressed[inode / BITS_PER_WORD] &= ~(1 << (inode % BITS_PER_WORD));
+
+	new_dentry = dir == FS_ROOT_DIR ? &boot_block->dentry_directory[num_directories] : &dentry;
+	memset(new_dentry, 0, sizeof(dentry_t));
+	strncpy(new_dentry->filename, name, len);
+	new_dentry->filetype = filetype;
+	new_dentry->inode_index = inode;
+
+	if (dir == FS_ROOT_DIR) {
+		fs_index_add(num_directories);
+		boot_block->dir_entry_num = ++num_directories;
+		fs_meta_mark(0);
+	} else if (fs_write_data(dir, inodes[dir].length, (uint8_t *) &dentry, sizeof(dentry_t)) != sizeof(dentry_t)) {
+		fs_bit_clear(inode_bitmap, inode);
+		return -1;
+	}
+	fs_meta_mark(1 + inode);
+
+	return inode;
+}
 
 /*
- * int32_t fs_init(module_t * mod)
- *   DESCRIPTION: This function initializes the file system, sets up the pointers and information relating to it inside the file system file
- *	 INPUTS: A pointer to the module that holds the file system information	  
+ * int32_t fs_create(const int8_t * fname)
+ *   DESCRIPTION: Creates an empty regular file
+ *	 INPUTS: fname - the path of the new file; the directories above it must exist
  *   OUTPUTS: none
- *   RETURN VALUE: 0 on success
- *   SIDE EFFECTS: file system pointers and numbers associated with the file system
+ *   RETURN VALUE: the inode of the file on success
+ *					-1 if the name is bad or taken, or there is no free dentry or inode
+ *   SIDE EFFECTS: adds a dentry to the parent directory
  */
 
-int32_t 
-fs_init(module_t *mod)
+int32_t
+fs_create(const int8_t * fname)
 {
-	// Mod start passed from kernal.c and points to boot block
-	boot_block = (boot_block_t*) mod->mod_start;
-	fs_end = mod->mod_end;
-	num_directories = boot_block->dir_entry_num;
-	num_inodes = boot_block->inode_num;
+	const int8_t * last;
+	uint32_t dir;
+	int32_t inode = -1;
 
-	printf("Boot Block loaded at address: 0x%#x\n", (unsigned int)boot_block);
-	printf("iNodes: %d\n", boot_block->inode_num);
-	printf("Dir Entries: %d\n", boot_block->dir_entry_num);
-	printf("Data Blocks: %d\n", boot_block->data_block_num);
-	return 0;
+	if (fname == NULL) return -1;
+
+	lock_acquire(&fs_lock);
+	if (fs_path_walk(fname, &dir, &last) == 0 && last != NULL)
+		inode = fs_dentry_new(dir, last, FILE_TYPE);
+	lock_release(&fs_lock);
+
+	return inode;
 }
 
 /*
- * int32_t read_dentry_by_name (const int8_t* fname, dentry_t * dentry)
- *   DESCRIPTION: This function reads a file
- *	 INPUTS: fname - the name of the file
- 			 dentry - the directory entry	  
+ * int32_t fs_mkdir(const int8_t * path)
+ *   DESCRIPTION: Creates an empty directory
+ *	 INPUTS: path - the path of the new directory; the directories above it must exist
  *   OUTPUTS: none
- *   RETURN VALUE: 0 on success
- *					-1 on failure
- *   SIDE EFFECTS: none
+ *   RETURN VALUE: the inode of the directory on success
+ *					-1 if the name is bad or taken, or there is no free dentry or inode
+ *   SIDE EFFECTS: adds a dentry to the parent directory
  */
 
-int32_t 
-read_dentry_by_name (const int8_t* fname, dentry_t * dentry)
+int32_t
+fs_mkdir(const int8_t * path)
 {
+	const int8_t * last;
+	uint32_t dir;
+	int32_t inode = -1;
 
-	int currFile;
+	if (path == NULL) return -1;
 
-	//check for dentry null
-	if(dentry == NULL) return -1;
-
-	//Transversing the the inode block for 0 to 63
-	for(currFile = 0; currFile < num_directories; currFile++) {
-		//checking the length of the string using strlen
-		if(strlen(fname) != strlen(boot_block->dentry_directory[currFile].filename)) continue;
-		
-		//comparing the name of the 'file'
-		//if it's the same, the copy three thisng
-
-		if(strncmp(fname, boot_block->dentry_directory[currFile].filename, strlen(fname)) == 0) {
-			//copy the whole needed bytes for the dentry
-			memcpy(dentry, &(boot_block->dentry_directory[currFile]), sizeof(dentry_t));
-			return 0;
-		}
-	}
-	// Filename not found
-	return -1;
+	lock_acquire(&fs_lock);
+	if (fs_path_walk(path, &dir, &last) == 0 && last != NULL)
+		inode = fs_dentry_new(dir, last, DIRECTORY_TYPE);
+	lock_release(&fs_lock);
+
+	return inode;
 }
 
 /*
- * int32_t read_dentry_by_index(uint32_t index, dentry_t * dentry)
- *   DESCRIPTION: This function reads a file based on an offset
- *	 INPUTS: index - the index from the dir 
- 			 dentry - the directory entry to copy into  
+ * int32_t fs_truncate(uint32_t inode, uint32_t length)
+ *   DESCRIPTION: Sets the length of a file, freeing blocks past the end or adding zeros
+ *	 INPUTS: inode - the inode offset for the file
+ *			 length - the new length
  *   OUTPUTS: none
  *   RETURN VALUE: 0 on success
- *					-1 on failure
- *   SIDE EFFECTS: none
+ *					-1 on failure, or if the file is compressed
+ *   SIDE EFFECTS: drops cached program pages of the file
  */
 
-int32_t 
-read_dentry_by_index(uint32_t index, dentry_t * dentry)
+int32_t
+fs_truncate(uint32_t inode, uint32_t length)
 {
+	int32_t ret = -1;
 
-	if (index < num_directories && index >= 0 && dentry != NULL) {
-		//should ask which index is passed in
-		memcpy(dentry, &(boot_block->dentry_directory[index]), sizeof(dentry_t));
-		return 0;
+	lock_acquire(&fs_lock);
+	if (inode < num_inodes && fs_bit_test(inode_bitmap, inode) && !fs_compressed(inode) &&
+		fs_resize(inode, length) == 0) {
+		image_cache_invalidate(inode);
+		ret = 0;
 	}
-	else { 
+	lock_release(&fs_lock);
+
+	return ret;
+}
+
+/*
+ * int32_t fs_meta_write(uint32_t block)
+ *   DESCRIPTION: Writes a metadata block to the disk if it changed since the last write
+ *	 INPUTS: block - 0 for the boot block, 1 + n for inode n
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success (or if it was clean), -1 on a disk error
+ *   SIDE EFFECTS: may sleep on the disk
+ */
+
+static int32_t
+fs_meta_write(uint32_t block)
+{
+	uint32_t flags, dirty;
+
+	// Clear first: a change made while the write sleeps marks the block again
+	cli_and_save(flags);
+	dirty = fs_bit_test(fs_meta_dirty, block);
+	fs_bit_clear(fs_meta_dirty, block);
+	restore_flags(flags);
+
+	if (!dirty) return 0;
+
+	if (ata_write(block * BCACHE_SECTORS, BCACHE_SECTORS, &fs_disk_meta[block]) == -1) {
+		fs_meta_mark(block);
 		return -1;
 	}
+	return 0;
 }
 
 /*
- * int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length)
- *   DESCRIPTION: This file reads the data from a file
- *	 INPUTS: inode - the inode offset for the file 
- 			 offset - offset into a file to start reading
- 			 buf - buffer to copy it into
- 			 length - number of bytes to copy  
+ * int32_t fs_sync(void)
+ *   DESCRIPTION: Writes every dirty data block, then the changed boot block and inodes, and
+ *				  has the drive commit them. Data goes first so no inode on disk points at
+ *				  blocks that were never written.
+ *	 INPUTS: none
  *   OUTPUTS: none
- *   RETURN VALUE: # of bytes copied on success
- *					-1 on failure
- *   SIDE EFFECTS: none
+ *   RETURN VALUE: 0 on success, -1 if any write failed
+ *   SIDE EFFECTS: may sleep on the disk; does nothing for a module
  */
 
-int32_t 
-read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length)
+int32_t
+fs_sync(void)
 {
+	uint32_t block;
+	int32_t ret;
 
-	uint32_t data_block_addr, file_length, i, bytes_in_block_read;
-	inode_t *inode_addr;
-	data_block_t *current_block;
+	if (!fs_on_disk) return 0;
+
+	ret = bcache_flush();
+	for (block = 0; block < fs_data_start; block++) {
+		if (fs_meta_write(block) == -1) ret = -1;
+	}
+	if (ata_flush() == -1) ret = -1;
+
+	return ret;
+}
+
+/*
+ * int32_t fs_fsync(uint32_t inode)
+ *   DESCRIPTION: Like fs_sync, but only for one file's data blocks and inode, plus the boot
+ *				  block in case the file is new
+ *	 INPUTS: inode - the inode offset for the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the inode is not a file or a write failed
+ *   SIDE EFFECTS: may sleep on the disk
+ */
+
+int32_t
+fs_fsync(uint32_t inode)
+{
+	fs_map_t map = { 0, 0, NULL, 0 };
+	uint32_t b, blocks;
+	int32_t ret = 0;
 
-	if(inode < 0 || buf == NULL || length < 0 || offset < 0)  // checking the parameter
+	if (inode >= num_inodes || !fs_bit_test(inode_bitmap, inode))
 		return -1;
 
-	inode_addr = (inode_t *) (((uint32_t) boot_block) + (inode + 1) * FOUR_KB); 						  // getting the address of the specific inode
-	data_block_addr = ((uint32_t) boot_block) + (((boot_block->inode_num) + 1) * FOUR_KB);// getting the first address of the data blocks
+	if (!fs_on_disk) return 0;
 
-	file_length = inode_addr->length; // How many bytes of data are in this file
-	current_block = (data_block_t *) (data_block_addr + (inode_addr->data[offset/FOUR_KB] * FOUR_KB)); // Grab the addr of the first data_block
+	blocks = fs_stored_blocks(inode);
+	for (b = 0; b < blocks; b++) {
+		if (bcache_sync(fs_data_start + fs_bmap(inode, b, &map)) == -1) ret = -1;
+
+		// And each table, once
+		if (map.entries != NULL && b == map.first && bcache_sync(fs_data_start + map.table) == -1) ret = -1;
+	}
+	if (fs_indirect && b > INODE_DIRECT_BLOCKS + BLOCK_POINTERS &&
+		bcache_sync(fs_data_start + inodes[inode].data[INODE_DOUBLE_INDIRECT]) == -1) ret = -1;
+	fs_map_release(&map);
+
+	if (fs_meta_write(0) == -1 || fs_meta_write(1 + inode) == -1) ret = -1;
+	if (ata_flush() == -1) ret = -1;
 
-	bytes_in_block_read = 0;
+	return ret;
+}
 
-	if (offset > file_length) return 0;
+/*
+ * void fs_flusher(void)
+ *   DESCRIPTION: Body of the flusher task. It sleeps until the PIT says a flush is due, then
+ *				  syncs, so writers only ever touch the cache.
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: never returns
+ *   SIDE EFFECTS: starts with interrupts off, from the scheduler
+ */
 
-	// iterate through the entire length to read
-	for (i = 0; i < length; i++) {
-		buf[i] = current_block->byte[offset % FOUR_KB];
-		// printf("Byte: 0x%#x, offset: %d\n", buf[i], offset);
+static void
+fs_flusher(void)
+{
+	uint16_t pid = pcb_process()->pid;
 
-		if (++offset % FOUR_KB == 0) {
-			current_block = (data_block_t *) (data_block_addr + (inode_addr->data[offset/FOUR_KB] * FOUR_KB));
+	while (1) {
+		cli();
+		while (!fs_flush_due) {
+			unschedule_task(pid);
+			asm volatile("sti; hlt; cli");
 		}
-		
-		if (offset > file_length) break;
+		fs_flush_due = 0;
+		sti();
 
-		bytes_in_block_read++;
+		fs_sync();
 	}
+}
+
+/*
+ * void fs_flusher_init(void)
+ *   DESCRIPTION: Starts the flusher task when the file system is on disk
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: takes a pid; the task first runs at the first wake-up
+ */
+
+void
+fs_flusher_init(void)
+{
+	if (!fs_on_disk) return;
+
+	fs_flusher_pid = tasks_kernel_thread(fs_flusher);
+	if (fs_flusher_pid == -1) printf("No pid for the file system flusher\n");
+}
+
+/*
+ * void fs_flusher_wake(void)
+ *   DESCRIPTION: Called from the PIT every FS_FLUSH_TICKS to have the flusher run
+ *	 INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: schedules the flusher task
+ */
+
+void
+fs_flusher_wake(void)
+{
+	if (fs_flusher_pid == -1) return;
 
-	return bytes_in_block_read;
+	fs_flush_due = 1;
+	schedule_task(fs_flusher_pid);
 }
 
 /*
@@ -186,80 +1714,67 @@ file_open(const uint8_t *filename)
 			break;
 	}
 	
-	if (dentry.filetype == FILE_TYPE) curr_pcb->elements[fd].inode_ptr = dentry.inode_index;
+	if (dentry.filetype == FILE_TYPE) {
+		if (dentry.inode_index >= num_inodes) {
+			pcb_close(curr_pcb, fd);
+			return -1;
+		}
+		curr_pcb->elements[fd].inode_ptr = dentry.inode_index;
+		curr_pcb->elements[fd].inode = &inodes[dentry.inode_index];
+	}
+
+	// A directory keeps its inode in inode_ptr only, so file operations still refuse it
+	if (dentry.filetype == DIRECTORY_TYPE) {
+		if (dentry.inode_index != FS_ROOT_DIR && !fs_is_subdir(&dentry)) {
+			pcb_close(curr_pcb, fd);
+			return -1;
+		}
+		curr_pcb->elements[fd].inode_ptr = dentry.inode_index;
+	}
 
 	return fd;
 }
 
 /*
- * int file_write(uint32_t inode, void* buf, uint32_t bytes)
- *   DESCRIPTION: Writes to a file from the buffer into the specified inode offset
- *	 INPUTS: inode - offset in the inodes
+ * int file_write(uint32_t fd, const void* buf, uint32_t bytes)
+ *   DESCRIPTION: Writes to a file at the descriptor's position, growing the file when the
+ *				  write runs past its end
+ *	 INPUTS: fd - the file descriptor to write to
  *			 buf - buffer to copy from
  * 			 bytes - number of bytes to copy 
  *   OUTPUTS: none
- *   RETURN VALUE: 0 on success
+ *   RETURN VALUE: # of bytes written on success
  *				   -1 on failure
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: advances the file position
  */
 
 int 
-file_write(uint32_t inode, void* buf, uint32_t bytes)
+file_write(uint32_t fd, const void* buf, uint32_t bytes)
 {
-	// uint32_t data_block_addr;
-	// dentry_t * dentry_;
-	// dentry_t test2;
-	// dentry_ = &test2;
-	// inode_t* inode_addr,inode_addr2;
-	
-	// printf("Test to write a file\n");
-	// dentry_t* test;
-	// num_files++;
-	// num_directories++;
-	// test=&boot_block->dentry_directory[16];
-	
-	// test->filename[0]='t';
-	// test->filename[1]='e';
-	// test->filename[2]='s';
-	// test->filename[3]='t';
-	// test->filename[4]='.';
-	// test->filename[5]='t';
-	// test->filename[6]='x';
-	// test->filename[7]='t';
-
-	// test->filetype=2;
-	// test->inode_index=boot_block->inode_num;
-	// boot_block->dir_entry_num++;
-	// num_files = boot_block->dir_entry_num;
-	
+	file_descriptor_element_t * file = &pcb_process()->elements[fd];
+	int32_t bytes_written;
 
-	// uint32_t temp_pointer;
-	// data_block_addr = ((uint32_t) boot_block) + (((boot_block->inode_num) + 1) * FOUR_KB);
-	// int i;
-	// for(i=boot_block->data_block_num;i>0;i--){
-	// 	temp_pointer=data_block_addr+((i-1)*FOUR_KB);
-	// 	memcpy((data_block_t*)temp_pointer+FOUR_KB,(data_block_t*) temp_pointer, FOUR_KB);
-	// }
+	// file is not in use, or is a directory or RTC
+	if (!file->flags || file->inode == NULL) return -1;
 
-	// inode_t* insert=(inode_t*)data_block_addr;
-	// insert->length=174;
-	// insert->data[0]=0;
+	bytes_written = write_data(file->inode_ptr, file->file_position, buf, bytes);
+	if (bytes_written == -1) return -1;
 
-
-	return -1;
+	file->file_position += bytes_written;
+	return bytes_written;
 }
 
 /*
- * int file_read(uint32_t inode, uint32_t offset, void* buf, uint32_t bytes)
- *   DESCRIPTION: Read the data in a file
- *	 INPUTS: inode - offset in the inodes
- *			 offset - offset to start reading
+ * int file_read(uint32_t fd, void* buf, uint32_t bytes)
+ *   DESCRIPTION: Read the data in a file from the descriptor's position, continuing
+ *				  from the descriptor's cached data block instead of looking it up again
+ *	 INPUTS: fd - the file descriptor to read from
  *			 buf - buffer to read into
  * 			 bytes - number of bytes to read 
  *   OUTPUTS: none
  *   RETURN VALUE: # of bytes read on success
  *				   -1 on failure
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: advances the file position and the read cursor
  */
 
 int 
@@ -267,20 +1782,156 @@ file_read(uint32_t fd, void* buf, uint32_t bytes)
 {
 	pcb_t * curr_pcb;
 	file_descriptor_element_t * file;
-	int32_t bytes_read;
+	uint32_t file_length, block, block_offset, chunk, bytes_read;
 
     curr_pcb = pcb_process();
     file = &curr_pcb->elements[fd];
 
     // file is not in use and fails
     // file is directory or RTC then fails
-    if (!file->flags) return -1;
+    if (!file->flags || file->inode == NULL) return -1;
+
+	// Disk blocks can be evicted, so there is no block pointer to keep, and a compressed
+	// block has to be unpacked first
+	if (fs_on_disk || fs_compressed(file->inode_ptr)) {
+		bytes_read = read_data(file->inode_ptr, file->file_position, buf, bytes);
+		if (bytes_read != -1) file->file_position += bytes_read;
+		return bytes_read;
+	}
+
+	file_length = file->inode->length;
+	if (file->file_position >= file_length) return 0;
+	if (bytes > file_length - file->file_position) bytes = file_length - file->file_position;
+
+	block = file->file_position / FOUR_KB;
+	block_offset = file->file_position % FOUR_KB;
+
+	for (bytes_read = 0; bytes_read < bytes; bytes_read += chunk) {
+		// Only a read that crosses into a new block pays for the lookup
+		if (file->block == NULL || file->block_index != block || file->generation != fs_generation) {
+			if ((file->block = (data_block_t *) fs_data_block(file->inode_ptr, block)) == NULL) break;
+			file->block_index = block;
+			file->generation = fs_generation;
+		}
+
+		chunk = FOUR_KB - block_offset;
+		if (chunk > bytes - bytes_read) chunk = bytes - bytes_read;
+
+		memcpy((uint8_t *) buf + bytes_read, file->block->byte + block_offset, chunk);
+
+		block++;
+		block_offset = 0;
+	}
+
+	if (bytes_read == 0 && bytes != 0) return -1;
 
-	bytes_read = read_data((uint32_t) file->inode_ptr, file->file_position, buf, bytes);
 	file->file_position += bytes_read;
 	return bytes_read;
 }
 
+/*
+ * int32_t fs_seek_target(uint32_t position, uint32_t end, int32_t offset, int32_t whence)
+ *   DESCRIPTION: Works out where an lseek lands
+ *	 INPUTS: position - the current position
+ *			 end - the position of the end of the file or directory
+ *			 offset - signed distance to move
+ *			 whence - SEEK_SET, SEEK_CUR or SEEK_END
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new position, -1 if whence is bad or the result is negative
+ *   SIDE EFFECTS: none
+ */
+
+static int32_t
+fs_seek_target(uint32_t position, uint32_t end, int32_t offset, int32_t whence)
+{
+	int32_t base;
+
+	switch (whence) {
+		case SEEK_SET: base = 0; break;
+		case SEEK_CUR: base = position; break;
+		case SEEK_END: base = end; break;
+		default: return -1;
+	}
+
+	if (base + offset < 0) return -1;
+	return base + offset;
+}
+
+/*
+ * int file_lseek(uint32_t fd, int32_t offset, int32_t whence)
+ *   DESCRIPTION: Moves the file position. Seeking past the end is allowed; a later write
+ *				  there leaves a gap of zeros.
+ *	 INPUTS: fd - the file descriptor
+ *			 offset - signed distance to move
+ *			 whence - SEEK_SET, SEEK_CUR or SEEK_END
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new position on success
+ *				   -1 on failure
+ *   SIDE EFFECTS: none
+ */
+
+int
+file_lseek(uint32_t fd, int32_t offset, int32_t whence)
+{
+	file_descriptor_element_t * file = &pcb_process()->elements[fd];
+	int32_t position;
+
+	if (!file->flags || file->inode == NULL) return -1;
+
+	position = fs_seek_target(file->file_position, file->inode->length, offset, whence);
+	if (position == -1) return -1;
+
+	// The read cursor checks its block index, so it needs no reset
+	file->file_position = position;
+	return position;
+}
+
+/*
+ * int file_pread(uint32_t fd, void* buf, uint32_t bytes, uint32_t offset)
+ *   DESCRIPTION: Reads from an explicit offset without moving the file position
+ *	 INPUTS: fd - the file descriptor to read from
+ *			 buf - buffer to read into
+ * 			 bytes - number of bytes to read
+ *			 offset - where in the file to start
+ *   OUTPUTS: none
+ *   RETURN VALUE: # of bytes read on success, 0 at or past the end of the file
+ *				   -1 on failure
+ *   SIDE EFFECTS: none
+ */
+
+int
+file_pread(uint32_t fd, void* buf, uint32_t bytes, uint32_t offset)
+{
+	file_descriptor_element_t * file = &pcb_process()->elements[fd];
+
+	if (!file->flags || file->inode == NULL) return -1;
+
+	return read_data(file->inode_ptr, offset, buf, bytes);
+}
+
+/*
+ * int file_pwrite(uint32_t fd, const void* buf, uint32_t bytes, uint32_t offset)
+ *   DESCRIPTION: Writes at an explicit offset without moving the file position
+ *	 INPUTS: fd - the file descriptor to write to
+ *			 buf - buffer to copy from
+ * 			 bytes - number of bytes to copy
+ *			 offset - where in the file to start
+ *   OUTPUTS: none
+ *   RETURN VALUE: # of bytes written on success
+ *				   -1 on failure
+ *   SIDE EFFECTS: grows the file when the write runs past its end
+ */
+
+int
+file_pwrite(uint32_t fd, const void* buf, uint32_t bytes, uint32_t offset)
+{
+	file_descriptor_element_t * file = &pcb_process()->elements[fd];
+
+	if (!file->flags || file->inode == NULL) return -1;
+
+	return write_data(file->inode_ptr, offset, buf, bytes);
+}
+
 /*
  * int file_close()
  *   DESCRIPTION: Provides an interface to close a file
@@ -302,7 +1953,8 @@ file_close(int32_t fd, void *buf, uint32_t bytes)
 
 /*
  * int dir_open(const uint8_t *dir_name)
- *   DESCRIPTION: Open a directory, provides an interface for the driver
+ *   DESCRIPTION: Open a directory, provides an interface for the driver. The path was
+ *				  already resolved by file_open, which left the directory in inode_ptr.
  *	 INPUTS: dir_name - the name of the directory to open 
  *   OUTPUTS: none
  *   RETURN VALUE: 0 on success
@@ -336,23 +1988,136 @@ dir_read(int file_desc, void* buf, uint32_t bytes)
 	
 	dentry_t * dentry_;
 	dentry_t test;
+	uint32_t index, len, dir;
 	dentry_ = &test;
 	//currentPCB
 	pcb_t* curr_pcb= pcb_process();
 
-	if(curr_pcb->elements[file_desc].file_position>=num_directories) return 0;
+	index = curr_pcb->elements[file_desc].file_position;
+	dir = curr_pcb->elements[file_desc].inode_ptr;
+	if(index>=fs_dir_entries(dir)) return 0;
 
-	read_dentry_by_index (curr_pcb->elements[file_desc].file_position,dentry_);
+	if (fs_dir_entry(dir, index, dentry_) == -1) return -1;
 
-	strcpy(buf, dentry_->filename);
+	// Full-length names are not NUL terminated, so bound the copy
+	len = fs_dentry_name_len(dentry_);
+	if (len > bytes) len = bytes;
+	strncpy(buf, dentry_->filename, len);
 	curr_pcb->elements[file_desc].file_position++;
-	return strlen(buf);
+	return len;
 
 }
 
+/*
+ * int dir_write(int file_desc, void* buf, uint32_t bytes)
+ *   DESCRIPTION: Creates an empty file in the directory
+ *	 INPUTS: file_desc - offset in the PCB
+ *			 buf - user buffer holding the name of the new file, not NUL terminated and
+ *				   without slashes
+ * 			 bytes - length of the name
+ *   OUTPUTS: none
+ *   RETURN VALUE: bytes on success
+ *				   -1 on failure
+ *   SIDE EFFECTS: adds a directory entry
+ */
+
 int
 dir_write(int file_desc, void* buf, uint32_t bytes) {
-	return -1;
+	int8_t name[FILENAME_LEN + 1];
+	uint32_t len;
+	int32_t inode;
+
+	if (bytes == 0 || bytes > FILENAME_LEN || (uint32_t) buf < KERNEL_MEM_END) return -1;
+
+	memcpy(name, buf, bytes);
+	name[bytes] = '\0';
+
+	// A slash or NUL would end the name early
+	fs_name_hash(name, &len);
+	if (len != bytes) return -1;
+
+	lock_acquire(&fs_lock);
+	inode = fs_dentry_new(pcb_process()->elements[file_desc].inode_ptr, name, FILE_TYPE);
+	lock_release(&fs_lock);
+
+	return inode == -1 ? -1 : bytes;
+}
+
+/*
+ * int dir_lseek(int file_desc, int32_t offset, int32_t whence)
+ *   DESCRIPTION: Moves the directory position, counted in entries; seeking to 0 rewinds
+ *	 INPUTS: file_desc - offset in the PCB
+ *			 offset - signed number of entries to move
+ *			 whence - SEEK_SET, SEEK_CUR or SEEK_END
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new position on success
+ *				   -1 on failure
+ *   SIDE EFFECTS: none
+ */
+
+int
+dir_lseek(int file_desc, int32_t offset, int32_t whence)
+{
+	file_descriptor_element_t * file = &pcb_process()->elements[file_desc];
+	uint32_t entries = fs_dir_entries(file->inode_ptr);
+	int32_t position;
+
+	position = fs_seek_target(file->file_position, entries, offset, whence);
+	if (position == -1 || position > entries) return -1;
+
+	file->file_position = position;
+	return position;
+}
+
+/*
+ * int32_t dir_getdents(int32_t fd, void* buf, uint32_t bytes)
+ *   DESCRIPTION: Reads as many directory entries as fit in the buffer, each as a dirent_t
+ *				  carrying the name, type, inode and size, so a listing takes a few calls
+ *				  instead of one per entry
+ *	 INPUTS: fd - an open directory
+ *			 buf - buffer to fill with records
+ * 			 bytes - size of the buffer
+ *   OUTPUTS: none
+ *   RETURN VALUE: # of bytes filled, 0 at the end of the directory
+ *				   -1 if fd is not a directory or the next record does not fit
+ *   SIDE EFFECTS: advances the directory position past the records returned
+ */
+
+int32_t
+dir_getdents(int32_t fd, void* buf, uint32_t bytes)
+{
+	file_descriptor_element_t * file = &pcb_process()->elements[fd];
+	dentry_t dentry;
+	dirent_t * record;
+	uint32_t filled = 0, rec_len, name_len, entries;
+
+	if (!file->flags || file->file_operation_jmp_tbl != (func_ptr *) dir_driver) return -1;
+
+	entries = fs_dir_entries(file->inode_ptr);
+	for (; file->file_position < entries; file->file_position++) {
+		if (fs_dir_entry(file->inode_ptr, file->file_position, &dentry) == -1) return -1;
+		name_len = fs_dentry_name_len(&dentry);
+
+		rec_len = sizeof(dirent_t) + name_len + 1;
+		rec_len = (rec_len + DIRENT_ALIGN - 1) & ~(DIRENT_ALIGN - 1);
+		if (filled + rec_len > bytes) break;
+
+		record = (dirent_t *) ((uint8_t *) buf + filled);
+		record->inode_index = dentry.inode_index;
+		record->filetype = dentry.filetype;
+		record->size = (dentry.filetype == FILE_TYPE && dentry.inode_index < num_inodes) ? inodes[dentry.inode_index].length : 0;
+		record->rec_len = rec_len;
+		record->name_len = name_len;
+		memcpy(record->name, dentry.filename, name_len);
+		record->name[name_len] = '\0';
+
+		filled += rec_len;
+	}
+
+	// Room for nothing while entries remain means the buffer is too small
+	if (filled == 0 && file->file_position < entries) return -1;
+
+	return filled;
 }
 
 /*
@@ -370,32 +2135,26 @@ dir_close() {
 }
 
 /*
- * int32_t loader(const int8_t * filename)
- *   DESCRIPTION: Loads a user level program into the appropriate place in memory (128MB + 48KB offset)
- *	 INPUTS: filename - name of the file 
+ * int32_t loader(dentry_t * dentry)
+ *   DESCRIPTION: Prepares a user level program to run at 128MB + 48KB. Nothing is copied here; the
+ *				  page fault handler pages the image in with loader_page_in as it is touched.
+ *	 INPUTS: dentry - directory entry of the program, already looked up by the caller
  *   OUTPUTS: None
- *   RETURN VALUE: 0 on success, -1 on failure
+ *   RETURN VALUE: entry point on success, -1 on failure
  *   SIDE EFFECTS: none
  */
 
 int32_t
-loader(const int8_t * filename) {
-	dentry_t dentry;
+loader(dentry_t * dentry) {
 	uint8_t entry_point[4];
 	uint32_t ret_val = 0;
 	int i;
 
-	uint32_t program_start_ptr = USER_PROGRAM_VIRTUAL_START + USER_PROGRAM_OFFSET;
-	
-	// Check if its a valid file
-	if (read_dentry_by_name(filename, &dentry)) return -1;
+	if (dentry == NULL) return -1;
 
-	// read_data(dentry.inode_index, 0, data, 7000);
-	// Loads program
-	read_data(dentry.inode_index, 0, (uint8_t *) program_start_ptr, FOUR_MB - USER_PROGRAM_OFFSET);
-	
-	// Grabs entry point
-	read_data(dentry.inode_index, ENTRY_POINT_OFFSET, entry_point, ENTRY_POINT_SIZE);
+	// Grabs entry point straight from the file
+	if (read_data(dentry->inode_index, ENTRY_POINT_OFFSET, entry_point, ENTRY_POINT_SIZE) != ENTRY_POINT_SIZE)
+		return -1;
 
 	for (i = 0; i < ENTRY_POINT_SIZE; i++) {
 		ret_val |= entry_point[i] << (i * EIGHT_BITS_IN_A_BYTE);
@@ -404,6 +2163,94 @@ loader(const int8_t * filename) {
 	return ret_val;
 }
 
+/*
+ * int32_t loader_page_in(uint32_t inode, uint32_t page, uint8_t * dest)
+ *   DESCRIPTION: Fills one 4 KB page of a program image from the program file. The file is mapped
+ *				  at USER_PROGRAM_OFFSET in the image; everything outside it reads as zeros.
+ *	 INPUTS: inode - the program file
+ *			 page - page aligned virtual address of the page in the image
+ *			 dest - where to write the 4 KB of the page
+ *   OUTPUTS: None
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: overwrites dest
+ */
+
+int32_t
+loader_page_in(uint32_t inode, uint32_t page, uint8_t * dest) {
+	uint32_t program_start_ptr = USER_PROGRAM_VIRTUAL_START + USER_PROGRAM_OFFSET;
+	int32_t bytes_read = 0;
+
+	// Pages above the program start hold the file, which ends somewhere (or nowhere) in this page
+	if (page >= program_start_ptr) {
+		bytes_read = read_data(inode, page - program_start_ptr, dest, FOUR_KB);
+		if (bytes_read == -1) return -1;
+	}
+
+	memset(dest + bytes_read, 0, FOUR_KB - bytes_read);
+	return 0;
+}
+
+/*
+ * int32_t loader_page_has_data(uint32_t inode, uint32_t page)
+ *   DESCRIPTION: Checks whether a page of a program image holds any bytes of the program file
+ *	 INPUTS: inode - the program file
+ *			 page - page aligned virtual address of the page in the image
+ *   OUTPUTS: None
+ *   RETURN VALUE: 1 if it does, 0 if the page is all zeros
+ *   SIDE EFFECTS: none
+ */
+
+int32_t
+loader_page_has_data(uint32_t inode, uint32_t page) {
+	uint32_t program_start_ptr = USER_PROGRAM_VIRTUAL_START + USER_PROGRAM_OFFSET;
+
+	if (inode >= num_inodes || page < program_start_ptr)
+		return 0;
+
+	return page - program_start_ptr < inodes[inode].length;
+}
+
+/*
+ * uint32_t loader_image_end(uint32_t inode)
+ *   DESCRIPTION: Finds the first address past a program image: the end of the file or of its
+ *				  highest loadable segment, which also counts the zero filled bss, whichever
+ *				  is later. The program's heap starts there.
+ *	 INPUTS: inode - the program file
+ *   OUTPUTS: None
+ *   RETURN VALUE: the address, not page aligned
+ *   SIDE EFFECTS: none
+ */
+
+uint32_t
+loader_image_end(uint32_t inode) {
+	uint32_t program_start_ptr = USER_PROGRAM_VIRTUAL_START + USER_PROGRAM_OFFSET;
+	elf_header_t header;
+	elf_program_header_t segment;
+	uint32_t end, i;
+
+	if (inode >= num_inodes) return program_start_ptr;
+	end = program_start_ptr + inodes[inode].length;
+
+	if (read_data(inode, 0, (uint8_t *) &header, sizeof(header)) != sizeof(header) ||
+		header.phentsize < sizeof(segment))
+		return end;
+
+	for (i = 0; i < header.phnum && i < ELF_MAX_SEGMENTS; i++) {
+		if (read_data(inode, header.phoff + i * header.phentsize, (uint8_t *) &segment, sizeof(segment)) != sizeof(segment))
+			break;
+
+		// Only segments inside the program page count
+		if (segment.type != ELF_PT_LOAD || segment.vaddr < program_start_ptr ||
+			segment.memsz > USER_PROGRAM_VIRTUAL_START + FOUR_MB - segment.vaddr)
+			continue;
+
+		if (segment.vaddr + segment.memsz > end)
+			end = segment.vaddr + segment.memsz;
+	}
+
+	return end;
+}
+
 /*
  * uint8_t executable_check(dentry_t * dentry)
  *   DESCRIPTION: Checks if a user level program is a valid executable
@@ -4,7 +4,6 @@
 #include "../lib/lib.h"
 #include "../lib/types.h"
 #include "../multiboot.h"
-#include "../kernel/pcb.h"
 
 #define FOUR_KB 0x1000
 
@@ -22,17 +21,62 @@
 
 #define ENTRY_POINT_OFFSET 24
 #define ENTRY_POINT_SIZE 4
+#define ELF_PT_LOAD 1 // program header type of a segment loaded into memory
+#define ELF_MAX_SEGMENTS 16 // program headers loader_image_end looks at
 
 #define USER_PROGRAM_VIRTUAL_START 0x8000000
 #define USER_PROGRAM_START 0x800000 // 8 MB
-#define USER_PROGRAM_OFFSET 0x048000
+#define USER_PROGRAM_OFFSET 0x048000 // must stay 4 KB aligned for loader_page_in
 #define FOUR_MB 0x400000 // 4 MB
 
+#define FILENAME_LEN 32 // names may fill all 32 bytes with no NUL
+#define MAX_DENTRIES 63
+#define DENTRY_HASH_SIZE 64 // power of two, at least MAX_DENTRIES
+#define DENTRY_HASH_MASK (DENTRY_HASH_SIZE - 1)
+#define DENTRY_NONE 0xFF // end of a hash chain
+
+// A subdirectory is an inode whose data is an array of dentry_t. The boot block's
+// entries are the root, which has no inode.
+#define FS_ROOT_DIR 0xFFFFFFFF // directory "inode" of the root
+#define FS_MAX_DEPTH 16 // directories a path may be nested in
+#define DCACHE_SIZE 128 // power of two
+#define DCACHE_MASK (DCACHE_SIZE - 1)
+
+// In module mode new data blocks go in the memory between the end of the GRUB module and
+// the lowest kernel stack (KERNEL_MEM_END - MAX_PID * KERNEL_STACK_SIZE). The kernel maps
+// nothing else the file system could address as blocks after the image, so that gap is
+// all the room there is to write; fs_init prints it.
+#define FS_MEM_END 0x780000
+#define FS_MAX_BLOCKS 65536 // size of the free block bitmap: 256 MB of data
+#define FS_MAX_INODES 256 // size of the free inode bitmap
+#define FS_DISK_MAX_INODES 64 // inodes a disk image may have; they are kept in memory
+#define FS_META_BLOCKS (1 + FS_DISK_MAX_INODES) // boot block and inodes
+#define FS_FLUSH_TICKS (5 * PIT_TICKS_PER_SEC) // how long written data may sit in memory
+#define INODE_MAX_BLOCKS 1023 // original layout: every data[] slot is a direct block
+
+// Indirect layout (boot_block_t.version FS_VERSION_INDIRECT): the last two data[] slots
+// point at a table of block numbers and at a table of such tables
+#define FS_VERSION_INDIRECT 2
+#define INODE_DIRECT_BLOCKS 1021
+#define INODE_INDIRECT 1021
+#define INODE_DOUBLE_INDIRECT 1022
+#define BLOCK_POINTERS (FOUR_KB / 4) // block numbers in a table
+#define INODE_MAX_BLOCKS_INDIRECT (INODE_DIRECT_BLOCKS + BLOCK_POINTERS + BLOCK_POINTERS * BLOCK_POINTERS)
+#define FS_NO_BLOCK 0xFFFFFFFF
+#define BITS_PER_WORD 32
+
+// Compressed files (bit set in boot_block_t.compressed) are read only. Their data blocks
+// hold a packed stream: one uint32_t per 4 KB block of the file giving the stream offset
+// where that block's chunk ends, then the chunks, the first right after the table. A chunk
+// as long as its block is stored as is; a shorter one is an LZ4 block.
+#define FS_COMPRESSED_WORDS (FS_MAX_INODES / BITS_PER_WORD)
+#define FS_UNPACK_BOUNCE 512 // bytes of a decompressed block copied out per hold of the buffers
+
 
 //all necessary structs for the filesystem
 
 typedef struct{
-	char filename[32];				//magic number
+	char filename[FILENAME_LEN];
 	uint32_t filetype;
 	uint32_t inode_index;
 	unsigned char reserved[24];				//magic number				
@@ -42,8 +86,10 @@ typedef struct{
 	uint32_t dir_entry_num;
 	uint32_t inode_num;
 	uint32_t data_block_num;
-	unsigned char reserved[52];				//magic number
-	dentry_t dentry_directory[63];			//magic number
+	uint32_t version;						// 0 for the original layout
+	uint32_t compressed[FS_COMPRESSED_WORDS];	// one bit per inode
+	unsigned char reserved[16];				//magic number
+	dentry_t dentry_directory[MAX_DENTRIES];
 } __attribute__((packed)) boot_block_t; //makesure it's next to each other
 
 
@@ -57,27 +103,119 @@ typedef struct{
 	uint32_t data[1023];	//magic number				
 } __attribute__((packed)) inode_t;
 
+// The parts of an executable's ELF header and program headers the loader reads
+typedef struct{
+	uint8_t ident[16];
+	uint16_t type;
+	uint16_t machine;
+	uint32_t version;
+	uint32_t entry;
+	uint32_t phoff;			// file offset of the program headers
+	uint32_t shoff;
+	uint32_t flags;
+	uint16_t ehsize;
+	uint16_t phentsize;		// bytes per program header
+	uint16_t phnum;
+	uint16_t shentsize;
+	uint16_t shnum;
+	uint16_t shstrndx;
+} __attribute__((packed)) elf_header_t;
+
+typedef struct{
+	uint32_t type;
+	uint32_t offset;
+	uint32_t vaddr;
+	uint32_t paddr;
+	uint32_t filesz;
+	uint32_t memsz;			// filesz plus the zero filled bss
+	uint32_t flags;
+	uint32_t align;
+} __attribute__((packed)) elf_program_header_t;
+
+// A block number table held while walking a file, so consecutive blocks
+// share one lookup of the table
+typedef struct{
+	uint32_t table;			// data block of the table, valid while entries is set
+	uint32_t first;			// file block of entries[0], FS_NO_BLOCK for a table of tables
+	uint32_t * entries;
+	uint32_t dirty;			// entries changed; written back on release
+} fs_map_t;
+
+// One name looked up in a subdirectory (the root has its own index). Root lookups are
+// never cached, so FS_ROOT_DIR marks an empty slot.
+typedef struct{
+	uint32_t dir;			// directory inode searched
+	dentry_t dentry;		// the entry the name resolved to
+} fs_dcache_t;
+
+// One record filled in by getdents. The name is NUL terminated and rec_len
+// pads the record to DIRENT_ALIGN bytes.
+typedef struct{
+	uint32_t inode_index;
+	uint32_t size;			// file length in bytes, 0 for directories and the RTC
+	uint16_t rec_len;		// bytes from this record to the next
+	uint8_t filetype;
+	uint8_t name_len;
+	char name[0];
+} __attribute__((packed)) dirent_t;
+
+#define DIRENT_ALIGN 4
+
+// lseek origins
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+// pcb.h embeds fs types in file descriptors, so it comes after them
+#include "../kernel/pcb.h"
+
 extern int32_t fs_init(module_t *mod);
+extern boot_block_t * fs_get_boot_block(void);
+extern uint32_t fs_image_length(void);
+extern uint32_t fs_disk_end(void);
+extern void fs_mmap_hold(uint32_t inode);
+extern void fs_mmap_drop(uint32_t inode);
 
 // File operations
 extern int file_open(const uint8_t *filename);
-extern int file_write(uint32_t inode, void* buf, uint32_t bytes);
+extern int file_write(uint32_t fd, const void* buf, uint32_t bytes);
 extern int file_read(uint32_t fd, void* buf, uint32_t bytes);
 extern int file_close(int32_t fd, void *buf, uint32_t bytes);
+extern int file_lseek(uint32_t fd, int32_t offset, int32_t whence);
+extern int file_pread(uint32_t fd, void* buf, uint32_t bytes, uint32_t offset);
+extern int file_pwrite(uint32_t fd, const void* buf, uint32_t bytes, uint32_t offset);
 
 // Directory operations
 extern int dir_read(int file_desc, void* buf, uint32_t bytes);
 extern int dir_open(const uint8_t *dir_name);
 extern int dir_write(int file_desc, void* buf, uint32_t bytes);
 extern int dir_close();
+extern int dir_lseek(int file_desc, int32_t offset, int32_t whence);
+extern int32_t dir_getdents(int32_t fd, void* buf, uint32_t bytes);
 
 // File reading operations
 extern int32_t read_dentry_by_name(const int8_t * fname, dentry_t * dentry);
 extern int32_t read_dentry_by_index(uint32_t index, dentry_t * dentry);
 extern int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+extern uint8_t * fs_data_block(uint32_t inode, uint32_t block);
+
+// File writing operations
+extern int32_t write_data(uint32_t inode, uint32_t offset, const uint8_t* buf, uint32_t length);
+extern int32_t fs_create(const int8_t * fname);
+extern int32_t fs_truncate(uint32_t inode, uint32_t length);
+extern int32_t fs_mkdir(const int8_t * path);
+
+// Write-back to the disk
+extern int32_t fs_sync(void);
+extern int32_t fs_fsync(uint32_t inode);
+extern void fs_flusher_init(void);
+extern void fs_flusher_wake(void);
 
 // Load an executable into the correct memory location
-extern int32_t loader(const int8_t * filename);
+extern int32_t loader(dentry_t * dentry);
+extern int32_t loader_page_in(uint32_t inode, uint32_t page, uint8_t * dest);
+extern int32_t loader_page_has_data(uint32_t inode, uint32_t page);
+extern uint32_t loader_image_end(uint32_t inode);
 extern uint8_t executable_check(dentry_t * dentry);
 
 #endif /* _FS_H_ */
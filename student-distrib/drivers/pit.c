@@ -2,6 +2,8 @@
 #include "../kernel/scheduling.h"
 #include "../kernel/irq.h"
 
+static volatile uint32_t pit_ticks; //ticks since pit_init
+
 /*
  * pit_init
  *   DESCRIPTION: Initilize the pit to default rates for our needs
@@ -38,8 +40,28 @@ pit_init(void)
 void
 pit_handler(void)
 {
+	pit_ticks++;
+
+	//Write back the file system cache now and then
+	if (pit_ticks % FS_FLUSH_TICKS == 0)
+		fs_flusher_wake();
+
 	//Send EOI
 	send_eoi(PIT_IRQ_LINE);
 	//Run the scheduler tick
 	scheduler_tick();
 }
+
+/*
+ * pit_get_ticks
+ *   DESCRIPTION: Returns the number of PIT interrupts seen so far, each
+ *				  1/PIT_TICKS_PER_SEC of a second apart.
+ *   OUTPUTS: none
+ *   RETURN VALUE: the tick count
+ *   SIDE EFFECTS: none
+ */
+uint32_t
+pit_get_ticks(void)
+{
+	return pit_ticks;
+}
@@ -17,6 +17,7 @@
 #define RATE_10MS_HI 0x2E
 
 #define PIT_IRQ_LINE 0 
+#define PIT_TICKS_PER_SEC 100 // at RATE_10MS
 
 //PIT initilization 
 extern void pit_init(void);
@@ -24,6 +25,9 @@ extern void pit_init(void);
 //PIT handler, calls scheduling tick
 extern void pit_handler(void);
 
+//Number of PIT interrupts since pit_init
+extern uint32_t pit_get_ticks(void);
+
 
 
 #endif
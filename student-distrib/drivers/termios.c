@@ -1,6 +1,8 @@
 #include "termios.h"
 #include "../kernel/pcb.h"
 #include "../kernel/paging.h"
+#include "../kernel/frame.h"
+#include "../kernel/swap.h"
 
 /* Struct to hold all terminal-related data */
 typedef struct term_data
@@ -120,6 +122,7 @@ int terminal_read(int32_t fd, void* buf, int32_t len)
 {
   int i, j; //iterator over input buffer. also count of chars copied
   char cr_read = 0; //number of cr read from in_buf
+  char swapped = 0; //set once this read has swapped the task out
   term_data_t *context_term; //the terminal data for the running task
   pcb_t *context; //PCB of running process
 
@@ -127,9 +130,18 @@ int terminal_read(int32_t fd, void* buf, int32_t len)
   context = pcb_process();
   context_term = (term_data_t *) &term_data_array[context->term]; 
 
-  //spin until a cr has been loaded into input buffer
+  //spin until a cr has been loaded into input buffer. Nobody can type into a
+  //terminal that is not shown, so when memory runs low the task gives its
+  //pages up while it waits; they fault back in once it runs again
   // if (active_term->terminal_desc == 1) return -1;
-  while(!(context_term->in_dat_nr_ret));
+  while(!(context_term->in_dat_nr_ret))
+  {
+    if(!swapped && !context_term->is_active && frame_free_count() < SWAP_LOW_FRAMES)
+    {
+      paging_swap_out(context->pid);
+      swapped = 1;
+    }
+  }
 
   //now in_buf has at least 1 cr. Copy chars from in_buf to buf until:
   //1. we fill buf
@@ -18,6 +18,10 @@
 #include "kernel/tasks.h"
 #include "drivers/pit.h"
 #include "kernel/scheduling.h"
+#include "kernel/image_cache.h"
+#include "drivers/ata.h"
+#include "kernel/frame.h"
+#include "kernel/swap.h"
 
  
 /* Macros. */
@@ -96,28 +100,6 @@ entry (unsigned long magic, unsigned long addr)
 				(unsigned) elf_sec->addr, (unsigned) elf_sec->shndx);
 	}
 
-	/* Are mmap_* valid? */
-	if (CHECK_FLAG (mbi->flags, 6))
-	{
-		memory_map_t *mmap;
-
-		/*printf ("mmap_addr = 0x%#x, mmap_length = 0x%x\n",
-				(unsigned) mbi->mmap_addr, (unsigned) mbi->mmap_length);*/
-		for (mmap = (memory_map_t *) mbi->mmap_addr;
-				(unsigned long) mmap < mbi->mmap_addr + mbi->mmap_length;
-				mmap = (memory_map_t *) ((unsigned long) mmap
-					+ mmap->size + sizeof (mmap->size))){
-			/*printf (" size = 0x%x,     base_addr = 0x%#x%#x\n"
-					"     type = 0x%x,  length    = 0x%#x%#x\n",
-					(unsigned) mmap->size,
-					(unsigned) mmap->base_addr_high,
-					(unsigned) mmap->base_addr_low,
-					(unsigned) mmap->type,
-					(unsigned) mmap->length_high,
-					(unsigned) mmap->length_low);*/
-		}
-	}
-
 	/* Construct an LDT entry in the GDT */
 	{
 		seg_desc_t the_ldt_desc;
@@ -168,12 +150,27 @@ entry (unsigned long magic, unsigned long addr)
 	//Initialize IDTR
 	lidt(idt_desc_ptr);
 
-	//Initialize File System
-	fs_init((module_t *) mbi->mods_addr);
+	//Initialize File System, from the ATA disk when GRUB loaded no module
+	if (CHECK_FLAG(mbi->flags, 3) && mbi->mods_count > 0)
+		fs_init((module_t *) mbi->mods_addr);
+	else
+		fs_init(NULL);
+
+	//Initialize the swap area at the end of the file system disk
+	swap_init();
+
+	//Initialize the physical frame allocator from the boot loader's memory map
+	frame_init(mbi);
 
 	//Initialize Paging
 	paging_init();
 
+	//Initialize the shared program image cache
+	image_cache_init();
+
+	//Load the runtime every program maps
+	paging_runtime_init();
+
 	//Initialize PIC
 	i8259_init();
 
@@ -203,6 +200,12 @@ entry (unsigned long magic, unsigned long addr)
 	//Initialize PIT
 	pit_init();
 
+	//Switch the disk to DMA now that there are tasks to put to sleep
+	ata_dma_init();
+
+	//Start writing the file system cache back in the background
+	fs_flusher_init();
+
 	clear();
 
 	//Initialize Shell
@@ -1,6 +1,9 @@
 #ifndef ASM_LINKAGE_H
 #define ASM_LINKAGE_H
 
+//highest valid system call number in __syscalls_jumptable
+#define SYSCALL_COUNT 29
+
 #ifndef ASM
 
 #include "syscall.h"
@@ -10,6 +13,10 @@ extern void keyboard_linkage();
 extern void rtc_linkage();
 extern void syscall_linkage();
 extern void pit_linkage();
+extern void ata_linkage();
+extern void page_fault_linkage();
+extern void syscall_fork_linkage();
+extern void fork_child_return();
 extern void _jump_rings(uint32_t entry);
 
 //ECE 391 system call library
@@ -24,6 +31,24 @@ extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
+extern int32_t ece391_mmap (int32_t fd, uint8_t** start);
+extern int32_t ece391_truncate (int32_t fd, uint32_t length);
+extern int32_t ece391_getdents (int32_t fd, void* buf, int32_t nbytes);
+extern int32_t ece391_lseek (int32_t fd, int32_t offset, int32_t whence);
+extern int32_t ece391_pread (int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
+extern int32_t ece391_pwrite (int32_t fd, const void* buf, int32_t nbytes, uint32_t offset);
+extern int32_t ece391_readv (int32_t fd, const iovec_t* iov, int32_t iovcnt);
+extern int32_t ece391_writev (int32_t fd, const iovec_t* iov, int32_t iovcnt);
+extern int32_t ece391_sync (void);
+extern int32_t ece391_fsync (int32_t fd);
+extern int32_t ece391_mkdir (const uint8_t* dirname);
+extern int32_t ece391_fsmap (uint8_t** start);
+extern int32_t ece391_fork (void);
+extern int32_t ece391_brk (void* addr);
+extern int32_t ece391_sbrk (int32_t increment);
+extern int32_t ece391_shm_create (uint32_t key, uint32_t size);
+extern int32_t ece391_shm_attach (uint32_t key, uint8_t** start);
+extern int32_t ece391_shm_detach (uint32_t key);
 
 #endif
 #endif
@@ -1,4 +1,5 @@
 #include "exception.h"
+#include "paging.h"
 
 //General exception handler 
 void divide(void);
@@ -14,7 +15,7 @@ void invalid_tss(void);
 void segment(void);
 void stack(void);
 void gpf(void);
-void page_fault(void);
+void page_fault_handler(uint32_t error_code);
 void core_dump(char * message);
 
 
@@ -43,7 +44,7 @@ void install_exceptions(void)
 	write_int_gate(11, segment);
 	write_int_gate(12, stack);
 	write_int_gate(13, gpf);
-	write_int_gate(14, page_fault);
+	write_int_gate(14, page_fault_linkage);
 }
 
 /*
@@ -250,19 +251,31 @@ void gpf(void)
 	iret();
 }
 /*
- * page_fault
- *   DESCRIPTION: Exception handler for page fault
- *	 INPUTS: none	  
+ * page_fault_handler
+ *   DESCRIPTION: Exception handler for page fault, called from page_fault_linkage. Faults inside
+ *				  a program image are demand paging or copy-on-write, and faults in shared
+ *				  memory map the segment's page; both are resolved here.
+ *	 INPUTS: error_code -- the error code pushed by the processor
  *   OUTPUTS: Prints "Page fault exception" on the shell
  *   RETURN VALUE: none
- *   SIDE EFFECTS: handle the exception and spin to halt the system
+ *   SIDE EFFECTS: maps the faulting page, or handles the exception and spins to halt the system
  */
-void page_fault(void)
+void page_fault_handler(uint32_t error_code)
 {
 	char message[] = "Page Fault Exception";
+	uint32_t addr;
+
+	asm volatile("movl %%cr2, %0"
+			: "=r" (addr));
+
+	if (paging_image_fault(pcb_process()->pid, addr, error_code) == 0 || paging_shm_fault(addr) == 0)
+		return;
+
+	if (addr >= USER_STACK_GUARD && addr < USER_STACK_GUARD + FOUR_KB)
+		strcpy((int8_t *) message, (const int8_t *) "Stack Overflow");
+
 	error_screan(message);
 	while(1);
-	iret();
 }
 
 /*
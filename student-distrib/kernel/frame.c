@@ -0,0 +1,269 @@
+#include "frame.h"
+
+// One bit per 4 KB frame, set while the frame is in use or is not usable RAM
+static uint32_t frame_bitmap[FRAME_MAX / FRAME_WORD_BITS];
+static uint32_t frame_free_frames;
+static uint32_t frame_words;	// words of the bitmap covering installed RAM
+// Mappings of each frame from frame_alloc; copy-on-write pages are mapped more than once
+static uint16_t frame_ref_count[FRAME_MAX];
+
+/*
+ * void frame_mark(uint32_t first, uint32_t end, uint32_t used)
+ *   DESCRIPTION: marks a run of frames used or free, keeping the free count in step
+ *   INPUTS: first - first frame of the run
+ *           end - frame after the run, clipped to FRAME_MAX
+ *           used - non-zero to mark the frames used
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+
+static void
+frame_mark(uint32_t first, uint32_t end, uint32_t used)
+{
+	uint32_t i, bit;
+
+	if (end > FRAME_MAX) end = FRAME_MAX;
+
+	for (i = first; i < end; i++) {
+		bit = 1 << (i % FRAME_WORD_BITS);
+		if (used && !(frame_bitmap[i / FRAME_WORD_BITS] & bit)) {
+			frame_bitmap[i / FRAME_WORD_BITS] |= bit;
+			frame_free_frames--;
+		} else if (!used && (frame_bitmap[i / FRAME_WORD_BITS] & bit)) {
+			frame_bitmap[i / FRAME_WORD_BITS] &= ~bit;
+			frame_free_frames++;
+		}
+	}
+}
+
+/*
+ * void frame_add_ram(uint32_t base, uint32_t length)
+ *   DESCRIPTION: makes the whole frames of a region of RAM available
+ *   INPUTS: base - physical address of the region
+ *           length - bytes in the region
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+
+static void
+frame_add_ram(uint32_t base, uint32_t length)
+{
+	uint32_t first = (base + FRAME_SIZE - 1) / FRAME_SIZE;
+	uint32_t end = base / FRAME_SIZE + length / FRAME_SIZE; // never past the region's end
+
+	if (end <= first) return;
+
+	frame_mark(first, end, 0);
+	if ((end + FRAME_WORD_BITS - 1) / FRAME_WORD_BITS > frame_words)
+		frame_words = (end + FRAME_WORD_BITS - 1) / FRAME_WORD_BITS;
+	if (frame_words > FRAME_MAX / FRAME_WORD_BITS)
+		frame_words = FRAME_MAX / FRAME_WORD_BITS;
+}
+
+/*
+ * void frame_init(multiboot_info_t * mbi)
+ *   DESCRIPTION: builds the frame bitmap from the boot loader's memory map, or from
+ *                mem_upper when there is none. Everything below FRAME_RESERVED_END but
+ *                the page table zone stays in use, as do the boot modules and what the
+ *                boot loader handed over.
+ *   INPUTS: mbi - multiboot information passed to entry
+ *   OUTPUTS: prints the amount of free memory
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+
+void
+frame_init(multiboot_info_t * mbi)
+{
+	memory_map_t * mmap;
+	module_t * mod;
+	uint32_t i, length;
+
+	memset(frame_bitmap, 0xFF, sizeof(frame_bitmap));
+	memset(frame_ref_count, 0, sizeof(frame_ref_count));
+	frame_free_frames = 0;
+	frame_words = 0;
+
+	if (mbi->flags & (1 << FRAME_MB_MMAP)) {
+		for (mmap = (memory_map_t *) mbi->mmap_addr;
+				(uint32_t) mmap < mbi->mmap_addr + mbi->mmap_length;
+				mmap = (memory_map_t *) ((uint32_t) mmap + mmap->size + sizeof (mmap->size))) {
+			// Only RAM below 4 GB can be mapped
+			if (mmap->type != FRAME_MB_RAM || mmap->base_addr_high != 0) continue;
+
+			length = mmap->length_low;
+			if (mmap->length_high != 0 || length > -mmap->base_addr_low)
+				length = -mmap->base_addr_low;
+			frame_add_ram(mmap->base_addr_low, length);
+		}
+	} else if (mbi->flags & (1 << FRAME_MB_MEM)) {
+		// mem_upper counts the KB of RAM starting at 1 MB
+		frame_add_ram(0x100000, mbi->mem_upper * 1024);
+	}
+
+	frame_mark(0, FRAME_TABLE_START / FRAME_SIZE, 1);
+	frame_mark(FRAME_TABLE_END / FRAME_SIZE, FRAME_RESERVED_END / FRAME_SIZE, 1);
+	frame_mark((uint32_t) mbi / FRAME_SIZE, ((uint32_t) (mbi + 1) + FRAME_SIZE - 1) / FRAME_SIZE, 1);
+	if (mbi->flags & (1 << FRAME_MB_MMAP))
+		frame_mark(mbi->mmap_addr / FRAME_SIZE, (mbi->mmap_addr + mbi->mmap_length + FRAME_SIZE - 1) / FRAME_SIZE, 1);
+	if (mbi->flags & (1 << FRAME_MB_MODS)) {
+		mod = (module_t *) mbi->mods_addr;
+		frame_mark((uint32_t) mod / FRAME_SIZE, ((uint32_t) (mod + mbi->mods_count) + FRAME_SIZE - 1) / FRAME_SIZE, 1);
+		for (i = 0; i < mbi->mods_count; i++, mod++)
+			frame_mark(mod->mod_start / FRAME_SIZE, (mod->mod_end + FRAME_SIZE - 1) / FRAME_SIZE, 1);
+	}
+
+	printf("Free memory: %d KB in 4 KB frames\n", frame_free_frames * (FRAME_SIZE / 1024));
+}
+
+/*
+ * uint32_t frame_alloc(void)
+ *   DESCRIPTION: hands out one 4 KB frame above the kernel, with one reference
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical address of the frame, 0 if memory is full
+ *   SIDE EFFECTS: none
+ */
+
+uint32_t
+frame_alloc(void)
+{
+	uint32_t flags, i, bit, frame = 0;
+
+	cli_and_save(flags);
+	for (i = frame_words; i-- > FRAME_RESERVED_END / FRAME_SIZE / FRAME_WORD_BITS; ) {
+		if (frame_bitmap[i] == 0xFFFFFFFF) continue;
+
+		for (bit = 0; frame_bitmap[i] & (1 << bit); bit++);
+		frame = i * FRAME_WORD_BITS + bit;
+		frame_mark(frame, frame + 1, 1);
+		frame_ref_count[frame] = 1;
+		frame *= FRAME_SIZE;
+		break;
+	}
+	restore_flags(flags);
+
+	return frame;
+}
+
+/*
+ * uint32_t frame_alloc_table(void)
+ *   DESCRIPTION: hands out a zeroed 4 KB frame the kernel can reach at its physical address,
+ *                for a page directory or page table
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical (and kernel virtual) address of the frame, 0 if the zone is full
+ *   SIDE EFFECTS: none
+ */
+
+uint32_t
+frame_alloc_table(void)
+{
+	uint32_t flags, i, bit, frame = 0;
+
+	cli_and_save(flags);
+	for (i = FRAME_TABLE_START / FRAME_SIZE / FRAME_WORD_BITS; i < FRAME_TABLE_END / FRAME_SIZE / FRAME_WORD_BITS; i++) {
+		if (frame_bitmap[i] == 0xFFFFFFFF) continue;
+
+		for (bit = 0; frame_bitmap[i] & (1 << bit); bit++);
+		frame = i * FRAME_WORD_BITS + bit;
+		frame_mark(frame, frame + 1, 1);
+		frame *= FRAME_SIZE;
+		break;
+	}
+	restore_flags(flags);
+
+	if (frame != 0) memset((void *) frame, 0, FRAME_SIZE);
+	return frame;
+}
+
+/*
+ * void frame_free(uint32_t frame)
+ *   DESCRIPTION: drops one reference to a frame from frame_alloc, or gives back a frame from
+ *                frame_alloc_table. The frame is free once its last reference is gone.
+ *   INPUTS: frame - its physical address
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+
+void
+frame_free(uint32_t frame)
+{
+	uint32_t flags;
+
+	if (frame < FRAME_TABLE_START || (frame >= FRAME_TABLE_END && frame < FRAME_RESERVED_END) ||
+		(frame & (FRAME_SIZE - 1)) != 0 || frame / FRAME_SIZE >= FRAME_MAX) return;
+
+	cli_and_save(flags);
+	if (frame_ref_count[frame / FRAME_SIZE] <= 1) {
+		frame_ref_count[frame / FRAME_SIZE] = 0;
+		frame_mark(frame / FRAME_SIZE, frame / FRAME_SIZE + 1, 0);
+	} else {
+		frame_ref_count[frame / FRAME_SIZE]--;
+	}
+	restore_flags(flags);
+}
+
+/*
+ * int32_t frame_ref(uint32_t frame)
+ *   DESCRIPTION: adds a reference to a frame from frame_alloc, for a second mapping of it
+ *   INPUTS: frame - its physical address
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the frame is not in use or has FRAME_REFS_MAX references
+ *   SIDE EFFECTS: the frame takes one more frame_free to give back
+ */
+
+int32_t
+frame_ref(uint32_t frame)
+{
+	uint32_t flags;
+	int32_t ret = -1;
+
+	if (frame < FRAME_RESERVED_END || (frame & (FRAME_SIZE - 1)) != 0 || frame / FRAME_SIZE >= FRAME_MAX)
+		return -1;
+
+	cli_and_save(flags);
+	if (frame_ref_count[frame / FRAME_SIZE] != 0 && frame_ref_count[frame / FRAME_SIZE] < FRAME_REFS_MAX) {
+		frame_ref_count[frame / FRAME_SIZE]++;
+		ret = 0;
+	}
+	restore_flags(flags);
+
+	return ret;
+}
+
+/*
+ * uint32_t frame_refs(uint32_t frame)
+ *   DESCRIPTION: number of references to a frame from frame_alloc
+ *   INPUTS: frame - its physical address
+ *   OUTPUTS: none
+ *   RETURN VALUE: the count, 0 if the frame is free or not from frame_alloc
+ *   SIDE EFFECTS: none
+ */
+
+uint32_t
+frame_refs(uint32_t frame)
+{
+	if (frame / FRAME_SIZE >= FRAME_MAX)
+		return 0;
+
+	return frame_ref_count[frame / FRAME_SIZE];
+}
+
+/*
+ * uint32_t frame_free_count(void)
+ *   DESCRIPTION: number of free 4 KB frames
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the count
+ *   SIDE EFFECTS: none
+ */
+
+uint32_t
+frame_free_count(void)
+{
+	return frame_free_frames;
+}
@@ -0,0 +1,32 @@
+#ifndef _FRAME_H_
+#define _FRAME_H_
+
+#include "../lib/lib.h"
+#include "../lib/types.h"
+#include "../multiboot.h"
+
+#define FRAME_SIZE 0x1000 // 4 KB
+#define FRAME_MAX 0x40000 // frames tracked: the first 1 GB of memory
+#define FRAME_WORD_BITS 32
+#define FRAME_RESERVED_END 0x800000 // kernel, boot module and kernel stacks
+// Free memory below the kernel is identity mapped for the kernel only, so page
+// directories and page tables are taken from there
+#define FRAME_TABLE_START 0x100000
+#define FRAME_TABLE_END 0x400000
+#define FRAME_REFS_MAX 0xFFFF // most mappings of one frame frame_ref allows, far more than MAX_PID
+
+// multiboot_info_t.flags bits and memory_map_t.type of usable RAM
+#define FRAME_MB_MEM 0
+#define FRAME_MB_MODS 3
+#define FRAME_MB_MMAP 6
+#define FRAME_MB_RAM 1
+
+extern void frame_init(multiboot_info_t * mbi);
+extern uint32_t frame_alloc(void);
+extern uint32_t frame_alloc_table(void);
+extern void frame_free(uint32_t frame);
+extern int32_t frame_ref(uint32_t frame);
+extern uint32_t frame_refs(uint32_t frame);
+extern uint32_t frame_free_count(void);
+
+#endif
@@ -0,0 +1,227 @@
+#include "image_cache.h"
+#include "../drivers/fs.h"
+#include "lock.h"
+
+// Frames holding cached program pages. They live in kernel memory, which is
+// identity mapped, so a frame's address is also its physical address.
+static data_block_t image_cache_frames[IMAGE_CACHE_PAGES] __attribute__((aligned(FOUR_KB)));
+static image_cache_entry_t image_cache[IMAGE_CACHE_PAGES];
+static int16_t image_cache_head[IMAGE_CACHE_HASH_SIZE];
+static uint32_t image_cache_hand; // next entry the replacement scan looks at
+static lock_t image_cache_lock; // held by image_cache_get, which may sleep reading a page
+
+/*
+ * uint32_t image_cache_hash(uint32_t inode, uint32_t page)
+ *   DESCRIPTION: hash bucket of a program page
+ *   INPUTS: inode - program file
+ *           page - virtual address of the page
+ *   OUTPUTS: none
+ *   RETURN VALUE: bucket index
+ *   SIDE EFFECTS: none
+ */
+
+static uint32_t
+image_cache_hash(uint32_t inode, uint32_t page)
+{
+	return (inode * 31 + (page >> 12)) & IMAGE_CACHE_HASH_MASK;
+}
+
+/*
+ * void image_cache_unlink(int16_t entry)
+ *   DESCRIPTION: removes an entry from its hash chain
+ *   INPUTS: entry - a VALID entry
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: new lookups no longer find the entry
+ */
+
+static void
+image_cache_unlink(int16_t entry)
+{
+	int16_t *link = &image_cache_head[image_cache_hash(image_cache[entry].inode, image_cache[entry].page)];
+
+	while (*link != entry)
+		link = &image_cache[*link].next;
+
+	*link = image_cache[entry].next;
+}
+
+/*
+ * void image_cache_init(void)
+ *   DESCRIPTION: empties the program image cache
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+
+void
+image_cache_init(void)
+{
+	int i;
+
+	for (i = 0; i < IMAGE_CACHE_HASH_SIZE; i++)
+		image_cache_head[i] = IMAGE_CACHE_NONE;
+
+	for (i = 0; i < IMAGE_CACHE_PAGES; i++)
+		image_cache[i].state = IMAGE_CACHE_FREE;
+
+	image_cache_hand = 0;
+}
+
+/*
+ * uint32_t image_cache_get(uint32_t inode, uint32_t page)
+ *   DESCRIPTION: returns a frame holding one page of a program image, reading it from the file
+ *                on a miss. The caller maps the frame read-only and must image_cache_put it when
+ *                the mapping goes away.
+ *   INPUTS: inode - program file
+ *           page - page aligned virtual address of the page in the program image
+ *   OUTPUTS: none
+ *   RETURN VALUE: physical address of the frame, 0 if every frame is in use
+ *   SIDE EFFECTS: may evict an unmapped page of another program; a miss may sleep on the
+ *                 disk, and other lookups wait for it
+ */
+
+uint32_t
+image_cache_get(uint32_t inode, uint32_t page)
+{
+	int16_t entry;
+	uint32_t i, flags, frame = 0;
+	int32_t ret;
+
+	lock_acquire(&image_cache_lock);
+	cli_and_save(flags);
+
+	for (entry = image_cache_head[image_cache_hash(inode, page)]; entry != IMAGE_CACHE_NONE; entry = image_cache[entry].next) {
+		if (image_cache[entry].inode == inode && image_cache[entry].page == page) {
+			image_cache[entry].refs++;
+			frame = (uint32_t) &image_cache_frames[entry];
+			break;
+		}
+	}
+
+	// Miss: take a free frame, or one no process has mapped right now
+	for (i = 0; frame == 0 && i < IMAGE_CACHE_PAGES; i++) {
+		entry = image_cache_hand;
+		image_cache_hand = (image_cache_hand + 1) % IMAGE_CACHE_PAGES;
+
+		if (image_cache[entry].state == IMAGE_CACHE_FREE ||
+			(image_cache[entry].state == IMAGE_CACHE_VALID && image_cache[entry].refs == 0))
+			break;
+	}
+
+	if (frame == 0 && i < IMAGE_CACHE_PAGES) {
+		if (image_cache[entry].state == IMAGE_CACHE_VALID)
+			image_cache_unlink(entry);
+
+		// Claimed but unhashed while the read sleeps, so neither a lookup nor the scan takes it
+		image_cache[entry].inode = inode;
+		image_cache[entry].page = page;
+		image_cache[entry].refs = 1;
+		image_cache[entry].state = IMAGE_CACHE_LOADING;
+
+		restore_flags(flags);
+		ret = loader_page_in(inode, page, image_cache_frames[entry].byte);
+		cli_and_save(flags);
+
+		if (ret == -1) {
+			image_cache[entry].refs = 0;
+			image_cache[entry].state = IMAGE_CACHE_FREE;
+		} else {
+			frame = (uint32_t) &image_cache_frames[entry];
+
+			// Left STALE if the file was written during the read
+			if (image_cache[entry].state == IMAGE_CACHE_LOADING) {
+				image_cache[entry].state = IMAGE_CACHE_VALID;
+				image_cache[entry].next = image_cache_head[image_cache_hash(inode, page)];
+				image_cache_head[image_cache_hash(inode, page)] = entry;
+			}
+		}
+	}
+
+	restore_flags(flags);
+	lock_release(&image_cache_lock);
+
+	return frame;
+}
+
+/*
+ * void image_cache_put(uint32_t frame)
+ *   DESCRIPTION: drops one mapping of a frame returned by image_cache_get
+ *   INPUTS: frame - physical address of the frame
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the page stays cached for the next execute of the program
+ */
+
+void
+image_cache_put(uint32_t frame)
+{
+	uint32_t entry = (frame - (uint32_t) image_cache_frames) / FOUR_KB;
+	uint32_t flags;
+
+	if (entry >= IMAGE_CACHE_PAGES)
+		return;
+
+	cli_and_save(flags);
+	if (image_cache[entry].refs != 0 && --image_cache[entry].refs == 0 &&
+		image_cache[entry].state == IMAGE_CACHE_STALE)
+		image_cache[entry].state = IMAGE_CACHE_FREE;
+	restore_flags(flags);
+}
+
+/*
+ * void image_cache_dup(uint32_t frame)
+ *   DESCRIPTION: adds a mapping of a frame returned by image_cache_get, for a PTE copied
+ *                into another address space
+ *   INPUTS: frame - physical address of the frame
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the new mapping must be dropped with image_cache_put as well
+ */
+
+void
+image_cache_dup(uint32_t frame)
+{
+	uint32_t entry = (frame - (uint32_t) image_cache_frames) / FOUR_KB;
+	uint32_t flags;
+
+	if (entry >= IMAGE_CACHE_PAGES)
+		return;
+
+	cli_and_save(flags);
+	if (image_cache[entry].refs != 0)
+		image_cache[entry].refs++;
+	restore_flags(flags);
+}
+
+/*
+ * void image_cache_invalidate(uint32_t inode)
+ *   DESCRIPTION: forgets every cached page of a file, for when its contents change
+ *   INPUTS: inode - the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: processes already running the old image keep their mappings; a page being
+ *                 read is handed to the task that asked for it but not cached
+ */
+
+void
+image_cache_invalidate(uint32_t inode)
+{
+	int16_t entry;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	for (entry = 0; entry < IMAGE_CACHE_PAGES; entry++) {
+		if (image_cache[entry].inode != inode)
+			continue;
+
+		if (image_cache[entry].state == IMAGE_CACHE_LOADING) {
+			image_cache[entry].state = IMAGE_CACHE_STALE;
+		} else if (image_cache[entry].state == IMAGE_CACHE_VALID) {
+			image_cache_unlink(entry);
+			image_cache[entry].state = image_cache[entry].refs ? IMAGE_CACHE_STALE : IMAGE_CACHE_FREE;
+		}
+	}
+	restore_flags(flags);
+}
@@ -0,0 +1,32 @@
+#ifndef _IMAGE_CACHE_H_
+#define _IMAGE_CACHE_H_
+
+#include "../lib/lib.h"
+#include "../lib/types.h"
+
+#define IMAGE_CACHE_PAGES 256 // 1 MB of program pages shared between processes
+#define IMAGE_CACHE_HASH_SIZE 64
+#define IMAGE_CACHE_HASH_MASK (IMAGE_CACHE_HASH_SIZE - 1)
+#define IMAGE_CACHE_NONE -1
+
+// States of a cache entry
+#define IMAGE_CACHE_FREE 0
+#define IMAGE_CACHE_VALID 1 // hashed, may be shared by new mappings
+#define IMAGE_CACHE_STALE 2 // file changed; freed when the last mapping goes away
+#define IMAGE_CACHE_LOADING 3 // being read from the file, not hashed yet
+
+typedef struct {
+	uint32_t inode; // program file
+	uint32_t page; // virtual address of the page in the program image
+	uint16_t refs; // PTEs currently mapping the frame
+	uint8_t state;
+	int16_t next; // next entry in the same hash bucket
+} image_cache_entry_t;
+
+extern void image_cache_init(void);
+extern uint32_t image_cache_get(uint32_t inode, uint32_t page);
+extern void image_cache_put(uint32_t frame);
+extern void image_cache_dup(uint32_t frame);
+extern void image_cache_invalidate(uint32_t inode);
+
+#endif
@@ -116,5 +116,6 @@ void init_idt()
 	write_int_gate(0x20, pit_linkage);
 	write_int_gate(0x21, keyboard_linkage);
 	write_int_gate(0x28, rtc_linkage);
+	write_int_gate(0x2E, ata_linkage);
 	write_sys_gate(0x80, syscall_linkage); // Setup INT x80
 }
@@ -0,0 +1,62 @@
+#include "lock.h"
+#include "scheduling.h"
+
+/*
+ * void lock_acquire(lock_t * lock)
+ *   DESCRIPTION: waits for a lock to be free and takes it. A task the scheduler can switch
+ *                away from sleeps until lock_release wakes it; anything else, such as the
+ *                boot stack, halts until the next interrupt and checks again.
+ *   INPUTS: lock - the lock
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may switch tasks; the lock is not recursive
+ */
+
+void
+lock_acquire(lock_t * lock)
+{
+	int16_t pid = task_sleepable();
+	uint32_t flags;
+
+	cli_and_save(flags);
+
+	// Checked with interrupts off so the release cannot slip in before we sleep
+	while (lock->held) {
+		if (pid >= 0) {
+			lock->waiting[pid] = 1;
+			unschedule_task(pid);
+		}
+		asm volatile("sti; hlt; cli");
+	}
+	lock->held = 1;
+
+	restore_flags(flags);
+}
+
+/*
+ * void lock_release(lock_t * lock)
+ *   DESCRIPTION: gives up a lock and wakes every task waiting for it; the first to run takes
+ *                it and the others go back to sleep
+ *   INPUTS: lock - the lock, held by the caller
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: schedules the waiting tasks
+ */
+
+void
+lock_release(lock_t * lock)
+{
+	uint32_t flags, i;
+
+	cli_and_save(flags);
+
+	lock->held = 0;
+	for (i = 0; i < MAX_PID; i++) {
+		if (!lock->waiting[i]) continue;
+
+		lock->waiting[i] = 0;
+		schedule_task(i);
+	}
+
+	restore_flags(flags);
+}
@@ -0,0 +1,18 @@
+#ifndef _LOCK_H_
+#define _LOCK_H_
+
+#include "../lib/lib.h"
+#include "../lib/types.h"
+#include "tasks.h"
+
+// A lock that may be held across a sleep on the disk. Tasks waiting for it are
+// unscheduled until it is released rather than spinning through their time slices.
+typedef struct {
+	uint32_t held;
+	uint8_t waiting[MAX_PID]; // set for each task asleep on the lock
+} lock_t;
+
+extern void lock_acquire(lock_t * lock);
+extern void lock_release(lock_t * lock);
+
+#endif
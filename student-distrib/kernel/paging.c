@@ -1,13 +1,38 @@
 #include "../kernel/paging.h"
 #include "../kernel/tasks.h"
+#include "../kernel/image_cache.h"
+#include "../kernel/frame.h"
+#include "../kernel/swap.h"
 
-//Page Directory 
-static pde_t page_dir_table[MAX_PID][PAGE_SIZE] __attribute__((aligned(PAGE_SIZE*4)));
+//Page Directory the kernel boots with, also used by pid 0
+static pde_t page_dir_table[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE*4)));
+//Kernel entries every process directory starts from, copied in one memcpy
+static pde_t page_dir_template[PAGE_SIZE];
 //Page Table Entries
 static pte_t page_table[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE * 4)));
 static pte_t user_page_table[PAGE_SIZE] __attribute__((aligned (PAGE_SIZE * 4)));
 
-static pte_t user_video_page[MAX_PID][PAGE_SIZE] __attribute__((aligned(PAGE_SIZE * 4)));
+//Each process's directory and page tables come from frame_alloc_table when first needed,
+//NULL until then, and go back in paging_free
+static pde_t * page_dirs[MAX_PID];
+static pte_t * user_video_page[MAX_PID];
+//4 KB pages of each program image, filled in by the page fault handler on first touch
+static pte_t * user_image_page[MAX_PID];
+//Read-only file mappings handed out by mmap
+static pte_t * user_mmap_page[MAX_PID];
+//Read-only view of the file system image, one table shared by every process that asks for it
+static pte_t fs_map_page[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE * 4)));
+static uint32_t fs_map_pages;
+//Shared memory segments, and the table and attached segments (one bit each) of each process
+static shm_segment_t shm_segments[SHM_SEGMENTS];
+static pte_t * user_shm_page[MAX_PID];
+static uint32_t shm_attached[MAX_PID];
+//The shared runtime, read once at boot and mapped read-only into every program
+static uint8_t runtime_frames[RUNTIME_MAX_PAGES][FOUR_KB] __attribute__((aligned(FOUR_KB)));
+static pte_t runtime_page[PAGE_SIZE] __attribute__((aligned(PAGE_SIZE * 4)));
+static uint32_t runtime_pages;
+//Holds a copy-on-write page while its mapping moves to the new frame
+static uint8_t paging_copy_buf[FOUR_KB];
 //uint32_t new_page_dir_addr;
 
 /*
@@ -28,7 +53,7 @@ paging_init(void){
     for(i = 0; i < PAGE_SIZE; i++) 
     {
         page_table[i].present = 0;
-        page_table[i].read_write = 0;
+        page_table[i].read_write = 1;
         page_table[i].user_supervisor = 0;
         page_table[i].write_through = 0;
         page_table[i].cache_disabled = 0;
@@ -50,52 +75,67 @@ paging_init(void){
         user_page_table[i].global = 0;
         user_page_table[i].avail = 0;
         user_page_table[i].physical_page_addr = i;
+
+        // The page table zone, so the kernel can edit tables at their physical address
+        if (i >= FRAME_TABLE_START / FOUR_KB && i < FRAME_TABLE_END / FOUR_KB)
+        {
+            page_table[i].present = 1;
+            user_page_table[i].present = 1;
+            user_page_table[i].user_supervisor = 0;
+        }
     }
     page_table[VIDEO_MEM_START].present = 1;
     user_page_table[VIDEO_MEM_START].present = 1;
 
 
-    page_dir_table[0][0].present = 1;
-    page_dir_table[0][0].read_write = 0;
-    page_dir_table[0][0].user_supervisor = 0;
-    page_dir_table[0][0].write_through = 0;
-    page_dir_table[0][0].cache_disabled = 0;
-    page_dir_table[0][0].accessed = 0;
-    page_dir_table[0][0].zero = 0;
-    page_dir_table[0][0].page_size = 0;
-    page_dir_table[0][0].global = 0;
-    page_dir_table[0][0].avail = 0;
+    page_dir_table[0].present = 1;
+    page_dir_table[0].read_write = 1;
+    page_dir_table[0].user_supervisor = 0;
+    page_dir_table[0].write_through = 0;
+    page_dir_table[0].cache_disabled = 0;
+    page_dir_table[0].accessed = 0;
+    page_dir_table[0].zero = 0;
+    page_dir_table[0].page_size = 0;
+    page_dir_table[0].global = 0;
+    page_dir_table[0].avail = 0;
     page_table_loc = (uint32_t)page_table;
-    page_dir_table[0][0].page_table_addr = page_table_loc >> TABLE_ADDRESS_SHIFT;
+    page_dir_table[0].page_table_addr = page_table_loc >> TABLE_ADDRESS_SHIFT;
 
 
-    page_dir_table[0][1].present = 1;
-    page_dir_table[0][1].read_write = 1;
-    page_dir_table[0][1].user_supervisor = 0;
-    page_dir_table[0][1].write_through = 0;
-    page_dir_table[0][1].cache_disabled = 0;
-    page_dir_table[0][1].accessed = 0;
-    page_dir_table[0][1].zero = 0;
-    page_dir_table[0][1].page_size = 1;
-    page_dir_table[0][1].global = 1;
-    page_dir_table[0][1].avail = 0;
-    page_dir_table[0][1].page_table_addr = KERNAL_START;
+    page_dir_table[1].present = 1;
+    page_dir_table[1].read_write = 1;
+    page_dir_table[1].user_supervisor = 0;
+    page_dir_table[1].write_through = 0;
+    page_dir_table[1].cache_disabled = 0;
+    page_dir_table[1].accessed = 0;
+    page_dir_table[1].zero = 0;
+    page_dir_table[1].page_size = 1;
+    page_dir_table[1].global = 1;
+    page_dir_table[1].avail = 0;
+    page_dir_table[1].page_table_addr = KERNAL_START;
 
 
     for(i = 2; i < PAGE_SIZE; i++) 
     {
-        page_dir_table[0][i].present = 0;
-        page_dir_table[0][i].read_write = 1;
-        page_dir_table[0][i].user_supervisor = 0;
-        page_dir_table[0][i].write_through = 0;
-        page_dir_table[0][i].cache_disabled = 0;
-        page_dir_table[0][i].accessed = 0;
-        page_dir_table[0][i].zero = 0;
-        page_dir_table[0][i].page_size = 0;
-        page_dir_table[0][i].global = 0;
-        page_dir_table[0][i].avail = 0;
-        page_dir_table[0][i].page_table_addr = i << 10;
+        page_dir_table[i].present = 0;
+        page_dir_table[i].read_write = 1;
+        page_dir_table[i].user_supervisor = 0;
+        page_dir_table[i].write_through = 0;
+        page_dir_table[i].cache_disabled = 0;
+        page_dir_table[i].accessed = 0;
+        page_dir_table[i].zero = 0;
+        page_dir_table[i].page_size = 0;
+        page_dir_table[i].global = 0;
+        page_dir_table[i].avail = 0;
+        page_dir_table[i].page_table_addr = i << 10;
     }
+    page_dirs[0] = page_dir_table;
+
+    // Processes share the kernel page and the low page table, and start with nothing else
+    for (i = 0; i < PAGE_SIZE; i++)
+        page_dir_template[i].val = DEFAULT_PD_ENTRY;
+    page_dir_template[0].val = ((uint32_t) user_page_table & PTE_ADDR_MASK) | SUPERVISOR | WRITABLE | PRESENT;
+    page_dir_template[1] = page_dir_table[1];
 
     //enables paging
     asm volatile(" movl $page_dir_table, %%eax \n   \
@@ -107,7 +147,7 @@ paging_init(void){
         movl %%eax, %%cr4       \n  \
                                     \
         movl %%cr0, %%eax       \n  \
-        orl $0x80000000, %%eax  \n  \
+        orl $0x80010000, %%eax  \n  \
         movl %%eax, %%cr0"          \
             :                           
             : 
@@ -115,64 +155,120 @@ paging_init(void){
 
 }
 
+/*
+ * pte_t * paging_table_new(uint32_t pid, uint32_t index)
+ *   DESCRIPTION: takes a zeroed page table from the frame allocator and hooks it into entry
+ *                index of a process's page directory. The PTEs decide the access rights, so
+ *                the PDE lets user level through.
+ *   INPUTS: pid - the pid of the process, which has a page directory
+ *           index - page directory entry the table covers
+ *   OUTPUTS: none
+ *   RETURN VALUE: the table, NULL if there is no memory for it
+ *   SIDE EFFECTS: none
+ */
+
+static pte_t *
+paging_table_new(uint32_t pid, uint32_t index)
+{
+    pte_t * table = (pte_t *) frame_alloc_table();
+
+    if (table != NULL)
+        page_dirs[pid][index].val = ((uint32_t) table & PTE_ADDR_MASK) | SUPERVISOR | WRITABLE | PRESENT;
+
+    return table;
+}
+
 /*
  * int32_t paging_allocate(uint32_t pid)
- *   DESCRIPTION: this function creates a new page directory for a new program
- *   INPUTS: pid - the pid of the new program 
+ *   DESCRIPTION: this function creates a new page directory for a new program, with an
+ *                empty page table for its image. Memory for the image is taken a 4 KB
+ *                frame at a time as pages are touched.
+ *   INPUTS: pid - the pid of the new program, which has nothing allocated yet
  *   OUTPUTS: none
- *   RETURN VALUE: 0 on success, -1 on failure
+ *   RETURN VALUE: 0 on success, -1 on failure or if memory is full
  *   SIDE EFFECTS: Paging is setup for the new user level program
  */
-   
+
 int32_t
 paging_allocate(uint32_t pid)
 {
-    uint32_t new_page_table_addr;
-
     if(pid >= MAX_PID || pid < 0)
         return -1;
 
-    uint32_t new_page_dir_table_addr;
-    new_page_dir_table_addr = (uint32_t)(&page_dir_table[pid]);
-
-    page_dir_table[pid][0].present = 1;
-    page_dir_table[pid][0].read_write = 1;
-    page_dir_table[pid][0].user_supervisor = 1;
-    page_dir_table[pid][0].write_through = 0;
-    page_dir_table[pid][0].cache_disabled = 0;
-    page_dir_table[pid][0].accessed = 0;
-    page_dir_table[pid][0].zero = 0;
-    page_dir_table[pid][0].page_size = 0;
-    page_dir_table[pid][0].global = 0;
-    page_dir_table[pid][0].avail = 0;
-    new_page_table_addr = (uint32_t) user_page_table;
-    page_dir_table[pid][0].page_table_addr = new_page_table_addr >> TABLE_ADDRESS_SHIFT;
-
-    page_dir_table[pid][1].present = 1;
-    page_dir_table[pid][1].read_write = 1;
-    page_dir_table[pid][1].user_supervisor = 0;
-    page_dir_table[pid][1].write_through = 0;
-    page_dir_table[pid][1].cache_disabled = 0;
-    page_dir_table[pid][1].accessed = 0;
-    page_dir_table[pid][1].zero = 0;
-    page_dir_table[pid][1].page_size = 1;
-    page_dir_table[pid][1].global = 1;
-    page_dir_table[pid][1].avail = 0;
-    page_dir_table[pid][1].page_table_addr = KERNAL_START;
-
-    page_dir_table[pid][P_IMG].present = 1;
-    page_dir_table[pid][P_IMG].read_write = 1;
-    page_dir_table[pid][P_IMG].user_supervisor = 1;
-    page_dir_table[pid][P_IMG].write_through = 0;
-    page_dir_table[pid][P_IMG].cache_disabled = 0;
-    page_dir_table[pid][P_IMG].accessed = 0;
-    page_dir_table[pid][P_IMG].zero = 0;
-    page_dir_table[pid][P_IMG].page_size = 1;
-    page_dir_table[pid][P_IMG].global = 0;
-    page_dir_table[pid][P_IMG].avail = 0;
-    page_dir_table[pid][P_IMG].page_table_addr = (pid+1) << 10;
+    // The image is mapped a page at a time as it is touched, so start with nothing present
+    if (paging_allocate_kernel(pid) == -1 || (user_image_page[pid] = paging_table_new(pid, P_IMG)) == NULL)
+    {
+        paging_free(pid);
+        return -1;
+    }
+
+    if (runtime_pages != 0)
+        page_dirs[pid][RUNTIME_LOAD].val = ((uint32_t) runtime_page & PTE_ADDR_MASK) | SUPERVISOR | WRITABLE | PRESENT;
 
+    return 0;
+}
+
+/*
+ * void paging_runtime_init(void)
+ *   DESCRIPTION: reads the shared runtime (the support library and system call wrappers
+ *                programs call through its entry table) from RUNTIME_FILE into kernel memory,
+ *                so paging_allocate can map the same read-only pages into every program
+ *   INPUTS: none
+ *   OUTPUTS: prints the size of the runtime, or why there is none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: programs started later find the runtime at RUNTIME_START; a runtime written
+ *                 to the file system after boot is not picked up
+ */
+
+void
+paging_runtime_init(void)
+{
+    dentry_t dentry;
+    int32_t length;
+    uint32_t i;
+
+    runtime_pages = 0;
+    if (read_dentry_by_name((int8_t *) RUNTIME_FILE, &dentry) == -1)
+    {
+        printf("No shared runtime\n");
+        return;
+    }
+
+    // One byte more than fits tells a runtime that is too big from one that just fits
+    length = read_data(dentry.inode_index, 0, (uint8_t *) runtime_frames, sizeof(runtime_frames));
+    if (length <= 0 || read_data(dentry.inode_index, sizeof(runtime_frames), (uint8_t *) &i, 1) > 0)
+    {
+        printf("Shared runtime missing or over %d KB\n", sizeof(runtime_frames) / 1024);
+        return;
+    }
+
+    runtime_pages = (length + FOUR_KB - 1) / FOUR_KB;
+    for (i = 0; i < runtime_pages; i++)
+        runtime_page[i].val = (uint32_t) runtime_frames[i] | SUPERVISOR | PRESENT;
+
+    printf("Shared runtime: %d bytes\n", length);
+}
+
+/*
+ * int32_t paging_allocate_kernel(uint32_t pid)
+ *   DESCRIPTION: creates the page directory of a task that never runs at user level, so it
+ *                needs no frame for a program image
+ *   INPUTS: pid - the pid of the task
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if there is no memory for the directory
+ *   SIDE EFFECTS: none
+ */
+   
+int32_t
+paging_allocate_kernel(uint32_t pid)
+{
+    if(pid >= MAX_PID || pid < 0)
+        return -1;
+
+    if (page_dirs[pid] == NULL && (page_dirs[pid] = (pde_t *) frame_alloc_table()) == NULL)
+        return -1;
 
+    memcpy(page_dirs[pid], page_dir_template, sizeof(page_dir_template));
     return 0;
 }
 
@@ -188,10 +284,10 @@ int32_t
 paging_update_control(uint32_t pid)
 {
 
-    if(pid >= MAX_PID || pid < 0)
+    if(pid >= MAX_PID || pid < 0 || page_dirs[pid] == NULL)
         return -1;
 
-    uint32_t sw_page_dir = (uint32_t)(&page_dir_table[pid]);
+    uint32_t sw_page_dir = (uint32_t) page_dirs[pid];
 
     asm volatile(" movl %0, %%eax \n   \
     andl $0xFFFFFFE7, %%eax \n  \
@@ -225,55 +321,26 @@ paging_update_control(uint32_t pid)
 int32_t 
 paging_map_video(uint32_t pid, uint8_t ** screen_start)
 {
-    int i;
     // int32_t four_mb_offset = ((int32_t) screen_start) / FOUR_MB;
     // int32_t four_kb_offset = (((int32_t) screen_start % FOUR_MB) / FOUR_KB);
 
     // Sanity check
-    if (pid < 0 || pid >= MAX_PID)
+    if (pid < 0 || pid >= MAX_PID || page_dirs[pid] == NULL)
         return -1;
 
-    // Initialize the new page
-    for (i = 0; i < PAGE_SIZE; ++i)
-    {
-        user_video_page[pid][i].present = 0;
-        user_video_page[pid][i].read_write = 1;
-        user_video_page[pid][i].user_supervisor = 0;
-        user_video_page[pid][i].write_through = 0;
-        user_video_page[pid][i].cache_disabled = 0;
-        user_video_page[pid][i].accessed = 0;
-        user_video_page[pid][i].dirty = 0;
-        user_video_page[pid][i].zero = 0;
-        user_video_page[pid][i].global = 0;
-        user_video_page[pid][i].avail = 0;
-        user_video_page[pid][i].physical_page_addr = 0;
-    }
-
+    // The table comes zeroed, so only the video memory page is present
+    if (user_video_page[pid] == NULL && (user_video_page[pid] = paging_table_new(pid, VIDEO_MEM_LOAD)) == NULL)
+        return -1;
 
     user_video_page[pid][VIDEO_MEM_START].physical_page_addr = VIDEO_MEM_START;
+    user_video_page[pid][VIDEO_MEM_START].read_write = 1;
     user_video_page[pid][VIDEO_MEM_START].present = 1;
     user_video_page[pid][VIDEO_MEM_START].user_supervisor = 1;
 
-    page_dir_table[pid][VIDEO_MEM_LOAD].present = 1;
-    page_dir_table[pid][VIDEO_MEM_LOAD].read_write = 1;
-    page_dir_table[pid][VIDEO_MEM_LOAD].user_supervisor = 1;
-    page_dir_table[pid][VIDEO_MEM_LOAD].write_through = 0;
-    page_dir_table[pid][VIDEO_MEM_LOAD].cache_disabled = 0;
-    page_dir_table[pid][VIDEO_MEM_LOAD].accessed = 0;
-    page_dir_table[pid][VIDEO_MEM_LOAD].zero = 0;
-    page_dir_table[pid][VIDEO_MEM_LOAD].page_size = 0;
-    page_dir_table[pid][VIDEO_MEM_LOAD].global = 0;
-    page_dir_table[pid][VIDEO_MEM_LOAD].avail = 0;
-
-
-    // Assign the video memory location in the appropriate place in the current page directory with the user_video_page
-    uint32_t page_table_loc = (uint32_t)user_video_page[pid];
-    page_dir_table[pid][VIDEO_MEM_LOAD].page_table_addr = page_table_loc >> TABLE_ADDRESS_SHIFT;
-
     // Change the pointer for the video memory in the user level program with the appropriate location for the video memory
     *screen_start = (uint8_t *) (PROGRAM_START - FOUR_MB) + (VIDEO_MEM_START * FOUR_KB);
 
-    RELOAD_CR3((uint32_t)(&page_dir_table[pid]));
+    RELOAD_CR3((uint32_t) page_dirs[pid]);
 
     return 0;
 
@@ -293,7 +360,852 @@ void
 update_video_paging(uint16_t pid, uint32_t addr)
 {
     // Update the control
+	if (pid >= MAX_PID || user_video_page[pid] == NULL)
+		return;
+
 	user_video_page[pid][VIDEO_MEM_START].physical_page_addr = (addr >> TABLE_ADDRESS_SHIFT) & TABLE_ADDRESS_MASK;
 
-	RELOAD_CR3((uint32_t)(&page_dir_table[pid]));
+	RELOAD_CR3((uint32_t) page_dirs[pid]);
+}
+
+/*
+ * uint32_t paging_mmap_reserve(uint32_t pid, uint32_t pages)
+ *   DESCRIPTION: finds pages consecutive unmapped virtual pages in the mmap region of a
+ *                process, the first run that fits, so space paging_mmap_unmap gave back is
+ *                used again
+ *   INPUTS: pid - the pid of the process
+ *           pages - number of 4 KB pages to reserve
+ *   OUTPUTS: None
+ *   RETURN VALUE: virtual address of the first page, 0 if the region is full
+ *   SIDE EFFECTS: the mmap page table is hooked into the page directory on first use; the
+ *                 caller maps the pages before reserving again
+ */
+
+uint32_t
+paging_mmap_reserve(uint32_t pid, uint32_t pages)
+{
+    uint32_t i, run = 0;
+
+    if (pid >= MAX_PID || page_dirs[pid] == NULL || pages > PAGE_SIZE)
+        return 0;
+
+    if (user_mmap_page[pid] == NULL && (user_mmap_page[pid] = paging_table_new(pid, MMAP_LOAD)) == NULL)
+        return 0;
+
+    if (pages == 0)
+        return MMAP_START;
+
+    for (i = 0; i < PAGE_SIZE; i++)
+    {
+        run = user_mmap_page[pid][i].present ? 0 : run + 1;
+        if (run == pages)
+            return MMAP_START + (i + 1 - pages) * FOUR_KB;
+    }
+
+    return 0;
+}
+
+/*
+ * void paging_mmap_unmap(uint32_t pid, uint32_t virt, uint32_t pages)
+ *   DESCRIPTION: unmaps pages of the mmap region, so paging_mmap_reserve can hand them out again
+ *   INPUTS: pid - the pid of the process
+ *           virt - first page, as returned by paging_mmap_reserve
+ *           pages - number of 4 KB pages
+ *   OUTPUTS: None
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: flushes the pages from the TLB
+ */
+
+void
+paging_mmap_unmap(uint32_t pid, uint32_t virt, uint32_t pages)
+{
+    uint32_t i;
+
+    if (pid >= MAX_PID || user_mmap_page[pid] == NULL || virt < MMAP_START || virt >= MMAP_START + FOUR_MB ||
+        pages > (MMAP_START + FOUR_MB - virt) / FOUR_KB)
+        return;
+
+    for (i = 0; i < pages; i++)
+    {
+        user_mmap_page[pid][((virt >> TABLE_ADDRESS_SHIFT) & TABLE_ADDRESS_MASK) + i].val = 0;
+        FLUSH_TLB(virt + i * FOUR_KB);
+    }
+}
+
+/*
+ * int32_t paging_mmap_page(uint32_t pid, uint32_t virt, uint32_t phys)
+ *   DESCRIPTION: maps one 4 KB physical page read-only for user level at virt
+ *   INPUTS: pid - the pid of the process
+ *           virt - a page returned by paging_mmap_reserve
+ *           phys - 4 KB aligned physical address to map
+ *   OUTPUTS: None
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: the caller reloads CR3 once all pages are mapped
+ */
+
+int32_t
+paging_mmap_page(uint32_t pid, uint32_t virt, uint32_t phys)
+{
+    if (pid >= MAX_PID || user_mmap_page[pid] == NULL || virt < MMAP_START || virt >= MMAP_START + FOUR_MB)
+        return -1;
+
+    user_mmap_page[pid][(virt >> TABLE_ADDRESS_SHIFT) & TABLE_ADDRESS_MASK].val = (phys & PTE_ADDR_MASK) | SUPERVISOR | PRESENT;
+    return 0;
+}
+
+/*
+ * uint32_t paging_map_fs(uint32_t pid, uint32_t image, uint32_t length)
+ *   DESCRIPTION: maps the in memory file system image read-only for user level at FS_MAP_START.
+ *                The page table is filled on the first call and shared after that, since the
+ *                image never moves.
+ *   INPUTS: pid - the pid of the process
+ *           image - 4 KB aligned physical address of the boot block
+ *           length - bytes of the image to map
+ *   OUTPUTS: None
+ *   RETURN VALUE: bytes mapped (at most 4 MB), 0 on failure
+ *   SIDE EFFECTS: reloads CR3
+ */
+
+uint32_t
+paging_map_fs(uint32_t pid, uint32_t image, uint32_t length)
+{
+    uint32_t i;
+
+    if (pid >= MAX_PID || page_dirs[pid] == NULL || length == 0 || (image & ~PTE_ADDR_MASK) != 0)
+        return 0;
+
+    if (length > FOUR_MB)
+        length = FOUR_MB;
+
+    if (fs_map_pages == 0)
+    {
+        fs_map_pages = (length + FOUR_KB - 1) / FOUR_KB;
+        for (i = 0; i < fs_map_pages; i++)
+            fs_map_page[i].val = (image + i * FOUR_KB) | SUPERVISOR | PRESENT;
+    }
+
+    page_dirs[pid][FS_MAP_LOAD].val = ((uint32_t) fs_map_page & PTE_ADDR_MASK) | SUPERVISOR | WRITABLE | PRESENT;
+    RELOAD_CR3((uint32_t) page_dirs[pid]);
+
+    return length;
+}
+
+/*
+ * uint32_t paging_fs_mapped(void)
+ *   DESCRIPTION: checks whether any process has the file system view from paging_map_fs,
+ *                through which it can read every data block
+ *   INPUTS: none
+ *   OUTPUTS: None
+ *   RETURN VALUE: 1 if some process has it mapped, 0 if not
+ *   SIDE EFFECTS: none
+ */
+
+uint32_t
+paging_fs_mapped(void)
+{
+    uint32_t pid;
+
+    for (pid = 0; pid < MAX_PID; pid++)
+        if (page_dirs[pid] != NULL && page_dirs[pid][FS_MAP_LOAD].present)
+            return 1;
+
+    return 0;
+}
+
+/*
+ * int32_t paging_cow_fault(pte_t * pte, uint32_t page)
+ *   DESCRIPTION: handles a write to an image page a fork left shared. The process gets its
+ *                own copy of the page, or the frame itself once no other process maps it.
+ *   INPUTS: pte - the read-only PTE, marked PTE_AVAIL_COW, of the current process
+ *           page - page aligned virtual address it maps
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if memory is full
+ *   SIDE EFFECTS: the page is mapped writable
+ */
+
+static int32_t
+paging_cow_fault(pte_t * pte, uint32_t page)
+{
+    uint32_t shared_frame = pte->val & PTE_ADDR_MASK;
+    uint32_t private_frame;
+    uint32_t flags;
+
+    if (frame_refs(shared_frame) <= 1)
+    {
+        pte->val = shared_frame | SUPERVISOR | WRITABLE | PRESENT;
+        FLUSH_TLB(page);
+        return 0;
+    }
+
+    if ((private_frame = frame_alloc()) == 0)
+        return -1;
+
+    // The kernel reaches user frames only through the current address space, so the
+    // contents go through a buffer while the mapping changes
+    cli_and_save(flags);
+    memcpy(paging_copy_buf, (uint8_t *) page, FOUR_KB);
+    pte->val = private_frame | SUPERVISOR | WRITABLE | PRESENT;
+    FLUSH_TLB(page);
+    memcpy((uint8_t *) page, paging_copy_buf, FOUR_KB);
+    restore_flags(flags);
+
+    frame_free(shared_frame);
+    return 0;
+}
+
+/*
+ * int32_t paging_swap_in(pte_t * pte, uint32_t page)
+ *   DESCRIPTION: reads a swapped out image page of the current process back into a new frame
+ *   INPUTS: pte - the PTE, marked PTE_AVAIL_SWAP, holding the swap slot
+ *           page - page aligned virtual address it maps
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if memory is full or the disk fails
+ *   SIDE EFFECTS: the page is mapped writable and its swap slot freed
+ */
+
+static int32_t
+paging_swap_in(pte_t * pte, uint32_t page)
+{
+    uint32_t slot = pte->val >> TABLE_ADDRESS_SHIFT;
+    uint32_t private_frame;
+
+    if ((private_frame = frame_alloc()) == 0)
+        return -1;
+
+    // Read straight into the page, it is only ours until the fault returns
+    pte->val = private_frame | SUPERVISOR | WRITABLE | PRESENT;
+    FLUSH_TLB(page);
+
+    if (swap_read(slot, (uint8_t *) page) == -1)
+    {
+        pte->val = slot << TABLE_ADDRESS_SHIFT;
+        pte->avail = PTE_AVAIL_SWAP;
+        FLUSH_TLB(page);
+        frame_free(private_frame);
+        return -1;
+    }
+
+    swap_slot_free(slot);
+    return 0;
+}
+
+/*
+ * int32_t paging_swap_out(uint32_t pid)
+ *   DESCRIPTION: gives the image pages of the current process back while it waits. Own pages
+ *                are written to the swap area and their PTEs keep the slot, marked
+ *                PTE_AVAIL_SWAP, for the page fault handler to read them back in; image cache
+ *                pages are just unmapped, since they fault back in from the cache. Pages a
+ *                fork left shared stay, as another process still maps them.
+ *   INPUTS: pid - the pid of the current process, whose pages are mapped
+ *   OUTPUTS: none
+ *   RETURN VALUE: number of frames given back
+ *   SIDE EFFECTS: stops early when the swap area is full; may sleep the calling task
+ */
+
+int32_t
+paging_swap_out(uint32_t pid)
+{
+    uint32_t i, page, frame;
+    int32_t slot, freed = 0;
+    pte_t * pte;
+
+    if (pid >= MAX_PID || user_image_page[pid] == NULL || pcb_process()->pid != pid)
+        return 0;
+
+    for (i = 0; i < PAGE_SIZE; i++)
+    {
+        pte = &user_image_page[pid][i];
+        if (!pte->present || pte->avail == PTE_AVAIL_COW)
+            continue;
+
+        page = PROGRAM_START + i * FOUR_KB;
+        frame = pte->val & PTE_ADDR_MASK;
+
+        if (pte->avail == PTE_AVAIL_CACHED)
+        {
+            pte->val = 0;
+            FLUSH_TLB(page);
+            image_cache_put(frame);
+            freed++;
+            continue;
+        }
+
+        if ((slot = swap_slot_alloc()) == SWAP_NONE)
+            break;
+
+        if (swap_write(slot, (uint8_t *) page) == -1)
+        {
+            swap_slot_free(slot);
+            break;
+        }
+
+        pte->val = ((uint32_t) slot << TABLE_ADDRESS_SHIFT);
+        pte->avail = PTE_AVAIL_SWAP;
+        FLUSH_TLB(page);
+        frame_free(frame);
+        freed++;
+    }
+
+    return freed;
+}
+
+/*
+ * int32_t paging_swap_in_image(uint32_t pid)
+ *   DESCRIPTION: reads every image page of the current process that paging_swap_out wrote
+ *                to the swap area back in, so paging_fork finds nothing left on the disk
+ *   INPUTS: pid - the pid of the current process, whose pages are mapped
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if memory is full or the disk fails
+ *   SIDE EFFECTS: may sleep the calling task, so it must run with interrupts on
+ */
+
+int32_t
+paging_swap_in_image(uint32_t pid)
+{
+    uint32_t i;
+    pte_t * pte;
+
+    if (pid >= MAX_PID || user_image_page[pid] == NULL || pcb_process()->pid != pid)
+        return -1;
+
+    for (i = 0; i < PAGE_SIZE; i++)
+    {
+        pte = &user_image_page[pid][i];
+        if (!pte->present && pte->avail == PTE_AVAIL_SWAP &&
+            paging_swap_in(pte, PROGRAM_START + i * FOUR_KB) == -1)
+            return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * int32_t paging_image_fault(uint32_t pid, uint32_t addr, uint32_t error_code)
+ *   DESCRIPTION: called by the page fault handler; if addr is inside the program image of the
+ *                process, maps its 4 KB page. Pages holding file data are mapped
+ *                read-only from the image cache so every process running the program shares
+ *                them; the first write copies the page into a frame of the process's own, as
+ *                it does for pages a fork left shared (paging_cow_fault).
+ *                Pages without file data, such as the bss, heap and stack, are zero filled in
+ *                a frame of their own, so the stack takes only the pages it has grown into. Own frames
+ *                come from frame_alloc, so a process only holds the pages it has touched.
+ *                Pages paging_swap_out wrote to the swap area are read back in.
+ *   INPUTS: pid - the pid of the process, whose page directory is in CR3
+ *           addr - the faulting linear address from CR2
+ *           error_code - the error code pushed by the processor
+ *   OUTPUTS: None
+ *   RETURN VALUE: 0 if the fault was handled, -1 if it was a real fault or memory is full
+ *   SIDE EFFECTS: the page is mapped for user level
+ */
+
+int32_t
+paging_image_fault(uint32_t pid, uint32_t addr, uint32_t error_code)
+{
+    pcb_t * pcb = get_pcb(pid);
+    uint32_t page = addr & PTE_ADDR_MASK;
+    uint32_t index = (addr >> TABLE_ADDRESS_SHIFT) & TABLE_ADDRESS_MASK;
+    uint32_t private_frame, cached_frame;
+    pte_t * pte;
+
+    if (addr < PROGRAM_START || addr >= PROGRAM_START + FOUR_MB || pid >= MAX_PID ||
+        user_image_page[pid] == NULL)
+        return -1;
+
+    // Heap pages exist only below the break
+    if (addr >= PAGE_ALIGN_UP(pcb->brk) && addr < USER_HEAP_END)
+        return -1;
+
+    // Stack pages are mapped down to the guard page, unless the image itself reaches that far
+    if (addr >= USER_STACK_GUARD && addr < USER_STACK_GUARD + FOUR_KB && pcb->heap_start <= USER_STACK_GUARD)
+        return -1;
+
+    pte = &user_image_page[pid][index];
+
+    if (!pte->present && pte->avail == PTE_AVAIL_SWAP)
+        return paging_swap_in(pte, page);
+
+    if (pte->present)
+    {
+        // Only a write to a shared page is ours to handle: give the process its own copy
+        if (!(error_code & PF_WRITE))
+            return -1;
+
+        if (pte->avail == PTE_AVAIL_COW)
+            return paging_cow_fault(pte, page);
+
+        if (pte->avail != PTE_AVAIL_CACHED)
+            return -1;
+
+        if ((private_frame = frame_alloc()) == 0)
+            return -1;
+
+        cached_frame = pte->val & PTE_ADDR_MASK;
+        pte->val = private_frame | SUPERVISOR | WRITABLE | PRESENT;
+        FLUSH_TLB(page);
+        memcpy((uint8_t *) page, (uint8_t *) cached_frame, FOUR_KB);
+        image_cache_put(cached_frame);
+        return 0;
+    }
+
+    if (!(error_code & PF_WRITE) && loader_page_has_data(pcb->image_inode, page))
+    {
+        cached_frame = image_cache_get(pcb->image_inode, page);
+        if (cached_frame != 0)
+        {
+            pte->val = cached_frame | SUPERVISOR | PRESENT;
+            pte->avail = PTE_AVAIL_CACHED;
+            FLUSH_TLB(page);
+            return 0;
+        }
+    }
+
+    // Written first, no file data, or the cache is full: fill a private page directly
+    if ((private_frame = frame_alloc()) == 0)
+        return -1;
+
+    pte->val = private_frame | SUPERVISOR | WRITABLE | PRESENT;
+    FLUSH_TLB(page);
+
+    return loader_page_in(pcb->image_inode, page, (uint8_t *) page);
+}
+
+/*
+ * void paging_unmap_image(uint32_t pid, uint32_t start, uint32_t end)
+ *   DESCRIPTION: unmaps the pages of a program image from start up to end, handing shared pages
+ *                back to the image cache, own pages back to the frame allocator and swapped
+ *                out pages back to the swap area. Touching
+ *                them again maps fresh pages.
+ *   INPUTS: pid - the pid of the process
+ *           start, end - page aligned addresses in the program image
+ *   OUTPUTS: None
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: flushes the pages from the TLB
+ */
+
+void
+paging_unmap_image(uint32_t pid, uint32_t start, uint32_t end)
+{
+    uint32_t page;
+    pte_t * pte;
+
+    if (pid >= MAX_PID || user_image_page[pid] == NULL || start < PROGRAM_START || end > PROGRAM_START + FOUR_MB)
+        return;
+
+    for (page = start; page < end; page += FOUR_KB)
+    {
+        pte = &user_image_page[pid][(page >> TABLE_ADDRESS_SHIFT) & TABLE_ADDRESS_MASK];
+        if (!pte->present)
+        {
+            if (pte->avail == PTE_AVAIL_SWAP)
+                swap_slot_free(pte->val >> TABLE_ADDRESS_SHIFT);
+            pte->val = 0;
+            continue;
+        }
+
+        if (pte->avail == PTE_AVAIL_CACHED)
+            image_cache_put(pte->val & PTE_ADDR_MASK);
+        else
+            frame_free(pte->val & PTE_ADDR_MASK);
+
+        pte->val = 0;
+        FLUSH_TLB(page);
+    }
+}
+
+/*
+ * void paging_release(uint32_t pid)
+ *   DESCRIPTION: unmaps the whole program image of a process (paging_unmap_image)
+ *   INPUTS: pid - the pid of the process
+ *   OUTPUTS: None
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the image page table is cleared
+ */
+
+void
+paging_release(uint32_t pid)
+{
+    paging_unmap_image(pid, PROGRAM_START, PROGRAM_START + FOUR_MB);
+}
+
+/*
+ * int32_t paging_fork(uint32_t parent, uint32_t child)
+ *   DESCRIPTION: builds the address space of a forked process from the one of its parent.
+ *                Image pages are shared rather than copied: cached pages through the image
+ *                cache, private pages read-only and PTE_AVAIL_COW in both processes, so the
+ *                first write to one copies it. Video, mmap and file system mappings are copied,
+ *                and the child is attached to the parent's shared memory segments.
+ *   INPUTS: parent - the pid of the current process
+ *           child - the pid of the new process, which has nothing allocated yet
+ *   OUTPUTS: None
+ *   RETURN VALUE: 0 on success, -1 if memory is full or a page of parent is swapped out
+ *   SIDE EFFECTS: reloads CR3, since writable pages of parent become read-only; never touches
+ *                 the disk, so it may run with interrupts off after paging_swap_in_image
+ */
+
+int32_t
+paging_fork(uint32_t parent, uint32_t child)
+{
+    uint32_t i, frame;
+    pte_t * pte;
+
+    if (parent >= MAX_PID || user_image_page[parent] == NULL || paging_allocate(child) == -1)
+        return -1;
+
+    for (i = 0; i < PAGE_SIZE; i++)
+    {
+        pte = &user_image_page[parent][i];
+
+        // Reading it back would sleep on the disk; the caller swapped everything in already
+        if (!pte->present && pte->avail == PTE_AVAIL_SWAP)
+            break;
+        if (!pte->present)
+            continue;
+
+        frame = pte->val & PTE_ADDR_MASK;
+        if (pte->avail == PTE_AVAIL_CACHED)
+            image_cache_dup(frame);
+        else if (frame_ref(frame) == -1)
+            break;
+        else
+        {
+            pte->read_write = 0;
+            pte->avail = PTE_AVAIL_COW;
+        }
+
+        user_image_page[child][i] = *pte;
+    }
+
+    RELOAD_CR3((uint32_t) page_dirs[parent]);
+
+    if (i < PAGE_SIZE)
+    {
+        paging_free(child);
+        return -1;
+    }
+
+    // These map kernel owned memory, so copying the entries is enough
+    if (user_video_page[parent] != NULL)
+    {
+        if ((user_video_page[child] = paging_table_new(child, VIDEO_MEM_LOAD)) == NULL)
+        {
+            paging_free(child);
+            return -1;
+        }
+        memcpy(user_video_page[child], user_video_page[parent], FOUR_KB);
+    }
+
+    if (user_mmap_page[parent] != NULL)
+    {
+        if ((user_mmap_page[child] = paging_table_new(child, MMAP_LOAD)) == NULL)
+        {
+            paging_free(child);
+            return -1;
+        }
+        memcpy(user_mmap_page[child], user_mmap_page[parent], FOUR_KB);
+    }
+
+    page_dirs[child][FS_MAP_LOAD] = page_dirs[parent][FS_MAP_LOAD];
+
+    // The child is attached to the same segments, at the same addresses
+    if (user_shm_page[parent] != NULL)
+    {
+        if ((user_shm_page[child] = paging_table_new(child, SHM_LOAD)) == NULL)
+        {
+            paging_free(child);
+            return -1;
+        }
+        memcpy(user_shm_page[child], user_shm_page[parent], FOUR_KB);
+        shm_attached[child] = shm_attached[parent];
+        for (i = 0; i < SHM_SEGMENTS; i++)
+            if (shm_attached[child] & (1 << i))
+                shm_segments[i].attached++;
+    }
+
+    return 0;
+}
+
+/*
+ * int32_t paging_shm_find(uint32_t key)
+ *   DESCRIPTION: looks up a shared memory segment by key
+ *   INPUTS: key - the key it was created with
+ *   OUTPUTS: None
+ *   RETURN VALUE: index of the segment, -1 if there is none
+ *   SIDE EFFECTS: none
+ */
+
+static int32_t
+paging_shm_find(uint32_t key)
+{
+    int32_t i;
+
+    for (i = 0; i < SHM_SEGMENTS; i++)
+        if (shm_segments[i].pages != 0 && shm_segments[i].key == key)
+            return i;
+
+    return -1;
+}
+
+/*
+ * int32_t paging_shm_create(uint32_t pid, uint32_t key, uint32_t size)
+ *   DESCRIPTION: creates a shared memory segment of size bytes, or finds the one already
+ *                created with key. Its pages read as zeros until written.
+ *   INPUTS: pid - the pid of the process creating it
+ *           key - name processes attach to it by
+ *           size - bytes, at most SHM_MAX_PAGES pages
+ *   OUTPUTS: None
+ *   RETURN VALUE: 0 on success, -1 if size is out of range, larger than the existing
+ *                 segment, or every segment is in use
+ *   SIDE EFFECTS: the segment lasts until the last process attached to it detaches, or
+ *                 until its creator exits if nobody ever attached
+ */
+
+int32_t
+paging_shm_create(uint32_t pid, uint32_t key, uint32_t size)
+{
+    int32_t i, ret = -1;
+    uint32_t flags;
+
+    if (pid >= MAX_PID || size == 0 || size > SHM_MAX_PAGES * FOUR_KB)
+        return -1;
+
+    cli_and_save(flags);
+    if ((i = paging_shm_find(key)) != -1)
+    {
+        if (size <= shm_segments[i].pages * FOUR_KB)
+            ret = 0;
+    }
+    else
+    {
+        for (i = 0; i < SHM_SEGMENTS && shm_segments[i].pages != 0; i++);
+        if (i < SHM_SEGMENTS)
+        {
+            memset(&shm_segments[i], 0, sizeof(shm_segment_t));
+            shm_segments[i].key = key;
+            shm_segments[i].pages = (size + FOUR_KB - 1) / FOUR_KB;
+            shm_segments[i].creator = pid;
+            ret = 0;
+        }
+    }
+    restore_flags(flags);
+
+    return ret;
+}
+
+/*
+ * uint32_t paging_shm_attach(uint32_t pid, uint32_t key, uint32_t * size)
+ *   DESCRIPTION: maps the shared memory segment with key into a process, at the segment's
+ *                slot in the shared memory table. Pages no process has touched yet are left
+ *                for paging_shm_fault.
+ *   INPUTS: pid - the pid of the process
+ *           key - the segment's key
+ *           size - set to the bytes in the segment
+ *   OUTPUTS: None
+ *   RETURN VALUE: virtual address of the segment, 0 on failure
+ *   SIDE EFFECTS: attaching twice maps the segment once
+ */
+
+uint32_t
+paging_shm_attach(uint32_t pid, uint32_t key, uint32_t * size)
+{
+    uint32_t flags, virt = 0, i;
+    int32_t seg;
+
+    if (pid >= MAX_PID || page_dirs[pid] == NULL)
+        return 0;
+
+    cli_and_save(flags);
+    if ((seg = paging_shm_find(key)) != -1 &&
+        (user_shm_page[pid] != NULL || (user_shm_page[pid] = paging_table_new(pid, SHM_LOAD)) != NULL))
+    {
+        if (!(shm_attached[pid] & (1 << seg)))
+        {
+            for (i = 0; i < shm_segments[seg].pages; i++)
+                if (shm_segments[seg].frames[i] != 0)
+                    user_shm_page[pid][seg * SHM_MAX_PAGES + i].val = shm_segments[seg].frames[i] | SUPERVISOR | WRITABLE | PRESENT;
+
+            shm_attached[pid] |= 1 << seg;
+            shm_segments[seg].attached++;
+        }
+
+        *size = shm_segments[seg].pages * FOUR_KB;
+        virt = SHM_START + seg * SHM_MAX_PAGES * FOUR_KB;
+    }
+    restore_flags(flags);
+
+    return virt;
+}
+
+/*
+ * void paging_shm_release(uint32_t seg)
+ *   DESCRIPTION: frees a segment nobody is attached to, and its frames
+ *   INPUTS: seg - index of the segment
+ *   OUTPUTS: None
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the slot can be created again; called with interrupts off
+ */
+
+static void
+paging_shm_release(uint32_t seg)
+{
+    uint32_t i;
+
+    for (i = 0; i < shm_segments[seg].pages; i++)
+        frame_free(shm_segments[seg].frames[i]);
+    shm_segments[seg].pages = 0;
+}
+
+/*
+ * void paging_shm_drop(uint32_t pid, uint32_t seg)
+ *   DESCRIPTION: unmaps a segment from a process, and frees it once nobody is attached
+ *   INPUTS: pid - the pid of the process, which is attached to seg
+ *           seg - index of the segment
+ *   OUTPUTS: None
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: flushes the pages from the TLB; called with interrupts off
+ */
+
+static void
+paging_shm_drop(uint32_t pid, uint32_t seg)
+{
+    uint32_t i, page = SHM_START + seg * SHM_MAX_PAGES * FOUR_KB;
+
+    for (i = 0; i < SHM_MAX_PAGES; i++, page += FOUR_KB)
+    {
+        if (!user_shm_page[pid][seg * SHM_MAX_PAGES + i].present)
+            continue;
+
+        user_shm_page[pid][seg * SHM_MAX_PAGES + i].val = 0;
+        FLUSH_TLB(page);
+    }
+
+    shm_attached[pid] &= ~(1 << seg);
+    if (--shm_segments[seg].attached == 0)
+        paging_shm_release(seg);
+}
+
+/*
+ * int32_t paging_shm_detach(uint32_t pid, uint32_t key)
+ *   DESCRIPTION: unmaps the shared memory segment with key from a process
+ *   INPUTS: pid - the pid of the process
+ *           key - the segment's key
+ *   OUTPUTS: None
+ *   RETURN VALUE: 0 on success, -1 if the process is not attached to it
+ *   SIDE EFFECTS: the last detach frees the segment
+ */
+
+int32_t
+paging_shm_detach(uint32_t pid, uint32_t key)
+{
+    uint32_t flags;
+    int32_t seg, ret = -1;
+
+    if (pid >= MAX_PID)
+        return -1;
+
+    cli_and_save(flags);
+    if ((seg = paging_shm_find(key)) != -1 && (shm_attached[pid] & (1 << seg)))
+    {
+        paging_shm_drop(pid, seg);
+        ret = 0;
+    }
+    restore_flags(flags);
+
+    return ret;
+}
+
+/*
+ * int32_t paging_shm_fault(uint32_t addr)
+ *   DESCRIPTION: called by the page fault handler; if addr is in a segment the current process
+ *                is attached to, maps its page. The first process to touch a page takes and
+ *                zeroes its frame; the others map the same frame.
+ *   INPUTS: addr - the faulting linear address from CR2
+ *   OUTPUTS: None
+ *   RETURN VALUE: 0 if the fault was handled, -1 if it was a real fault or memory is full
+ *   SIDE EFFECTS: the page is mapped for user level
+ */
+
+int32_t
+paging_shm_fault(uint32_t addr)
+{
+    pcb_t * curr = pcb_process();
+    uint32_t page = addr & PTE_ADDR_MASK;
+    uint32_t index = (addr >> TABLE_ADDRESS_SHIFT) & TABLE_ADDRESS_MASK;
+    uint32_t seg = index / SHM_MAX_PAGES, fresh = 0;
+    shm_segment_t * segment = &shm_segments[seg];
+
+    if (addr < SHM_START || addr >= SHM_START + FOUR_MB || curr->pid >= MAX_PID ||
+        user_shm_page[curr->pid] == NULL || !(shm_attached[curr->pid] & (1 << seg)) ||
+        index % SHM_MAX_PAGES >= segment->pages)
+        return -1;
+
+    if (segment->frames[index % SHM_MAX_PAGES] == 0)
+    {
+        if ((segment->frames[index % SHM_MAX_PAGES] = frame_alloc()) == 0)
+            return -1;
+        fresh = 1;
+    }
+
+    user_shm_page[curr->pid][index].val = segment->frames[index % SHM_MAX_PAGES] | SUPERVISOR | WRITABLE | PRESENT;
+    FLUSH_TLB(page);
+
+    // The kernel reaches the new frame only through this mapping
+    if (fresh)
+        memset((uint8_t *) page, 0, FOUR_KB);
+
+    return 0;
+}
+
+/*
+ * void paging_free(uint32_t pid)
+ *   DESCRIPTION: unmaps the program image of a process that is going away, detaches its shared
+ *                memory and gives its frames, page tables and page directory back to the frame
+ *                allocator. Segments it created that nobody attached to are freed too.
+ *                If the directory is in CR3, the boot directory is loaded first, so nothing
+ *                keeps using tables the allocator may hand out again.
+ *   INPUTS: pid - the pid of the process
+ *   OUTPUTS: None
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the process must not touch its image again; may reload CR3
+ */
+
+void
+paging_free(uint32_t pid)
+{
+    uint32_t i, cr3;
+
+    // pid 0 keeps the directory the kernel booted with
+    if (pid >= MAX_PID || pid == 0)
+        return;
+
+    asm volatile("movl %%cr3, %0" : "=r" (cr3));
+    if (page_dirs[pid] != NULL && (cr3 & PTE_ADDR_MASK) == (uint32_t) page_dirs[pid])
+        RELOAD_CR3((uint32_t) page_dir_table);
+
+    paging_release(pid);
+
+    for (i = 0; i < SHM_SEGMENTS; i++)
+    {
+        if (shm_attached[pid] & (1 << i))
+            paging_shm_drop(pid, i);
+
+        // A segment the process never shared would otherwise hold its slot forever
+        if (shm_segments[i].pages != 0 && shm_segments[i].creator == pid)
+        {
+            if (shm_segments[i].attached == 0)
+                paging_shm_release(i);
+            else
+                shm_segments[i].creator = MAX_PID;
+        }
+    }
+
+    frame_free((uint32_t) user_image_page[pid]);
+    frame_free((uint32_t) user_video_page[pid]);
+    frame_free((uint32_t) user_mmap_page[pid]);
+    frame_free((uint32_t) user_shm_page[pid]);
+    frame_free((uint32_t) page_dirs[pid]);
+    user_image_page[pid] = NULL;
+    user_video_page[pid] = NULL;
+    user_mmap_page[pid] = NULL;
+    user_shm_page[pid] = NULL;
+    page_dirs[pid] = NULL;
 }
@@ -18,6 +18,12 @@
 #define KERNAL_END 0x800
 #define PROGRAM_START 0x8000000 // The virtual memory location where programs are located
 #define PROGRAM_OFFSET 0x48000 // offset to start loading the program into virtual memory
+#define USER_STACK_MAX 0x100000 // top of the program page kept for the user stack
+#define USER_HEAP_END (PROGRAM_START + FOUR_MB - USER_STACK_MAX) // brk may not go past this
+// Lowest page of the stack area, never mapped, so a stack overflow faults here
+// instead of running into the heap or the image
+#define USER_STACK_GUARD USER_HEAP_END
+#define PAGE_ALIGN_UP(addr) (((addr) + FOUR_KB - 1) & PTE_ADDR_MASK)
 
 
 #define PTE_ADDR_MASK 0xFFFFF000
@@ -31,9 +37,38 @@
 #define P_IMG 0x20
 
 #define VIDEO_MEM_LOAD 31
+#define MMAP_LOAD 33 // page directory entry for mmap'd files, right above the program image
+#define MMAP_START (MMAP_LOAD * FOUR_MB)
+#define FS_MAP_LOAD 34 // page directory entry for the read-only view of the file system image
+#define FS_MAP_START (FS_MAP_LOAD * FOUR_MB)
+#define SHM_LOAD 35 // page directory entry for shared memory segments
+#define SHM_START (SHM_LOAD * FOUR_MB)
+#define SHM_SEGMENTS 16
+// Each segment has a fixed slot of SHM_MAX_PAGES pages (256 KB) in the shared memory
+// table, at the same address in every process attached to it
+#define SHM_MAX_PAGES (PAGE_SIZE / SHM_SEGMENTS)
+#define RUNTIME_LOAD 36 // page directory entry for the shared runtime (syscalls/ece391runtime.h)
+#define RUNTIME_START (RUNTIME_LOAD * FOUR_MB)
+#define RUNTIME_MAX_PAGES 4
+#define RUNTIME_FILE "runtime"
+
+#define PF_WRITE 0x2 // page fault error code: the access was a write
+
+#define PTE_AVAIL_CACHED 0x1 // avail bits of an image PTE mapping an image cache frame
+#define PTE_AVAIL_COW 0x2 // avail bits of a read-only image PTE whose frame is copied on write
+#define PTE_AVAIL_SWAP 0x4 // avail bits of a not present image PTE whose page is in the swap slot in its address bits
 
                         
 
+//A shared memory segment; its frames are taken on first touch, 0 until then
+typedef struct {
+	uint32_t key;
+	uint32_t pages; // 0 while the slot is free
+	uint32_t attached; // processes that have it mapped
+	uint32_t creator; // pid that created it, MAX_PID once that process has exited
+	uint32_t frames[SHM_MAX_PAGES];
+} shm_segment_t;
+
 //Page directory entry
 typedef union pde_t {
 	uint32_t val;
@@ -96,8 +131,26 @@ asm volatile(" movl %0, %%eax \n   \
 
 extern void paging_init();
 extern int32_t paging_allocate(uint32_t pid);
+extern int32_t paging_allocate_kernel(uint32_t pid);
 extern int32_t paging_update_control(uint32_t pid);
 extern int32_t paging_map_video(uint32_t pid, uint8_t ** screen_start);
 extern void update_video_paging(uint16_t pid, uint32_t addr);
+extern uint32_t paging_mmap_reserve(uint32_t pid, uint32_t pages);
+extern void paging_mmap_unmap(uint32_t pid, uint32_t virt, uint32_t pages);
+extern int32_t paging_image_fault(uint32_t pid, uint32_t addr, uint32_t error_code);
+extern void paging_release(uint32_t pid);
+extern void paging_unmap_image(uint32_t pid, uint32_t start, uint32_t end);
+extern void paging_free(uint32_t pid);
+extern int32_t paging_mmap_page(uint32_t pid, uint32_t virt, uint32_t phys);
+extern uint32_t paging_map_fs(uint32_t pid, uint32_t image, uint32_t length);
+extern uint32_t paging_fs_mapped(void);
+extern int32_t paging_fork(uint32_t parent, uint32_t child);
+extern int32_t paging_shm_create(uint32_t pid, uint32_t key, uint32_t size);
+extern uint32_t paging_shm_attach(uint32_t pid, uint32_t key, uint32_t * size);
+extern int32_t paging_shm_detach(uint32_t pid, uint32_t key);
+extern int32_t paging_shm_fault(uint32_t addr);
+extern void paging_runtime_init(void);
+extern int32_t paging_swap_out(uint32_t pid);
+extern int32_t paging_swap_in_image(uint32_t pid);
 
 #endif
@@ -1,11 +1,28 @@
 #include "pcb.h"
 
+static int pcb_unsupported();
+
 // Function pointer interfaces
 
-func_ptr rtc_driver[4] = { rtc_open, rtc_write, rtc_read, rtc_close };
-func_ptr file_driver[4] = { file_open, file_write, file_read, file_close };
-func_ptr dir_driver[4] = { dir_open, dir_write, dir_read, dir_close };
-func_ptr terminal_driver[4] = { terminal_open, terminal_write, terminal_read, terminal_close };
+func_ptr rtc_driver[DRIVER_OPS] = { rtc_open, rtc_write, rtc_read, rtc_close, pcb_unsupported, pcb_unsupported, pcb_unsupported };
+func_ptr file_driver[DRIVER_OPS] = { file_open, file_write, file_read, file_close, file_lseek, file_pread, file_pwrite };
+func_ptr dir_driver[DRIVER_OPS] = { dir_open, dir_write, dir_read, dir_close, dir_lseek, pcb_unsupported, pcb_unsupported };
+func_ptr terminal_driver[DRIVER_OPS] = { terminal_open, terminal_write, terminal_read, terminal_close, pcb_unsupported, pcb_unsupported, pcb_unsupported };
+
+/*
+ * int pcb_unsupported()
+ *   DESCRIPTION: driver table entry for operations a device does not have, such as seeking a terminal
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: -1
+ *   SIDE EFFECTS: none
+ */
+
+static int
+pcb_unsupported()
+{
+    return -1;
+}
 
 
 /*
@@ -25,6 +42,7 @@ pcb_init(pcb_t *pcb)
 
     // Setup the PCB
 		pcb->term = 0;
+    pcb->forked = 0;
 
     for (i = 0; i < FD_MAX; i++)
     {
@@ -32,6 +50,10 @@ pcb_init(pcb_t *pcb)
         pcb->elements[i].inode_ptr = NULL;
         pcb->elements[i].file_position = 0;
         pcb->elements[i].flags = 0;
+        pcb->elements[i].inode = NULL;
+        pcb->elements[i].block = NULL;
+        pcb->elements[i].mmap_start = 0;
+        pcb->elements[i].mmap_pages = 0;
     }
 
     // stdin
@@ -69,6 +91,10 @@ pcb_open(pcb_t * pcb, void * file_op_tbl)
             pcb->elements[i].file_operation_jmp_tbl = file_op_tbl;
             pcb->elements[i].file_position = 0;
             pcb->elements[i].inode_ptr = NULL;
+            pcb->elements[i].inode = NULL;
+            pcb->elements[i].block = NULL;
+            pcb->elements[i].mmap_start = 0;
+            pcb->elements[i].mmap_pages = 0;
             pcb->elements[i].flags = 1;
             return i; // Return the line that was opened
         }
@@ -17,11 +17,28 @@
 
 typedef int (*func_ptr)();
 
+// Slots of the per-type driver tables in pcb.c
+#define DRIVER_OPEN 0
+#define DRIVER_WRITE 1
+#define DRIVER_READ 2
+#define DRIVER_CLOSE 3
+#define DRIVER_LSEEK 4
+#define DRIVER_PREAD 5
+#define DRIVER_PWRITE 6
+#define DRIVER_OPS 7
+
 typedef struct {
     func_ptr * file_operation_jmp_tbl;
     uint32_t inode_ptr; 
     uint32_t file_position;
     uint32_t flags; // open/close
+    // Read cursor for regular files, so sequential reads skip the block lookup
+    inode_t * inode; // resolved inode_ptr
+    uint32_t block_index; // index into inode->data of the cached block
+    data_block_t * block; // that data block, NULL until the first read
+    uint32_t generation; // fs generation block was looked up in; stale once blocks are freed
+    uint32_t mmap_start; // user address of the file's mmap, unmapped on close
+    uint32_t mmap_pages; // pages mapped there, 0 if the file is not mapped
 } __attribute__((packed)) file_descriptor_element_t;
 
 typedef struct {
@@ -37,6 +54,10 @@ typedef struct {
     uint8_t rtc_fd;
     uint8_t rtc;
     int rtc_rate;
+    uint32_t image_inode; // program file, paged in on demand by the page fault handler
+    uint8_t forked; // made by fork: nobody waits for it, so halt just switches away
+    uint32_t heap_start; // first address past the program image and its bss
+    uint32_t brk; // end of the heap, moved by brk and sbrk
 } __attribute__((packed)) pcb_t;
 
 
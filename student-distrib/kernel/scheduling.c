@@ -20,7 +20,7 @@ scheduling_init(void)
 	int i; //iterator
 
 	//mark all tasks unscheduled
-	for(i=0; i<=MAX_PID; i++)
+	for(i=0; i<MAX_PID; i++)
 		sched[i] = 0;
 	//print kernel message
 	printf("Enabled Scheduling\n");
@@ -57,6 +57,40 @@ unschedule_task(uint16_t pid)
 	return;
 }
 
+/*
+ *  task_scheduled -- check whether a task is marked runnable
+ *   INPUTS:  pid -- pid of task to check
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the task is scheduled, 0 if not or pid is out of range
+ *   SIDE EFFECTS: none
+ */
+uint8_t
+task_scheduled(uint16_t pid)
+{
+	return pid < MAX_PID && sched[pid] == 1;
+}
+
+/*
+ *  task_sleepable -- find the task a sleep would unschedule. There is none on the boot
+ *                    stack, whose PCB is not set up, nor for a task the scheduler would
+ *                    not switch back to.
+ *   INPUTS:  none
+ *   OUTPUTS: none
+ *   RETURN VALUE: pid of the current task, -1 if it cannot sleep
+ *   SIDE EFFECTS: none
+ */
+int16_t
+task_sleepable(void)
+{
+	pcb_t *curr = pcb_process();
+
+	if (curr->pid >= MAX_PID || get_pcb(curr->pid) != curr || !tasks_pid_in_use(curr->pid) ||
+		!task_scheduled(curr->pid))
+		return -1;
+
+	return curr->pid;
+}
+
 
 void
 /*
@@ -17,4 +17,10 @@ void schedule_task(uint16_t pid);
 
 //unmark a pid as runnable
 void unschedule_task(uint16_t pid);
+
+//check whether a pid is runnable
+uint8_t task_scheduled(uint16_t pid);
+
+//pid of the current task if it can be put to sleep
+int16_t task_sleepable(void);
 #endif
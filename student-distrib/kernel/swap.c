@@ -0,0 +1,143 @@
+#include "swap.h"
+#include "../drivers/fs.h"
+
+// One bit per slot, set while the slot holds a page
+static uint32_t swap_bitmap[SWAP_SLOTS / SWAP_WORD_BITS];
+static uint32_t swap_slots; // slots the disk has room for, 0 without swap
+static uint32_t swap_free_count;
+static uint32_t swap_first_sector;
+
+/*
+ * void swap_init(void)
+ *   DESCRIPTION: sets up the swap area in the sectors after the last block the file system
+ *                may use, up to SWAP_SLOTS pages. There is no swap unless the file system
+ *                was mounted from the disk and left room at its end.
+ *   INPUTS: none
+ *   OUTPUTS: prints the size of the swap area
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: must run after fs_init
+ */
+
+void
+swap_init(void)
+{
+	uint32_t fs_end = fs_disk_end();
+
+	memset(swap_bitmap, 0, sizeof(swap_bitmap));
+	swap_slots = 0;
+
+	if (fs_end != 0 && ata_sectors() > fs_end)
+		swap_slots = (ata_sectors() - fs_end) / SWAP_SLOT_SECTORS;
+	if (swap_slots > SWAP_SLOTS) swap_slots = SWAP_SLOTS;
+
+	swap_free_count = swap_slots;
+	swap_first_sector = ata_sectors() - swap_slots * SWAP_SLOT_SECTORS;
+
+	if (swap_slots == 0)
+		printf("No swap area\n");
+	else
+		printf("Swap: %d KB at sector %d\n", swap_slots * SWAP_SLOT_SIZE / 1024, swap_first_sector);
+}
+
+/*
+ * int32_t swap_slot_alloc(void)
+ *   DESCRIPTION: takes a free slot of the swap area
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the slot, SWAP_NONE if the swap area is full or there is none
+ *   SIDE EFFECTS: none
+ */
+
+int32_t
+swap_slot_alloc(void)
+{
+	uint32_t i, flags;
+
+	cli_and_save(flags);
+	for (i = 0; i < swap_slots; i++) {
+		if (!(swap_bitmap[i / SWAP_WORD_BITS] & (1 << (i % SWAP_WORD_BITS)))) {
+			swap_bitmap[i / SWAP_WORD_BITS] |= 1 << (i % SWAP_WORD_BITS);
+			swap_free_count--;
+			restore_flags(flags);
+			return i;
+		}
+	}
+	restore_flags(flags);
+
+	return SWAP_NONE;
+}
+
+/*
+ * void swap_slot_free(uint32_t slot)
+ *   DESCRIPTION: gives a slot back once its page is read back in or no longer needed
+ *   INPUTS: slot - a slot from swap_slot_alloc
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: ignores free and out of range slots
+ */
+
+void
+swap_slot_free(uint32_t slot)
+{
+	uint32_t flags;
+
+	if (slot >= swap_slots) return;
+
+	cli_and_save(flags);
+	if (swap_bitmap[slot / SWAP_WORD_BITS] & (1 << (slot % SWAP_WORD_BITS))) {
+		swap_bitmap[slot / SWAP_WORD_BITS] &= ~(1 << (slot % SWAP_WORD_BITS));
+		swap_free_count++;
+	}
+	restore_flags(flags);
+}
+
+/*
+ * uint32_t swap_free_slots(void)
+ *   DESCRIPTION: number of free slots in the swap area
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: free slots
+ *   SIDE EFFECTS: none
+ */
+
+uint32_t
+swap_free_slots(void)
+{
+	return swap_free_count;
+}
+
+/*
+ * int32_t swap_write(uint32_t slot, const void * page)
+ *   DESCRIPTION: writes a page out to its slot
+ *   INPUTS: slot - a slot from swap_slot_alloc
+ *           page - the page, SWAP_SLOT_SIZE bytes mapped in the current address space
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: may sleep the calling task
+ */
+
+int32_t
+swap_write(uint32_t slot, const void * page)
+{
+	if (slot >= swap_slots) return -1;
+
+	return ata_write(swap_first_sector + slot * SWAP_SLOT_SECTORS, SWAP_SLOT_SECTORS, page);
+}
+
+/*
+ * int32_t swap_read(uint32_t slot, void * page)
+ *   DESCRIPTION: reads a page back from its slot
+ *   INPUTS: slot - a slot holding a page written by swap_write
+ *           page - destination, SWAP_SLOT_SIZE bytes mapped in the current address space
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: may sleep the calling task
+ */
+
+int32_t
+swap_read(uint32_t slot, void * page)
+{
+	if (slot >= swap_slots) return -1;
+
+	return ata_read(swap_first_sector + slot * SWAP_SLOT_SECTORS, SWAP_SLOT_SECTORS, page);
+}
@@ -0,0 +1,25 @@
+#ifndef _SWAP_H_
+#define _SWAP_H_
+
+#include "../lib/lib.h"
+#include "../lib/types.h"
+#include "../drivers/ata.h"
+
+// The swap area is the end of the file system disk, past the blocks the file system may use
+#define SWAP_SLOTS 1024 // 4 MB of swapped out pages at most
+#define SWAP_SLOT_SIZE 0x1000
+#define SWAP_SLOT_SECTORS (SWAP_SLOT_SIZE / ATA_SECTOR_SIZE)
+#define SWAP_WORD_BITS 32
+#define SWAP_NONE -1
+// A process waiting for input on a terminal nobody is looking at is swapped out
+// once fewer frames than this are free
+#define SWAP_LOW_FRAMES 64
+
+extern void swap_init(void);
+extern int32_t swap_slot_alloc(void);
+extern void swap_slot_free(uint32_t slot);
+extern uint32_t swap_free_slots(void);
+extern int32_t swap_write(uint32_t slot, const void * page);
+extern int32_t swap_read(uint32_t slot, void * page);
+
+#endif
@@ -37,9 +37,30 @@ syscall_halt (uint8_t status)
     pcb_t * curr = pcb_process();
     pcb_t * c_parent_pcb = (pcb_t *) curr->parent_pcb;
 
+    if (curr->forked)
+    {
+        //nobody waits for a forked process: give everything back and run the next task,
+        //which never switches back here since this pid is no longer scheduled. Interrupts
+        //stay off until the switch, paging_free leaves for the boot directory, and the
+        //pid and this stack are only reused once another task runs
+        unschedule_task(curr->pid);
+        for (i = 2; i < FD_MAX; i++) if (curr->elements[i].flags) syscall_close(i);
+        paging_free(curr->pid);
+        tasks_pid_retire(curr->pid);
+
+        //with nothing else runnable, wait here for a task to be scheduled
+        while (1)
+        {
+            scheduler_tick();
+            asm volatile("sti; hlt; cli");
+        }
+    }
+
     if (curr->parent_pcb == NULL)
     {
         ///Should not halt shell
+        for (i = 2; i < FD_MAX; i++) if (curr->elements[i].flags) syscall_close(i);
+        paging_free(curr->pid);
         tasks_pid_free(curr->pid);
         asm volatile("movl %0, %%esp"       \
                       :: "r" (KERNEL_STACK(curr->pid)));
@@ -58,7 +79,9 @@ syscall_halt (uint8_t status)
     //remove child PCB
     c_parent_pcb -> child = NULL;
     
-    //free this task's pid
+    //hand shared image pages back to the image cache, the image frame back to the
+    //frame allocator, and free this task's pid
+    paging_free(curr->pid);
     tasks_pid_free(curr->pid);
 
 
@@ -110,7 +133,7 @@ syscall_halt (uint8_t status)
 int32_t 
 syscall_execute (const uint8_t * command)
 {
-    uint8_t fname[BUFFER_LENGTH];
+    uint8_t fname[BUFFER_LENGTH + 1]; // room for a NUL after a full-length name
     uint8_t fargs[IN_BUF_SIZE];
   uint16_t pid;
     uint32_t i, fname_length = 0, file_flag = 0,  entry_point;
@@ -164,14 +187,20 @@ syscall_execute (const uint8_t * command)
 		cli_and_save(flags); // Do we need this? How do we reenable interrupts afterwards
   
     
-    // 3) setup paging and load CR3, flush TLB
-    paging_allocate(pid);
+    // 3) setup paging and load CR3, flush TLB; fails when there is no memory left for the image
+    if (paging_allocate(pid) == -1)
+    {
+        tasks_pid_free(pid);
+        restore_flags(flags);
+        return -1;
+    }
     paging_update_control(pid);
 		
     // 4) Call loader
-    entry_point = loader((char *) fname);
+    entry_point = loader(&dentry);
     if (entry_point == -1)
     {
+        paging_free(pid);
         tasks_pid_free(pid);
         paging_update_control(curr->pid);
         restore_flags(flags);
@@ -190,6 +219,9 @@ syscall_execute (const uint8_t * command)
     newPCB->pid = pid;
     newPCB->esp_reg = ((uint32_t)(newPCB)) + KERNEL_STACK_SIZE - 4;
 	newPCB->term = curr->term;
+    newPCB->image_inode = dentry.inode_index;
+    newPCB->heap_start = loader_image_end(dentry.inode_index);
+    newPCB->brk = newPCB->heap_start;
 	newPCB->parent_pcb = (struct pcb_t *) curr;
 
     // Store the args passed to this function into the PCB.
@@ -248,7 +280,7 @@ syscall_execute (const uint8_t * command)
 int32_t 
 syscall_init_shell (uint8_t term_num)
 {
-    uint8_t fname[BUFFER_LENGTH];
+    uint8_t fname[BUFFER_LENGTH + 1]; // room for a NUL after a full-length name
     uint8_t fargs[IN_BUF_SIZE];
     uint16_t pid;
     uint32_t i, fname_length = 0, file_flag = 0,  entry_point;
@@ -304,13 +336,19 @@ syscall_init_shell (uint8_t term_num)
     cli_and_save(flags); // Do we need this? How do we reenable interrupts afterwards
     
     // 3) setup paging and load CR3, flush TLB
-    paging_allocate(pid);
+    if (paging_allocate(pid) == -1)
+    {
+        tasks_pid_free(pid);
+        restore_flags(flags);
+        return -1;
+    }
     paging_update_control(pid);
 
     // 4) Call loader
-    entry_point = loader((char *) fname);
+    entry_point = loader(&dentry);
     if (entry_point == -1)
     {
+        paging_free(pid);
         tasks_pid_free(pid);
         paging_update_control(curr->pid);
         restore_flags(flags);
@@ -332,6 +370,9 @@ syscall_init_shell (uint8_t term_num)
     newPCB->pid = pid;
     newPCB->esp_reg = ((uint32_t)(newPCB)) + KERNEL_STACK_SIZE - 4;
     newPCB->term = term_num;
+    newPCB->image_inode = dentry.inode_index;
+    newPCB->heap_start = loader_image_end(dentry.inode_index);
+    newPCB->brk = newPCB->heap_start;
     // Store the args passed to this function into the PCB.
     strcpy((int8_t*)newPCB->args, (const int8_t*)fargs);
     
@@ -455,13 +496,37 @@ syscall_open (const uint8_t * filename)
     fd = file_open(filename);
     if (fd == -1) return -1;
 
-    if (strncmp("rtc", (char*)filename, 3) != -1)
+    // Only the RTC device itself, not every file whose name starts with "rtc"
+    if ((void *) curr->elements[fd].file_operation_jmp_tbl == (void *) rtc_driver)
         curr->rtc_fd = fd;
 
     (*(curr->elements[fd].file_operation_jmp_tbl[0]))();
     return fd;
 }
 
+/*
+ * void syscall_mmap_drop (pcb_t * curr, int32_t fd)
+ *   DESCRIPTION: Unmaps the pages syscall_mmap mapped for an open file, if any
+ *   INPUTS: curr - the current process
+ *           fd - a valid file descriptor
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: the pages go back to the process's mmap region
+ */
+
+static void
+syscall_mmap_drop (pcb_t * curr, int32_t fd)
+{
+    file_descriptor_element_t * file = &curr->elements[fd];
+
+    if (file->mmap_pages == 0) return;
+
+    paging_mmap_unmap(curr->pid, file->mmap_start, file->mmap_pages);
+    fs_mmap_drop(file->inode_ptr);
+    file->mmap_start = 0;
+    file->mmap_pages = 0;
+}
+
 /*
  * int32_t syscall_close (int32_t fd)
  *   DESCRIPTION: Performs a open on the passed in fd, calls the open operation in the fd's jump table 
@@ -483,6 +548,8 @@ syscall_close (int32_t fd)
     // File isn't open in the first place
     if (curr->elements[fd].flags == 0) return -1;
 
+    syscall_mmap_drop(curr, fd);
+
     // Set the flag to 0
     pcb_close(curr, fd);
 
@@ -548,6 +615,548 @@ syscall_vidmap (uint8_t ** screen_start)
     return VIDEO_MEM_LOC;
 }
 
+/*
+ * int32_t syscall_mmap (int32_t fd, uint8_t ** start)
+ *   DESCRIPTION: Maps the data blocks of an open file read-only into the current process, one 4 KB page
+ *                per block, so the file can be scanned in place without read calls
+ *   INPUTS: fd - an open regular file
+ *           start - set to the user address of the first byte of the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: length of the file in bytes on success, -1 on failure
+ *   SIDE EFFECTS: uses up part of the process's mmap region until fd is closed or mapped again
+ */
+
+int32_t
+syscall_mmap (int32_t fd, uint8_t ** start)
+{
+    pcb_t * curr = pcb_process();
+    file_descriptor_element_t * file;
+    uint32_t length, pages, virt, i;
+    uint8_t * block;
+
+    if (fd >= FD_MAX || fd < FD_MIN) return -1;
+
+    if (start == NULL || (uint32_t) start < KERNEL_MEM_END)
+        return -1;
+
+    // Only regular files have data blocks to map
+    file = &curr->elements[fd];
+    if (!file->flags || file->inode == NULL) return -1;
+
+    // Mapping the file again replaces its old mapping
+    syscall_mmap_drop(curr, fd);
+
+    length = file->inode->length;
+    pages = (length + FOUR_KB - 1) / FOUR_KB;
+
+    virt = paging_mmap_reserve(curr->pid, pages);
+    if (virt == 0) return -1;
+
+    // Blocks need not be contiguous in the image, so each gets its own PTE
+    for (i = 0; i < pages; i++)
+    {
+        block = fs_data_block(file->inode_ptr, i);
+        if (block == NULL || paging_mmap_page(curr->pid, virt + i * FOUR_KB, (uint32_t) block) == -1)
+        {
+            paging_mmap_unmap(curr->pid, virt, i);
+            return -1;
+        }
+    }
+
+    paging_update_control(curr->pid);
+    file->mmap_start = virt;
+    file->mmap_pages = pages;
+    if (pages != 0)
+        fs_mmap_hold(file->inode_ptr);
+
+    *start = (uint8_t *) virt;
+    return length;
+}
+
+/*
+ * int32_t syscall_truncate (int32_t fd, uint32_t length)
+ *   DESCRIPTION: Sets the length of an open regular file, dropping data past the new end or
+ *                extending it with zeros
+ *   INPUTS: fd - an open regular file
+ *           length - the new length in bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: frees or allocates data blocks
+ */
+
+int32_t
+syscall_truncate (int32_t fd, uint32_t length)
+{
+    file_descriptor_element_t * file;
+
+    if (fd >= FD_MAX || fd < FD_MIN) return -1;
+
+    file = &pcb_process()->elements[fd];
+    if (!file->flags || file->inode == NULL) return -1;
+
+    return fs_truncate(file->inode_ptr, length);
+}
+
+/*
+ * int32_t syscall_getdents (int32_t fd, void * buf, int32_t nbytes)
+ *   DESCRIPTION: Fills buf with as many directory records (dirent_t) as fit
+ *   INPUTS: fd - an open directory
+ *           buf - user buffer for the records
+ *           nbytes - size of buf
+ *   OUTPUTS: none
+ *   RETURN VALUE: # of bytes filled, 0 at the end of the directory, -1 on failure
+ *   SIDE EFFECTS: advances the directory position
+ */
+
+int32_t
+syscall_getdents (int32_t fd, void * buf, int32_t nbytes)
+{
+    if (fd >= FD_MAX || fd < FD_MIN || nbytes <= 0) return -1;
+
+    if (buf == NULL || (uint32_t) buf < KERNEL_MEM_END)
+        return -1;
+
+    return dir_getdents(fd, buf, nbytes);
+}
+
+/*
+ * int32_t syscall_lseek (int32_t fd, int32_t offset, int32_t whence)
+ *   DESCRIPTION: Moves the position of an open file or directory
+ *   INPUTS: fd - the file descriptor
+ *           offset - signed distance to move
+ *           whence - SEEK_SET, SEEK_CUR or SEEK_END
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new position, -1 on failure or for the terminal and RTC
+ *   SIDE EFFECTS: none
+ */
+
+int32_t
+syscall_lseek (int32_t fd, int32_t offset, int32_t whence)
+{
+    pcb_t * curr = pcb_process();
+
+    if (fd >= FD_MAX || fd < FD_MIN || curr->elements[fd].flags == 0) return -1;
+
+    return (*(curr->elements[fd].file_operation_jmp_tbl[DRIVER_LSEEK]))(fd, offset, whence);
+}
+
+/*
+ * uint32_t syscall_user_buf (const void * buf, uint32_t nbytes)
+ *   DESCRIPTION: Checks that a buffer a process passed in lies wholly above kernel memory,
+ *                without wrapping around the end of the address space into it
+ *   INPUTS: buf - start of the buffer
+ *           nbytes - its size
+ *   OUTPUTS: none
+ *   RETURN VALUE: non-zero if the kernel may read or write the buffer for the process
+ *   SIDE EFFECTS: none
+ */
+
+static uint32_t
+syscall_user_buf (const void * buf, uint32_t nbytes)
+{
+    return (uint32_t) buf >= KERNEL_MEM_END && (uint32_t) buf + nbytes >= (uint32_t) buf;
+}
+
+/*
+ * int32_t syscall_pread (int32_t fd, void * buf, int32_t nbytes, uint32_t offset)
+ *   DESCRIPTION: Reads from an explicit offset, leaving the file position alone
+ *   INPUTS: fd - an open regular file
+ *           buf - user buffer to read into
+ *           nbytes - number of bytes to read
+ *           offset - where in the file to start
+ *   OUTPUTS: none
+ *   RETURN VALUE: # of bytes read, -1 on failure
+ *   SIDE EFFECTS: none
+ */
+
+int32_t
+syscall_pread (int32_t fd, void * buf, int32_t nbytes, uint32_t offset)
+{
+    pcb_t * curr = pcb_process();
+
+    if (fd >= FD_MAX || fd < FD_MIN || curr->elements[fd].flags == 0) return -1;
+    if (nbytes < 0 || !syscall_user_buf(buf, nbytes)) return -1;
+
+    return (*(curr->elements[fd].file_operation_jmp_tbl[DRIVER_PREAD]))(fd, buf, nbytes, offset);
+}
+
+/*
+ * int32_t syscall_pwrite (int32_t fd, const void * buf, int32_t nbytes, uint32_t offset)
+ *   DESCRIPTION: Writes at an explicit offset, leaving the file position alone
+ *   INPUTS: fd - an open regular file
+ *           buf - user buffer to copy from
+ *           nbytes - number of bytes to write
+ *           offset - where in the file to start
+ *   OUTPUTS: none
+ *   RETURN VALUE: # of bytes written, -1 on failure
+ *   SIDE EFFECTS: grows the file when the write runs past its end
+ */
+
+int32_t
+syscall_pwrite (int32_t fd, const void * buf, int32_t nbytes, uint32_t offset)
+{
+    pcb_t * curr = pcb_process();
+
+    if (fd >= FD_MAX || fd < FD_MIN || curr->elements[fd].flags == 0) return -1;
+    if (nbytes < 0 || !syscall_user_buf(buf, nbytes)) return -1;
+
+    return (*(curr->elements[fd].file_operation_jmp_tbl[DRIVER_PWRITE]))(fd, buf, nbytes, offset);
+}
+
+/*
+ * int32_t syscall_readv (int32_t fd, const iovec_t * iov, int32_t iovcnt)
+ *   DESCRIPTION: Reads into several buffers in turn with one trap, stopping early on a short read
+ *   INPUTS: fd - the file descriptor to read from
+ *           iov - array of user buffers
+ *           iovcnt - number of buffers, at most IOV_MAX
+ *   OUTPUTS: none
+ *   RETURN VALUE: total # of bytes read, -1 if the first read fails
+ *   SIDE EFFECTS: advances the file position
+ */
+
+int32_t
+syscall_readv (int32_t fd, const iovec_t * iov, int32_t iovcnt)
+{
+    int32_t i, cnt, total = 0;
+
+    if (iovcnt < 0 || iovcnt > IOV_MAX || !syscall_user_buf(iov, iovcnt * sizeof(iovec_t))) return -1;
+
+    // Every buffer is checked before any data moves
+    for (i = 0; i < iovcnt; i++)
+        if (!syscall_user_buf(iov[i].base, iov[i].len)) return -1;
+
+    for (i = 0; i < iovcnt; i++)
+    {
+        if (iov[i].len == 0) continue;
+
+        cnt = syscall_read(fd, iov[i].base, iov[i].len);
+        if (cnt == -1) return total ? total : -1;
+
+        total += cnt;
+        if (cnt < iov[i].len) break;
+    }
+
+    return total;
+}
+
+/*
+ * int32_t syscall_writev (int32_t fd, const iovec_t * iov, int32_t iovcnt)
+ *   DESCRIPTION: Writes several buffers in turn with one trap
+ *   INPUTS: fd - the file descriptor to write to
+ *           iov - array of user buffers
+ *           iovcnt - number of buffers, at most IOV_MAX
+ *   OUTPUTS: none
+ *   RETURN VALUE: total # of bytes written, -1 if the first write fails
+ *   SIDE EFFECTS: advances the file position
+ */
+
+int32_t
+syscall_writev (int32_t fd, const iovec_t * iov, int32_t iovcnt)
+{
+    int32_t i, cnt, total = 0;
+
+    if (iovcnt < 0 || iovcnt > IOV_MAX || !syscall_user_buf(iov, iovcnt * sizeof(iovec_t))) return -1;
+
+    // Every buffer is checked before any data moves
+    for (i = 0; i < iovcnt; i++)
+        if (!syscall_user_buf(iov[i].base, iov[i].len)) return -1;
+
+    for (i = 0; i < iovcnt; i++)
+    {
+        if (iov[i].len == 0) continue;
+
+        cnt = syscall_write(fd, iov[i].base, iov[i].len);
+        if (cnt == -1) return total ? total : -1;
+
+        total += cnt;
+        if (cnt < iov[i].len) break;
+    }
+
+    return total;
+}
+
+/*
+ * int32_t syscall_sync (void)
+ *   DESCRIPTION: Writes everything the file system holds in memory to the disk, without
+ *                waiting for the background flusher
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if a disk write failed
+ *   SIDE EFFECTS: sleeps on the disk
+ */
+
+int32_t
+syscall_sync (void)
+{
+    return fs_sync();
+}
+
+/*
+ * int32_t syscall_fsync (int32_t fd)
+ *   DESCRIPTION: Writes one open regular file's data and inode to the disk
+ *   INPUTS: fd - an open regular file
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: sleeps on the disk
+ */
+
+int32_t
+syscall_fsync (int32_t fd)
+{
+    file_descriptor_element_t * file;
+
+    if (fd >= FD_MAX || fd < FD_MIN) return -1;
+
+    file = &pcb_process()->elements[fd];
+    if (!file->flags || file->inode == NULL) return -1;
+
+    return fs_fsync(file->inode_ptr);
+}
+
+/*
+ * int32_t syscall_mkdir (const uint8_t * dirname)
+ *   DESCRIPTION: Creates an empty directory
+ *   INPUTS: dirname - user string with the path of the new directory; every directory above
+ *                     it must exist
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: adds an entry to the parent directory
+ */
+
+int32_t
+syscall_mkdir (const uint8_t * dirname)
+{
+    if (dirname == NULL || (uint32_t) dirname < KERNEL_MEM_END) return -1;
+
+    return fs_mkdir((const int8_t *) dirname) == -1 ? -1 : 0;
+}
+
+/*
+ * int32_t syscall_fsmap (uint8_t ** start)
+ *   DESCRIPTION: Maps the whole in memory file system image read-only into the current process,
+ *                so programs can look up and scan files themselves without further calls. The
+ *                image is live: writes by other processes show up in it.
+ *   INPUTS: start - set to the user address of the boot block
+ *   OUTPUTS: none
+ *   RETURN VALUE: bytes mapped on success, -1 on failure or if the file system is on disk
+ *   SIDE EFFECTS: the mapping lasts until the process halts
+ */
+
+int32_t
+syscall_fsmap (uint8_t ** start)
+{
+    uint32_t length;
+
+    if (start == NULL || (uint32_t) start < KERNEL_MEM_END)
+        return -1;
+
+    length = paging_map_fs(pcb_process()->pid, (uint32_t) fs_get_boot_block(), fs_image_length());
+    if (length == 0) return -1;
+
+    *start = (uint8_t *) FS_MAP_START;
+    return length;
+}
+
+/*
+ * int32_t syscall_fork (void)
+ *   DESCRIPTION: Creates a copy of the calling process without loading anything from the file
+ *                system. The child shares the parent's pages until one of them writes
+ *                (paging_fork), starts with a copy of the parent's pcb and open files, and
+ *                returns from the same call. Unlike execute, the parent keeps running.
+ *   INPUTS: none; syscall_fork_linkage has pushed the caller's EDI and EBP
+ *   OUTPUTS: none
+ *   RETURN VALUE: pid of the child in the parent, 0 in the child, -1 on failure
+ *   SIDE EFFECTS: the child is scheduled
+ */
+
+int32_t
+syscall_fork (void)
+{
+    pcb_t * curr = pcb_process(), *newPCB;
+    uint32_t * parent_stack, * stack;
+    int32_t flags;
+    uint16_t pid;
+    uint32_t i;
+
+    pid = tasks_pid_new();
+
+    // out of pids
+    if (pid == NEGATIVE_1)
+        return -1;
+
+    //swapped out pages are read back while interrupts are still on, as the disk sleeps
+    if (paging_swap_in_image(curr->pid) == -1)
+    {
+        tasks_pid_free(pid);
+        return -1;
+    }
+
+    //begin critical section
+    cli_and_save(flags);
+
+    if (paging_fork(curr->pid, pid) == -1)
+    {
+        tasks_pid_free(pid);
+        restore_flags(flags);
+        return -1;
+    }
+
+    newPCB = get_pcb(pid);
+    memcpy(newPCB, curr, sizeof(pcb_t));
+    newPCB->pid = pid;
+    newPCB->child = NULL;
+    newPCB->forked = 1;
+
+    //the child maps the same files as the parent, which keeps their blocks
+    for (i = 2; i < FD_MAX; i++)
+        if (newPCB->elements[i].flags && newPCB->elements[i].mmap_pages != 0)
+            fs_mmap_hold(newPCB->elements[i].inode_ptr);
+
+    //copy the user registers, then lay the stack out as if scheduler_tick had switched away
+    //from the child, so the first switch to it returns into fork_child_return
+    parent_stack = (uint32_t *) (KERNEL_STACK(curr->pid));
+    stack = (uint32_t *) (KERNEL_STACK(pid));
+    memcpy(&stack[-FORK_FRAME_WORDS], &parent_stack[-FORK_FRAME_WORDS], FORK_FRAME_WORDS * sizeof(uint32_t));
+    stack[-FORK_FRAME_WORDS - 1] = (uint32_t) fork_child_return;
+    stack[-FORK_FRAME_WORDS - 2] = 0; //ebp
+    newPCB->ebp_reg = (uint32_t) &stack[-FORK_FRAME_WORDS - 2];
+    newPCB->esp_reg = newPCB->ebp_reg;
+
+    schedule_task(pid);
+
+    //end critical section
+    restore_flags(flags);
+
+    return pid;
+}
+
+/*
+ * int32_t syscall_set_break (pcb_t * curr, uint32_t addr)
+ *   DESCRIPTION: Moves the end of the heap of a process to addr. Pages below the new break are
+ *                mapped zero filled as they are touched; pages wholly above it are released.
+ *   INPUTS: curr - the process
+ *           addr - the new break, from heap_start up to USER_HEAP_END
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if addr is out of range
+ *   SIDE EFFECTS: none
+ */
+
+int32_t
+syscall_set_break (pcb_t * curr, uint32_t addr)
+{
+    if (addr < curr->heap_start || addr > USER_HEAP_END)
+        return -1;
+
+    if (PAGE_ALIGN_UP(addr) < PAGE_ALIGN_UP(curr->brk))
+        paging_unmap_image(curr->pid, PAGE_ALIGN_UP(addr), PAGE_ALIGN_UP(curr->brk));
+
+    curr->brk = addr;
+    return 0;
+}
+
+/*
+ * int32_t syscall_brk (void * addr)
+ *   DESCRIPTION: Sets the end of the heap, which starts right after the program image
+ *   INPUTS: addr - the new break, or NULL to ask for the current one
+ *   OUTPUTS: none
+ *   RETURN VALUE: the break on success, -1 if addr is below the heap or past USER_HEAP_END
+ *   SIDE EFFECTS: shrinking the heap frees its pages
+ */
+
+int32_t
+syscall_brk (void * addr)
+{
+    pcb_t * curr = pcb_process();
+
+    if (addr != NULL && syscall_set_break(curr, (uint32_t) addr) == -1)
+        return -1;
+
+    return curr->brk;
+}
+
+/*
+ * int32_t syscall_sbrk (int32_t increment)
+ *   DESCRIPTION: Grows the heap by increment bytes, or shrinks it if increment is negative
+ *   INPUTS: increment - bytes to add to the break
+ *   OUTPUTS: none
+ *   RETURN VALUE: the old break, the start of the new memory, on success; -1 on failure
+ *   SIDE EFFECTS: shrinking the heap frees its pages
+ */
+
+int32_t
+syscall_sbrk (int32_t increment)
+{
+    pcb_t * curr = pcb_process();
+    uint32_t old_brk = curr->brk;
+
+    // Catch a break that would wrap around the address space
+    if ((increment > 0 && old_brk + increment < old_brk) || (increment < 0 && old_brk + increment > old_brk))
+        return -1;
+
+    if (syscall_set_break(curr, old_brk + increment) == -1)
+        return -1;
+
+    return old_brk;
+}
+
+/*
+ * int32_t syscall_shm_create (uint32_t key, uint32_t size)
+ *   DESCRIPTION: Creates a shared memory segment processes can attach to by key, or checks
+ *                that the one already created with key is big enough
+ *   INPUTS: key - name of the segment
+ *           size - bytes, at most 256 KB
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: the segment reads as zeros until written
+ */
+
+int32_t
+syscall_shm_create (uint32_t key, uint32_t size)
+{
+    return paging_shm_create(pcb_process()->pid, key, size);
+}
+
+/*
+ * int32_t syscall_shm_attach (uint32_t key, uint8_t ** start)
+ *   DESCRIPTION: Maps a shared memory segment into the current process. Every process attached
+ *                to it sees the same memory, with no copy through the kernel.
+ *   INPUTS: key - name of the segment
+ *           start - set to the user address of the segment
+ *   OUTPUTS: none
+ *   RETURN VALUE: bytes in the segment on success, -1 on failure
+ *   SIDE EFFECTS: the mapping lasts until shm_detach or halt
+ */
+
+int32_t
+syscall_shm_attach (uint32_t key, uint8_t ** start)
+{
+    uint32_t virt, size;
+
+    if (start == NULL || (uint32_t) start < KERNEL_MEM_END)
+        return -1;
+
+    virt = paging_shm_attach(pcb_process()->pid, key, &size);
+    if (virt == 0) return -1;
+
+    *start = (uint8_t *) virt;
+    return size;
+}
+
+/*
+ * int32_t syscall_shm_detach (uint32_t key)
+ *   DESCRIPTION: Unmaps a shared memory segment from the current process
+ *   INPUTS: key - name of the segment
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if the process is not attached to it
+ *   SIDE EFFECTS: the segment is freed once no process is attached
+ */
+
+int32_t
+syscall_shm_detach (uint32_t key)
+{
+    return paging_shm_detach(pcb_process()->pid, key);
+}
+
 int32_t 
 syscall_set_handler (int32_t signum, void * handler_address)
 {
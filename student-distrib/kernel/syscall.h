@@ -13,6 +13,14 @@
 #define SYSCALL_VIDMAP 8
 #define SYSCALL_SET_HANDLER 9
 #define SYSCALL_SIGRETURN 10
+#define SYSCALL_MMAP 12
+#define SYSCALL_TRUNCATE 13
+#define SYSCALL_GETDENTS 14
+#define SYSCALL_LSEEK 15
+#define SYSCALL_PREAD 16
+#define SYSCALL_PWRITE 17
+#define SYSCALL_READV 18
+#define SYSCALL_WRITEV 19
 #define ENTRY_POINT_OFFSET 24
 #define DEFAULT_STACK 0x800000 - 4
 #define INITIAL_PID 1
@@ -23,6 +31,17 @@
 #define VIDEO_MEM_LOC 0x80000000 - 0x400000 + (0xB8 * 0x1000)
 #define NEGATIVE_1 0xFFFF
 #define STATUS_MASK 0x000000FF
+// Words of a fork call's kernel stack frame copied to the child: EDI and EBP from
+// syscall_fork_linkage, the return into syscall_linkage, the four registers it pushes
+// and the processor's five
+#define FORK_FRAME_WORDS 12
+#define IOV_MAX 16
+
+// One buffer of a readv or writev
+typedef struct {
+    void * base;
+    uint32_t len;
+} iovec_t;
 
 int32_t syscall_handler(uint32_t syscall_num, uint32_t arg1, uint32_t arg2, uint32_t arg3);
 
@@ -34,6 +53,25 @@ int32_t syscall_open (const uint8_t * filename);
 int32_t syscall_close (int32_t fd);
 int32_t syscall_getargs (uint8_t * buf, int32_t nbytes);
 int32_t syscall_vidmap (uint8_t ** screen_start);
+int32_t syscall_mmap (int32_t fd, uint8_t ** start);
+int32_t syscall_truncate (int32_t fd, uint32_t length);
+int32_t syscall_getdents (int32_t fd, void * buf, int32_t nbytes);
+int32_t syscall_lseek (int32_t fd, int32_t offset, int32_t whence);
+int32_t syscall_pread (int32_t fd, void * buf, int32_t nbytes, uint32_t offset);
+int32_t syscall_pwrite (int32_t fd, const void * buf, int32_t nbytes, uint32_t offset);
+int32_t syscall_readv (int32_t fd, const iovec_t * iov, int32_t iovcnt);
+int32_t syscall_writev (int32_t fd, const iovec_t * iov, int32_t iovcnt);
+int32_t syscall_sync (void);
+int32_t syscall_fsync (int32_t fd);
+int32_t syscall_mkdir (const uint8_t * dirname);
+int32_t syscall_fsmap (uint8_t ** start);
+int32_t syscall_fork (void);
+int32_t syscall_set_break (pcb_t * curr, uint32_t addr);
+int32_t syscall_brk (void * addr);
+int32_t syscall_sbrk (int32_t increment);
+int32_t syscall_shm_create (uint32_t key, uint32_t size);
+int32_t syscall_shm_attach (uint32_t key, uint8_t ** start);
+int32_t syscall_shm_detach (uint32_t key);
 int32_t syscall_set_handler (int32_t signum, void * handler_address);
 int32_t syscall_sigreturn (void);
 int32_t syscall_init_shell (uint8_t term_num);
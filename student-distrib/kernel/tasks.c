@@ -1,4 +1,6 @@
 #include "tasks.h"
+#include "paging.h"
+#include "scheduling.h"
 
 // Array of all the pids usable for in the system
 static uint8_t pid_usage[MAX_PID];
@@ -30,7 +32,8 @@ init_tasks()
 
 /*
  * int16_t tasks_pid_new()
- *   DESCRIPTION: get a new pid from the vector and set the vector for that pid to being used 
+ *   DESCRIPTION: get a new pid from the vector and set the vector for that pid to being used.
+ *                A retired pid is taken back too, unless its kernel stack is the one in use.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: the pid for the new process
@@ -42,11 +45,12 @@ int16_t
 tasks_pid_new()
 {
 	int i; //iterator
+	uint16_t curr_pid = pcb_process()->pid;
 
 	//start at PID 1. 
 	for(i=1; i<MAX_PID; i++)
 	{
-		if (pid_usage[i] == FREE)
+		if (pid_usage[i] == FREE || (pid_usage[i] == RETIRED && i != curr_pid))
 		{
 			pid_usage[i] = IN_USE;
 			return i;
@@ -80,3 +84,77 @@ tasks_pid_free(int16_t pid)
 	pid_usage[pid] = FREE;
 }
 
+/*
+ * void tasks_pid_retire(int16_t pid)
+ *   DESCRIPTION: frees the pid of a task that is exiting while still running on its kernel
+ *                stack. tasks_pid_new hands the pid (and the stack) out again only from
+ *                another task's stack, so once the exiting task has switched away.
+ *   INPUTS: pid - the pid of the current task, which must never be scheduled again
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+
+void
+tasks_pid_retire(int16_t pid)
+{
+	pid_usage[pid] = RETIRED;
+}
+
+/*
+ * int32_t tasks_pid_in_use(int16_t pid)
+ *   DESCRIPTION: checks whether a pid belongs to a live task
+ *   INPUTS: pid - the pid to check
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the pid is in use, 0 if it is free, retired or out of range
+ *   SIDE EFFECTS: none
+ */
+
+int32_t
+tasks_pid_in_use(int16_t pid)
+{
+	return pid > 0 && pid < MAX_PID && pid_usage[pid] == IN_USE;
+}
+
+/*
+ * int16_t tasks_kernel_thread(void (*entry)(void))
+ *   DESCRIPTION: starts a task that runs entry in the kernel and never goes to user space.
+ *                Its stack is laid out as if scheduler_tick had switched away from it, so
+ *                the first switch to it returns into entry, with interrupts off.
+ *   INPUTS: entry - the task's body, which must not return
+ *   OUTPUTS: none
+ *   RETURN VALUE: the pid of the task, -1 if there is no free pid
+ *   SIDE EFFECTS: the task starts unscheduled; it first runs after schedule_task(pid)
+ */
+
+int16_t
+tasks_kernel_thread(void (*entry)(void))
+{
+	int16_t pid = tasks_pid_new();
+	uint32_t * stack;
+	pcb_t * pcb;
+
+	if (pid == -1) return -1;
+	if (paging_allocate_kernel(pid) == -1)
+	{
+		tasks_pid_free(pid);
+		return -1;
+	}
+
+	pcb = get_pcb(pid);
+	pcb_init(pcb);
+	pcb->pid = pid;
+	pcb->parent_pcb = NULL;
+	pcb->child = NULL;
+	pcb->vidmap = 0;
+
+	//scheduler_tick ends with leave; ret, which pops ebp and then the return address
+	stack = (uint32_t *) (KERNEL_STACK(pid));
+	stack[-1] = 0; //return address of entry, never used
+	stack[-2] = (uint32_t) entry;
+	stack[-3] = 0; //ebp
+	pcb->ebp_reg = (uint32_t) &stack[-3];
+	pcb->esp_reg = pcb->ebp_reg;
+
+	return pid;
+}
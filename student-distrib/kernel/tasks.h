@@ -4,9 +4,12 @@
 #include "pcb.h"
 #define FREE 0
 #define IN_USE 1
+#define RETIRED 2 // its task has exited but may still be on its kernel stack
 
 //the max pid (inclusive)
-#define MAX_PID 16
+//page tables are allocated per process, so a pid slot costs little more than its 8 KB
+//kernel stack; 64 stacks reach down to 7.5 MB, where the file system stops (FS_MEM_END)
+#define MAX_PID 64
 
 //get address of a pid's kernel stack
 #define KERNEL_STACK(next_pid) 0x800000 - (0x2000 * next_pid) - 4
@@ -14,4 +17,7 @@
 void init_tasks();
 int16_t tasks_pid_new();
 void tasks_pid_free(int16_t);
+void tasks_pid_retire(int16_t);
+int32_t tasks_pid_in_use(int16_t);
+int16_t tasks_kernel_thread(void (*entry)(void));
 #endif
@@ -0,0 +1,100 @@
+/* lz4.c - Decoder for LZ4 compressed blocks
+ * vim:ts=4 noexpandtab
+ */
+
+#include "lz4.h"
+#include "lib.h"
+
+/*
+* int32_t lz4_length(const uint8_t** ip, const uint8_t* iend, uint32_t* len);
+*   Inputs: const uint8_t** ip = read position, just past the token or the offset
+*			const uint8_t* iend = end of the input
+*			uint32_t* len = length from the token's nibble, extended in place
+*   Return Value: 0 on success, -1 if the input ends inside the length
+*	Function: adds the extra length bytes that follow a full nibble (LZ4_RUN_MASK)
+*/
+
+static int32_t
+lz4_length(const uint8_t** ip, const uint8_t* iend, uint32_t* len)
+{
+	uint8_t b;
+
+	if (*len != LZ4_RUN_MASK)
+		return 0;
+
+	do {
+		if (*ip >= iend)
+			return -1;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+
+	return 0;
+}
+
+/*
+* int32_t lz4_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len);
+*   Inputs: const uint8_t* src = one LZ4 block (no frame header)
+*			uint32_t src_len = bytes in the block
+*			uint8_t* dst = output buffer
+*			uint32_t dst_len = size of the output buffer
+*   Return Value: number of bytes written to dst, -1 if the block is corrupt or does not fit
+*	Function: decodes a block of literal runs and back references. Every length and
+*			  offset is checked, so a bad block never reads or writes out of bounds.
+*/
+
+int32_t
+lz4_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len)
+{
+	const uint8_t* ip = src;
+	const uint8_t* iend = src + src_len;
+	const uint8_t* match;
+	uint8_t* op = dst;
+	uint8_t* oend = dst + dst_len;
+	uint32_t token, len, offset;
+
+	while (ip < iend) {
+		token = *ip++;
+
+		/* Literals, copied straight from the input */
+		len = token >> 4;
+		if (lz4_length(&ip, iend, &len) == -1)
+			return -1;
+		if (len > (uint32_t)(iend - ip) || len > (uint32_t)(oend - op))
+			return -1;
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* The last sequence is literals only */
+		if (ip == iend)
+			break;
+
+		/* Match: a little endian offset back into the output, then its length */
+		if (iend - ip < 2)
+			return -1;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (uint32_t)(op - dst))
+			return -1;
+
+		len = token & LZ4_RUN_MASK;
+		if (lz4_length(&ip, iend, &len) == -1)
+			return -1;
+		len += LZ4_MIN_MATCH;
+		if (len > (uint32_t)(oend - op))
+			return -1;
+
+		/* A match may overlap the bytes it produces (a run), which has to go a byte at a time */
+		match = op - offset;
+		if (offset >= len) {
+			memcpy(op, match, len);
+			op += len;
+		} else {
+			while (len--)
+				*op++ = *match++;
+		}
+	}
+
+	return op - dst;
+}
@@ -0,0 +1,15 @@
+/* lz4.h - Decoder for LZ4 compressed blocks
+ * vim:ts=4 noexpandtab
+ */
+
+#ifndef _LZ4_H_
+#define _LZ4_H_
+
+#include "types.h"
+
+#define LZ4_MIN_MATCH 4 // a match length of 0 in a token means 4 bytes
+#define LZ4_RUN_MASK 15 // a full length nibble continues in the following bytes
+
+int32_t lz4_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len);
+
+#endif /* _LZ4_H_ */
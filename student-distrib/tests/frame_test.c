@@ -0,0 +1,398 @@
+#include "../kernel/frame.h"
+#include "../kernel/paging.h"
+#include "../kernel/tasks.h"
+#include "../kernel/swap.h"
+#include "../kernel/syscall.h"
+#include "../drivers/fs.h"
+#include "../lib/lib.h"
+#include "tests_files.h"
+
+#define SHM_TEST_KEY 0x391
+#define HEAP_TEST_FILE "shell"
+
+static uint8_t swap_test_out[SWAP_SLOT_SIZE] __attribute__((aligned(SWAP_SLOT_SIZE)));
+static uint8_t swap_test_in[SWAP_SLOT_SIZE] __attribute__((aligned(SWAP_SLOT_SIZE)));
+
+/*
+ * test_frame_alloc
+ *   DESCRIPTION: Takes two 4 KB frames, checks they are aligned, above the
+ *				  kernel and different, and that freeing them brings the
+ *				  free count back
+ *   RETURN VALUE: none
+ */
+void
+test_frame_alloc()
+{
+	uint32_t before = frame_free_count();
+	uint32_t first, second;
+	int failed = 0;
+
+	first = frame_alloc();
+	second = frame_alloc();
+	if (first == 0 || second == 0) {
+		printf("Out of memory (Failed)\n");
+		failed++;
+	}
+
+	if ((first & (FRAME_SIZE - 1)) != 0 || (second & (FRAME_SIZE - 1)) != 0 ||
+		(first != 0 && first < FRAME_RESERVED_END) || (second != 0 && second < FRAME_RESERVED_END)) {
+		printf("Frame misaligned or in the kernel (Failed)\n");
+		failed++;
+	}
+
+	if (first != 0 && first == second) {
+		printf("Same frame handed out twice (Failed)\n");
+		failed++;
+	}
+
+	if (frame_free_count() != before - (first != 0) - (second != 0)) {
+		printf("Free count wrong after allocating (Failed)\n");
+		failed++;
+	}
+
+	if (first != 0) frame_free(first);
+	if (second != 0) frame_free(second);
+	if (frame_free_count() != before) {
+		printf("Free count not restored (Failed)\n");
+		failed++;
+	}
+
+	printf("Frame allocator: %d failures, %d KB free\n", failed, before * (FRAME_SIZE / 1024));
+}
+
+/*
+ * test_paging_alloc
+ *   DESCRIPTION: Builds the address space of a spare pid and checks it took
+ *				  only a directory and the image page table (image pages come
+ *				  later, as they are touched), then that paging_free gives them
+ *				  back
+ *   RETURN VALUE: none
+ */
+void
+test_paging_alloc()
+{
+	int16_t pid = tasks_pid_new();
+	uint32_t before = frame_free_count();
+	int failed = 0;
+
+	if (pid == -1) {
+		printf("No spare pid\n");
+		return;
+	}
+
+	if (paging_allocate(pid) == -1) {
+		printf("Allocate failed (Failed)\n");
+		failed++;
+	} else if (frame_free_count() != before - 2) {
+		printf("Took %d frames, expected 2 (Failed)\n", before - frame_free_count());
+		failed++;
+	}
+
+	paging_free(pid);
+	if (frame_free_count() != before) {
+		printf("Frames not given back (Failed)\n");
+		failed++;
+	}
+	tasks_pid_free(pid);
+
+	printf("Paging allocation: %d failures\n", failed);
+}
+
+/*
+ * test_mmap_window
+ *   DESCRIPTION: Maps two runs into the mmap region of a spare pid, unmaps
+ *				  the first and checks a run that fits in the hole is placed
+ *				  there, and that a run larger than the region is refused
+ *   RETURN VALUE: none
+ */
+void
+test_mmap_window()
+{
+	int16_t pid = tasks_pid_new();
+	uint32_t first, second, again, i;
+	int failed = 0;
+
+	if (pid == -1) {
+		printf("No spare pid\n");
+		return;
+	}
+
+	if (paging_allocate(pid) == -1 || (first = paging_mmap_reserve(pid, 3)) == 0) {
+		printf("Setup failed (Failed)\n");
+		failed++;
+	} else {
+		// Any kernel page will do as the mapped data
+		for (i = 0; i < 3; i++) paging_mmap_page(pid, first + i * FOUR_KB, KERNEL_MEM_END - FOUR_MB);
+		second = paging_mmap_reserve(pid, 2);
+		for (i = 0; i < 2; i++) paging_mmap_page(pid, second + i * FOUR_KB, KERNEL_MEM_END - FOUR_MB);
+		if (second != first + 3 * FOUR_KB) {
+			printf("Second run at 0x%x overlaps (Failed)\n", second);
+			failed++;
+		}
+
+		paging_mmap_unmap(pid, first, 3);
+		again = paging_mmap_reserve(pid, 2);
+		if (again != first) {
+			printf("Freed run not reused, got 0x%x (Failed)\n", again);
+			failed++;
+		}
+
+		if (paging_mmap_reserve(pid, PAGE_SIZE) != 0) {
+			printf("Reserved past the region (Failed)\n");
+			failed++;
+		}
+	}
+
+	paging_free(pid);
+	tasks_pid_free(pid);
+
+	printf("Mmap window: %d failures\n", failed);
+}
+
+/*
+ * test_frame_ref
+ *   DESCRIPTION: Takes a frame, adds a second reference with frame_ref and
+ *				  checks it stays in use until the second frame_free, as a
+ *				  frame shared copy-on-write by fork does
+ *   RETURN VALUE: none
+ */
+void
+test_frame_ref()
+{
+	uint32_t before = frame_free_count();
+	uint32_t frame = frame_alloc();
+	int failed = 0;
+
+	if (frame == 0) {
+		printf("Out of memory (Failed)\n");
+		return;
+	}
+
+	if (frame_refs(frame) != 1 || frame_ref(frame) == -1 || frame_refs(frame) != 2) {
+		printf("Reference count wrong (Failed)\n");
+		failed++;
+	}
+
+	frame_free(frame);
+	if (frame_refs(frame) != 1 || frame_free_count() != before - 1) {
+		printf("Frame freed while still mapped (Failed)\n");
+		failed++;
+	}
+
+	frame_free(frame);
+	if (frame_refs(frame) != 0 || frame_free_count() != before) {
+		printf("Frame not given back (Failed)\n");
+		failed++;
+	}
+
+	if (frame_ref(frame) != -1) {
+		printf("Referenced a free frame (Failed)\n");
+		failed++;
+	}
+
+	printf("Frame references: %d failures\n", failed);
+}
+
+/*
+ * test_shm
+ *   DESCRIPTION: Creates a shared memory segment, attaches a spare pid to it
+ *				  twice, then checks the segment goes away with its last
+ *				  detach, that one nobody attached goes away with its
+ *				  creator, and that no frames were left behind
+ *   RETURN VALUE: none
+ */
+void
+test_shm()
+{
+	int16_t pid = tasks_pid_new();
+	int16_t other = tasks_pid_new();
+	uint32_t before = frame_free_count();
+	uint32_t virt, size = 0;
+	int failed = 0;
+
+	if (pid == -1 || other == -1) {
+		printf("No spare pid\n");
+		if (pid != -1)
+			tasks_pid_free(pid);
+		if (other != -1)
+			tasks_pid_free(other);
+		return;
+	}
+
+	if (paging_allocate(pid) == -1 || paging_allocate(other) == -1 ||
+		paging_shm_create(pid, SHM_TEST_KEY, 3 * FOUR_KB) == -1) {
+		printf("Setup failed (Failed)\n");
+		failed++;
+	} else {
+		if (paging_shm_create(pid, SHM_TEST_KEY, FOUR_KB) == -1 ||
+			paging_shm_create(pid, SHM_TEST_KEY, SHM_MAX_PAGES * FOUR_KB) != -1) {
+			printf("Existing segment not checked (Failed)\n");
+			failed++;
+		}
+
+		virt = paging_shm_attach(pid, SHM_TEST_KEY, &size);
+		if (virt < SHM_START || virt >= SHM_START + FOUR_MB || size != 3 * FOUR_KB ||
+			paging_shm_attach(pid, SHM_TEST_KEY, &size) != virt) {
+			printf("Attach at 0x%x, %d bytes (Failed)\n", virt, size);
+			failed++;
+		}
+
+		if (paging_shm_detach(pid, SHM_TEST_KEY) == -1 || paging_shm_detach(pid, SHM_TEST_KEY) != -1 ||
+			paging_shm_attach(pid, SHM_TEST_KEY, &size) != 0) {
+			printf("Segment outlived its last detach (Failed)\n");
+			failed++;
+		}
+
+		if (paging_shm_create(pid, SHM_TEST_KEY, FOUR_KB) == -1) {
+			printf("Setup failed (Failed)\n");
+			failed++;
+		}
+	}
+
+	paging_free(pid);
+	tasks_pid_free(pid);
+	if (paging_shm_attach(other, SHM_TEST_KEY, &size) != 0) {
+		printf("Unattached segment outlived its creator (Failed)\n");
+		failed++;
+	}
+
+	paging_free(other);
+	tasks_pid_free(other);
+	if (frame_free_count() != before) {
+		printf("Frames not given back (Failed)\n");
+		failed++;
+	}
+
+	printf("Shared memory: %d failures\n", failed);
+}
+
+/*
+ * test_heap_break
+ *   DESCRIPTION: Gives a spare pid the heap of a program, grows it by two
+ *				  pages and touches them, then checks breaks out of range are
+ *				  refused, pages above the break do not fault in, shrinking
+ *				  frees the page above the new break and no frames were left
+ *				  behind
+ *   RETURN VALUE: none
+ */
+void
+test_heap_break()
+{
+	int16_t pid = tasks_pid_new();
+	uint32_t before = frame_free_count();
+	uint32_t heap, grown;
+	dentry_t entry;
+	pcb_t * pcb;
+	int failed = 0;
+
+	if (pid == -1) {
+		printf("No spare pid\n");
+		return;
+	}
+
+	if (read_dentry_by_name(HEAP_TEST_FILE, &entry)) {
+		printf("%s not found\n", HEAP_TEST_FILE);
+		tasks_pid_free(pid);
+		return;
+	}
+
+	pcb = get_pcb(pid);
+	pcb->pid = pid;
+	pcb->image_inode = entry.inode_index;
+	pcb->heap_start = pcb->brk = loader_image_end(entry.inode_index);
+	heap = PAGE_ALIGN_UP(pcb->heap_start);
+
+	// Faulted pages are filled through their user address, so the spare pid's directory is loaded
+	if (paging_allocate(pid) == -1 || paging_update_control(pid) == -1) {
+		printf("Setup failed (Failed)\n");
+		failed++;
+	} else {
+		if (syscall_set_break(pcb, heap + 2 * FOUR_KB) == -1 ||
+			paging_image_fault(pid, heap, PF_WRITE) == -1 ||
+			paging_image_fault(pid, heap + FOUR_KB, PF_WRITE) == -1) {
+			printf("Heap pages not mapped after growing (Failed)\n");
+			failed++;
+		}
+
+		if (paging_image_fault(pid, heap + 2 * FOUR_KB, PF_WRITE) != -1) {
+			printf("Page above the break mapped (Failed)\n");
+			failed++;
+		}
+
+		if (syscall_set_break(pcb, USER_HEAP_END + 1) != -1 ||
+			syscall_set_break(pcb, pcb->heap_start - 1) != -1 || pcb->brk != heap + 2 * FOUR_KB) {
+			printf("Break moved out of range (Failed)\n");
+			failed++;
+		}
+
+		grown = frame_free_count();
+		if (syscall_set_break(pcb, heap + FOUR_KB) == -1 || frame_free_count() != grown + 1 ||
+			paging_image_fault(pid, heap + FOUR_KB, PF_WRITE) != -1) {
+			printf("Shrinking kept the page above the break (Failed)\n");
+			failed++;
+		}
+	}
+
+	// Frees the directory while it is loaded, which puts the boot directory back
+	paging_free(pid);
+	tasks_pid_free(pid);
+	if (frame_free_count() != before) {
+		printf("Frames not given back (Failed)\n");
+		failed++;
+	}
+
+	printf("Heap break: %d failures\n", failed);
+}
+
+/*
+ * test_swap
+ *   DESCRIPTION: Writes a page to a swap slot and reads it back, then checks
+ *				  the slot is handed out again once freed
+ *   RETURN VALUE: none
+ */
+void
+test_swap()
+{
+	uint32_t before = swap_free_slots();
+	int32_t slot;
+	int failed = 0;
+	uint32_t i;
+
+	if (before == 0) {
+		printf("No swap area\n");
+		return;
+	}
+
+	for (i = 0; i < SWAP_SLOT_SIZE; i++) {
+		swap_test_out[i] = (uint8_t) (i * 7 + 3);
+		swap_test_in[i] = 0;
+	}
+
+	slot = swap_slot_alloc();
+	if (slot == SWAP_NONE || swap_free_slots() != before - 1) {
+		printf("No slot taken (Failed)\n");
+		failed++;
+	} else {
+		if (swap_write(slot, swap_test_out) == -1 || swap_read(slot, swap_test_in) == -1) {
+			printf("Disk error on slot %d (Failed)\n", slot);
+			failed++;
+		}
+
+		for (i = 0; i < SWAP_SLOT_SIZE; i++) {
+			if (swap_test_in[i] != swap_test_out[i]) {
+				printf("Page not read back from slot %d (Failed)\n", slot);
+				failed++;
+				break;
+			}
+		}
+
+		swap_slot_free(slot);
+		if (swap_free_slots() != before || swap_slot_alloc() != slot) {
+			printf("Slot not given back (Failed)\n");
+			failed++;
+		}
+		swap_slot_free(slot);
+	}
+
+	printf("Swap: %d failures\n", failed);
+}
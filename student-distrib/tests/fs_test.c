@@ -1,7 +1,25 @@
 #include "../drivers/fs.h"
 #include "../lib/lib.h"
+#include "../drivers/pit.h"
+#include "../drivers/bcache.h"
+#include "../lib/lz4.h"
 #include "tests_files.h"
 
+#define BENCH_FILE "verylargetxtwithverylongname.tx" // the image keeps 31 bytes of the name
+#define BENCH_TICKS (2 * PIT_TICKS_PER_SEC)
+#define BENCH_BUF_SIZE 8192
+#define ONE_KB 0x400
+#define WRITE_TEST_FILE "write_test.txt"
+#define WRITE_TEST_LEN (FOUR_KB + 100) // written at offset 1, so spans two partial blocks
+#define SYNC_TEST_FILE "sync_test.txt"
+#define INDIRECT_TEST_FILE "indirect_test.txt"
+#define INDIRECT_TEST_LEN 100
+#define DIR_TEST_DIR "dir_test"
+#define DIR_TEST_FILE "dir_test/inner/file"
+
+static uint8_t bench_buf[BENCH_BUF_SIZE];
+static uint8_t dma_buf[FOUR_KB] __attribute__((aligned(FOUR_KB)));
+
 void 
 test_file()
 {
@@ -54,3 +72,502 @@ test_non_existant_file()
 	printf("File Exists (Failed)");
 	return;
 }
+
+void
+test_dentry_lookup()
+{
+	dentry_t by_index, by_name;
+	int8_t name[FILENAME_LEN + 1];
+	int i, failed = 0;
+
+	// Every dentry must be found again through the name index
+	for (i = 0; read_dentry_by_index(i, &by_index) == 0; i++) {
+		memcpy(name, by_index.filename, FILENAME_LEN);
+		name[FILENAME_LEN] = '\0';
+
+		if (read_dentry_by_name(name, &by_name) || by_name.inode_index != by_index.inode_index) {
+			printf("Lookup failed: %s\n", name);
+			failed++;
+		}
+	}
+
+	// One byte too long for any dentry
+	if (read_dentry_by_name("verylargetxtwithverylongname.txt!", &by_name) == 0) {
+		printf("Over-long name matched (Failed)\n");
+		failed++;
+	}
+
+	printf("Dentry lookup: %d entries, %d failures\n", i, failed);
+}
+
+/*
+ * test_fs_write
+ *   DESCRIPTION: Creates a file, writes a pattern across several blocks,
+ *				  reads it back, then truncates and grows it again
+ *   RETURN VALUE: none
+ */
+void
+test_fs_write()
+{
+	dentry_t entry;
+	uint32_t i;
+	int32_t inode;
+	int failed = 0;
+
+	inode = fs_create(WRITE_TEST_FILE);
+	if (inode == -1 || read_dentry_by_name(WRITE_TEST_FILE, &entry) || entry.inode_index != inode) {
+		printf("Create failed\n");
+		return;
+	}
+
+	if (fs_create(WRITE_TEST_FILE) != -1) {
+		printf("Duplicate name created (Failed)\n");
+		failed++;
+	}
+
+	for (i = 0; i < WRITE_TEST_LEN; i++)
+		bench_buf[i] = i % 251;
+
+	// Start one byte in so the first block is partial
+	if (write_data(inode, 1, bench_buf, WRITE_TEST_LEN) != WRITE_TEST_LEN) {
+		printf("Write failed\n");
+		failed++;
+	}
+
+	memset(bench_buf, 0xFF, BENCH_BUF_SIZE);
+	if (read_data(inode, 0, bench_buf, BENCH_BUF_SIZE) != WRITE_TEST_LEN + 1 || bench_buf[0] != 0) {
+		printf("Read back wrong length or gap (Failed)\n");
+		failed++;
+	}
+	for (i = 0; i < WRITE_TEST_LEN; i++) {
+		if (bench_buf[i + 1] != i % 251) {
+			printf("Byte %d differs (Failed)\n", i + 1);
+			failed++;
+			break;
+		}
+	}
+
+	// Shrink into the first block, then grow: the cut off bytes must read back as zeros
+	fs_truncate(inode, 10);
+	fs_truncate(inode, FOUR_KB);
+	read_data(inode, 0, bench_buf, FOUR_KB);
+	for (i = 10; i < FOUR_KB; i++) {
+		if (bench_buf[i] != 0) {
+			printf("Stale byte %d after truncate (Failed)\n", i);
+			failed++;
+			break;
+		}
+	}
+
+	// Blocks an mmap still maps must not be freed
+	fs_mmap_hold(inode);
+	if (fs_truncate(inode, 0) != -1) {
+		printf("Truncated a mapped file (Failed)\n");
+		failed++;
+	}
+	fs_mmap_drop(inode);
+
+	fs_truncate(inode, 0);
+	printf("File write: %d failures\n", failed);
+}
+
+/*
+ * test_bcache
+ *   DESCRIPTION: When the file system is on disk, checks that block 0 read
+ *				  through the buffer cache matches the mounted boot block and
+ *				  that a second lookup hits the same buffer
+ *   RETURN VALUE: none
+ */
+void
+test_bcache()
+{
+	boot_block_t *cached;
+	uint8_t *first, *second;
+	int failed = 0;
+
+	if (ata_sectors() == 0) {
+		printf("No ATA disk\n");
+		return;
+	}
+
+	first = bcache_get(0);
+	second = bcache_get(0);
+	if (first == NULL || first != second) {
+		printf("Second lookup missed the cache (Failed)\n");
+		failed++;
+	}
+
+	cached = (boot_block_t *) first;
+	if (first != NULL && (cached->dir_entry_num != fs_get_boot_block()->dir_entry_num ||
+		cached->inode_num != fs_get_boot_block()->inode_num)) {
+		printf("Block 0 is not the boot block (Failed)\n");
+		failed++;
+	}
+
+	bcache_put(first);
+	bcache_put(second);
+	printf("Buffer cache: %d failures\n", failed);
+}
+
+/*
+ * test_fs_sync
+ *   DESCRIPTION: When the file system is on disk, writes a block of a file,
+ *				  fsyncs it and reads the inode and the block straight from
+ *				  the disk to check both were written
+ *   RETURN VALUE: none
+ */
+void
+test_fs_sync()
+{
+	boot_block_t *boot_block = fs_get_boot_block();
+	inode_t *disk_inode = (inode_t *) dma_buf;
+	dentry_t entry;
+	int32_t inode;
+	uint32_t i, block, failed = 0;
+
+	if (ata_sectors() == 0) {
+		printf("No ATA disk\n");
+		return;
+	}
+
+	inode = read_dentry_by_name(SYNC_TEST_FILE, &entry) == 0 ? entry.inode_index : fs_create(SYNC_TEST_FILE);
+	for (i = 0; i < FOUR_KB; i++)
+		bench_buf[i] = i % 253;
+
+	if (inode == -1 || write_data(inode, 0, bench_buf, FOUR_KB) != FOUR_KB || fs_fsync(inode) == -1) {
+		printf("Write or fsync failed (Failed)\n");
+		return;
+	}
+
+	if (ata_read((1 + inode) * BCACHE_SECTORS, BCACHE_SECTORS, dma_buf) == -1 || disk_inode->length < FOUR_KB) {
+		printf("Inode not on disk (Failed)\n");
+		failed++;
+	}
+
+	block = 1 + boot_block->inode_num + ((inode_t *) (boot_block + 1))[inode].data[0];
+	if (ata_read(block * BCACHE_SECTORS, BCACHE_SECTORS, dma_buf) == -1) {
+		printf("Data block read failed (Failed)\n");
+		return;
+	}
+	for (i = 0; i < FOUR_KB; i++) {
+		if (dma_buf[i] != i % 253) {
+			printf("Byte %d not on disk (Failed)\n", i);
+			failed++;
+			break;
+		}
+	}
+
+	printf("fsync: %d failures\n", failed);
+}
+
+/*
+ * test_fs_indirect
+ *   DESCRIPTION: On an image with indirect blocks, writes just past the
+ *				  first block of the double indirect range, so every kind of
+ *				  table is needed, reads it back and truncates the file away
+ *   RETURN VALUE: none
+ */
+void
+test_fs_indirect()
+{
+	uint32_t i, offset = (INODE_DIRECT_BLOCKS + BLOCK_POINTERS) * FOUR_KB + 1;
+	int32_t inode;
+	int failed = 0;
+
+	if (fs_get_boot_block()->version != FS_VERSION_INDIRECT) {
+		printf("No indirect blocks in this image\n");
+		return;
+	}
+
+	inode = fs_create(INDIRECT_TEST_FILE);
+	for (i = 0; i < INDIRECT_TEST_LEN; i++)
+		bench_buf[i] = i + 1;
+
+	if (inode == -1 || write_data(inode, offset, bench_buf, INDIRECT_TEST_LEN) != INDIRECT_TEST_LEN) {
+		printf("Write past the direct blocks failed\n");
+		return;
+	}
+
+	memset(bench_buf, 0, INDIRECT_TEST_LEN);
+	if (read_data(inode, offset, bench_buf, BENCH_BUF_SIZE) != INDIRECT_TEST_LEN) {
+		printf("Read back wrong length (Failed)\n");
+		failed++;
+	}
+	for (i = 0; i < INDIRECT_TEST_LEN; i++) {
+		if (bench_buf[i] != i + 1) {
+			printf("Byte %d differs (Failed)\n", i);
+			failed++;
+			break;
+		}
+	}
+
+	// The gap before the write reads as zeros, in the single indirect range too
+	read_data(inode, INODE_DIRECT_BLOCKS * FOUR_KB, bench_buf, FOUR_KB);
+	for (i = 0; i < FOUR_KB; i++) {
+		if (bench_buf[i] != 0) {
+			printf("Gap not zero (Failed)\n");
+			failed++;
+			break;
+		}
+	}
+
+	if (fs_truncate(inode, 0) == -1) {
+		printf("Truncate failed (Failed)\n");
+		failed++;
+	}
+
+	printf("Indirect blocks: %d failures\n", failed);
+}
+
+/*
+ * test_fs_dirs
+ *   DESCRIPTION: Makes a directory with one inside it, creates a file at the
+ *				  bottom and finds it again through paths with extra slashes,
+ *				  "." and "..", then checks names that must not resolve
+ *   RETURN VALUE: none
+ */
+void
+test_fs_dirs()
+{
+	dentry_t entry;
+	int32_t inode;
+	int failed = 0;
+
+	// Left over from an earlier run on a disk image is fine
+	fs_mkdir(DIR_TEST_DIR);
+	fs_mkdir(DIR_TEST_DIR "/inner");
+	if (read_dentry_by_name(DIR_TEST_FILE, &entry) == 0) {
+		inode = entry.inode_index;
+	} else if ((inode = fs_create(DIR_TEST_FILE)) == -1) {
+		printf("Create in a subdirectory failed\n");
+		return;
+	}
+
+	if (write_data(inode, 0, (uint8_t *) "dirs", 4) != 4) {
+		printf("Write failed (Failed)\n");
+		failed++;
+	}
+
+	if (read_dentry_by_name("/" DIR_TEST_DIR "//./inner/../inner/file", &entry) || entry.inode_index != inode) {
+		printf("Path with dots not resolved (Failed)\n");
+		failed++;
+	}
+
+	if (read_dentry_by_name(DIR_TEST_DIR "/inner", &entry) || entry.filetype != DIRECTORY_TYPE) {
+		printf("Subdirectory entry wrong (Failed)\n");
+		failed++;
+	}
+
+	if (read_dentry_by_name("..", &entry) || entry.inode_index != FS_ROOT_DIR) {
+		printf(".. at the root did not stay there (Failed)\n");
+		failed++;
+	}
+
+	if (read_dentry_by_name(DIR_TEST_FILE "/more", &entry) == 0 ||
+		read_dentry_by_name(DIR_TEST_DIR "/missing/file", &entry) == 0) {
+		printf("Bad path resolved (Failed)\n");
+		failed++;
+	}
+
+	if (fs_mkdir(DIR_TEST_DIR) != -1 || fs_create(DIR_TEST_DIR "/..") != -1) {
+		printf("Existing name created again (Failed)\n");
+		failed++;
+	}
+
+	printf("Directories: %d failures\n", failed);
+}
+
+/*
+ * test_fs_map
+ *   DESCRIPTION: Checks that the region fsmap hands to user level starts at a
+ *				  page aligned boot block and holds every data block of a file,
+ *				  which is how the user library finds them
+ *   RETURN VALUE: none
+ */
+void
+test_fs_map()
+{
+	uint32_t image = (uint32_t) fs_get_boot_block();
+	uint32_t length = fs_image_length();
+	uint32_t block, addr;
+	dentry_t dentry;
+	int failed = 0;
+
+	if (length == 0) {
+		printf("File system is on disk, nothing to map\n");
+		return;
+	}
+
+	if ((image & (FOUR_KB - 1)) != 0 || length % FOUR_KB != 0) {
+		printf("Image not page aligned (Failed)\n");
+		failed++;
+	}
+
+	if (read_dentry_by_name(BENCH_FILE, &dentry) == 0) {
+		for (block = 0; (addr = (uint32_t) fs_data_block(dentry.inode_index, block)) != 0; block++) {
+			if (addr < image + (1 + fs_get_boot_block()->inode_num) * FOUR_KB || addr + FOUR_KB > image + length) {
+				printf("Block %d outside the image (Failed)\n", block);
+				failed++;
+				break;
+			}
+		}
+	}
+
+	printf("File system map: %d bytes, %d failures\n", length, failed);
+}
+
+/*
+ * test_lz4
+ *   DESCRIPTION: Decodes a small block with an overlapping match, checks a
+ *				  cut off block is refused, and that a compressed file in the
+ *				  image (createfs -z) cannot be written
+ *   RETURN VALUE: none
+ */
+void
+test_lz4()
+{
+	// 3 literals and a 9 byte match 3 back, then the final literal
+	static const uint8_t block[] = { 0x35, 'a', 'b', 'c', 3, 0, 0x10, '!' };
+	static const int8_t expect[] = "abcabcabcabc!";
+	boot_block_t * boot_block = fs_get_boot_block();
+	dentry_t dentry;
+	int failed = 0;
+
+	memset(bench_buf, 0, sizeof(expect));
+	if (lz4_decompress(block, sizeof(block), bench_buf, BENCH_BUF_SIZE) != sizeof(expect) - 1 ||
+		strncmp((int8_t *) bench_buf, expect, sizeof(expect)) != 0) {
+		printf("Decoded wrong (Failed)\n");
+		failed++;
+	}
+
+	if (lz4_decompress(block, sizeof(block) - 3, bench_buf, BENCH_BUF_SIZE) != -1) {
+		printf("Cut off block accepted (Failed)\n");
+		failed++;
+	}
+
+	if (lz4_decompress(block, sizeof(block), bench_buf, 8) != -1) {
+		printf("Output overrun accepted (Failed)\n");
+		failed++;
+	}
+
+	if (read_dentry_by_name(BENCH_FILE, &dentry) == 0 && dentry.inode_index < FS_MAX_INODES &&
+		(boot_block->compressed[dentry.inode_index / BITS_PER_WORD] & (1 << (dentry.inode_index % BITS_PER_WORD))) &&
+		write_data(dentry.inode_index, 0, block, sizeof(block)) != -1) {
+		printf("Compressed file written (Failed)\n");
+		failed++;
+	}
+
+	printf("LZ4: %d failures\n", failed);
+}
+
+/*
+ * test_ata_dma
+ *   DESCRIPTION: Reads the first disk block twice, once into an aligned
+ *				  buffer (DMA when it is on and a task is running) and once at an odd address
+ *				  (always PIO), and checks the two agree
+ *   RETURN VALUE: none
+ */
+void
+test_ata_dma()
+{
+	uint32_t i, failed = 0;
+
+	if (ata_sectors() == 0) {
+		printf("No ATA disk\n");
+		return;
+	}
+
+	if (ata_read(0, FOUR_KB / ATA_SECTOR_SIZE, dma_buf) == -1 ||
+		ata_read(0, FOUR_KB / ATA_SECTOR_SIZE, bench_buf + 1) == -1) {
+		printf("ATA read failed (Failed)\n");
+		return;
+	}
+
+	for (i = 0; i < FOUR_KB; i++) {
+		if (dma_buf[i] != bench_buf[i + 1]) failed++;
+	}
+
+	printf("ATA DMA: %d bytes differ from PIO\n", failed);
+}
+
+/*
+ * read_data_bytewise
+ *   DESCRIPTION: The original one-byte-per-iteration read_data loop, kept
+ *				  only as the baseline for test_read_data_bench
+ *   RETURN VALUE: # of bytes copied
+ */
+static int32_t
+read_data_bytewise(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length)
+{
+	boot_block_t *boot_block = fs_get_boot_block();
+	uint32_t data_block_addr, file_length, i, bytes_in_block_read;
+	inode_t *inode_addr;
+	data_block_t *current_block;
+
+	inode_addr = (inode_t *) (((uint32_t) boot_block) + (inode + 1) * FOUR_KB);
+	data_block_addr = ((uint32_t) boot_block) + (((boot_block->inode_num) + 1) * FOUR_KB);
+
+	file_length = inode_addr->length;
+	current_block = (data_block_t *) (data_block_addr + (inode_addr->data[offset/FOUR_KB] * FOUR_KB));
+
+	bytes_in_block_read = 0;
+
+	if (offset > file_length) return 0;
+
+	for (i = 0; i < length; i++) {
+		buf[i] = current_block->byte[offset % FOUR_KB];
+
+		if (++offset % FOUR_KB == 0) {
+			current_block = (data_block_t *) (data_block_addr + (inode_addr->data[offset/FOUR_KB] * FOUR_KB));
+		}
+		
+		if (offset > file_length) break;
+
+		bytes_in_block_read++;
+	}
+
+	return bytes_in_block_read;
+}
+
+/*
+ * bench_one
+ *   DESCRIPTION: Reads the whole file over and over for BENCH_TICKS PIT ticks
+ *				  and prints the throughput. Needs the PIT running.
+ *   RETURN VALUE: none
+ */
+static void
+bench_one(char *label, int32_t (*reader)(uint32_t, uint32_t, uint8_t*, uint32_t), uint32_t inode)
+{
+	uint32_t start, end, bytes = 0, kb = 0, kb_per_sec;
+
+	// Line up with a tick edge so the first interval is a full one
+	start = pit_get_ticks();
+	while (pit_get_ticks() == start);
+	start = pit_get_ticks();
+	end = start + BENCH_TICKS;
+
+	// Fold whole KBs out as we go; a byte count wraps in well under BENCH_TICKS
+	while (pit_get_ticks() < end) {
+		bytes += reader(inode, 0, bench_buf, BENCH_BUF_SIZE);
+		kb += bytes / ONE_KB;
+		bytes %= ONE_KB;
+	}
+
+	kb_per_sec = kb / BENCH_TICKS * PIT_TICKS_PER_SEC;
+	printf("%s: %d MB/s (%d KB/s)\n", label, kb_per_sec / ONE_KB, kb_per_sec);
+}
+
+void
+test_read_data_bench()
+{
+	dentry_t entry;
+
+	if (read_dentry_by_name(BENCH_FILE, &entry)) {
+		printf("%s not found\n", BENCH_FILE);
+		return;
+	}
+
+	printf("read_data throughput on %s\n", BENCH_FILE);
+	bench_one("before (byte loop)", read_data_bytewise, entry.inode_index);
+	bench_one("after (block memcpy)", read_data, entry.inode_index);
+}
@@ -0,0 +1,90 @@
+#include "../drivers/fs.h"
+#include "../kernel/image_cache.h"
+#include "../lib/lib.h"
+#include "tests_files.h"
+
+#define CACHE_TEST_FILE "shell"
+#define CACHE_TEST_PAGE (USER_PROGRAM_VIRTUAL_START + USER_PROGRAM_OFFSET)
+
+static uint8_t cache_test_buf[FOUR_KB];
+
+/*
+ * test_image_cache
+ *   DESCRIPTION: Checks that two lookups of a program page share one frame,
+ *				  that the frame holds the file's bytes, and that invalidating
+ *				  the file stops new lookups from reusing the old frame
+ *   RETURN VALUE: none
+ */
+void
+test_image_cache()
+{
+	dentry_t entry;
+	uint32_t first, second, reloaded, i;
+	int failed = 0;
+
+	if (read_dentry_by_name(CACHE_TEST_FILE, &entry)) {
+		printf("%s not found\n", CACHE_TEST_FILE);
+		return;
+	}
+
+	first = image_cache_get(entry.inode_index, CACHE_TEST_PAGE);
+	second = image_cache_get(entry.inode_index, CACHE_TEST_PAGE);
+	if (first == 0 || first != second) {
+		printf("Second lookup missed the cache (Failed)\n");
+		failed++;
+	}
+
+	loader_page_in(entry.inode_index, CACHE_TEST_PAGE, cache_test_buf);
+	for (i = 0; first != 0 && i < FOUR_KB; i++) {
+		if (cache_test_buf[i] != ((uint8_t *) first)[i]) {
+			printf("Cached page differs from the file (Failed)\n");
+			failed++;
+			break;
+		}
+	}
+
+	// Still mapped twice, so the old frame must survive until both puts
+	image_cache_invalidate(entry.inode_index);
+	reloaded = image_cache_get(entry.inode_index, CACHE_TEST_PAGE);
+	if (reloaded == 0 || reloaded == first) {
+		printf("Invalidated page was reused (Failed)\n");
+		failed++;
+	}
+
+	image_cache_put(first);
+	image_cache_put(second);
+	image_cache_put(reloaded);
+
+	printf("Image cache: %d failures\n", failed);
+}
+
+/*
+ * test_loader_image_end
+ *   DESCRIPTION: Checks that the heap of a program would start past every
+ *				  byte of its file and inside the program page
+ *   RETURN VALUE: none
+ */
+void
+test_loader_image_end()
+{
+	dentry_t entry;
+	uint32_t end;
+	uint8_t byte;
+	int failed = 0;
+
+	if (read_dentry_by_name(CACHE_TEST_FILE, &entry)) {
+		printf("%s not found\n", CACHE_TEST_FILE);
+		return;
+	}
+
+	end = loader_image_end(entry.inode_index);
+	if (end <= CACHE_TEST_PAGE || end > USER_PROGRAM_VIRTUAL_START + FOUR_MB) {
+		printf("Image end 0x%x outside the program page (Failed)\n", end);
+		failed++;
+	} else if (read_data(entry.inode_index, end - CACHE_TEST_PAGE, &byte, 1) > 0) {
+		printf("File goes on past the image end (Failed)\n");
+		failed++;
+	}
+
+	printf("Loader image end: %d failures\n", failed);
+}
@@ -4,6 +4,25 @@
 extern void test_ls();
 extern void test_file();
 extern void test_non_existant_file();
+extern void test_dentry_lookup();
+extern void test_read_data_bench();
+extern void test_fs_write();
+extern void test_bcache();
+extern void test_ata_dma();
+extern void test_fs_sync();
+extern void test_fs_indirect();
+extern void test_lz4();
+extern void test_fs_dirs();
+extern void test_fs_map();
+extern void test_image_cache();
+extern void test_loader_image_end();
+extern void test_frame_alloc();
+extern void test_paging_alloc();
+extern void test_mmap_window();
+extern void test_frame_ref();
+extern void test_shm();
+extern void test_heap_break();
+extern void test_swap();
 extern void test_rtc();
 
 #endif
@@ -7,17 +7,45 @@ int main ()
 {
     int32_t fd, cnt;
     uint8_t buf[1024];
+    uint8_t* map;
+    const uint8_t* data;
+    ece391_fsfile_t file;
+    uint32_t block, left;
 
     if (0 != ece391_getargs (buf, 1024)) {
         ece391_fdputs (1, (uint8_t*)"could not read arguments\n");
 	return 3;
     }
 
+    /* Files in the mapped image are written out block by block with no
+       open or read calls */
+    if (0 == ece391_fs_open (buf, &file)) {
+        left = file.length;
+        for (block = 0; 0 != left; block++) {
+            if (0 == (data = ece391_fs_block (&file, block))) {
+                ece391_fdputs (1, (uint8_t*)"file read failed\n");
+                return 3;
+            }
+            cnt = left < ECE391_FS_BLOCK ? left : ECE391_FS_BLOCK;
+            if (-1 == ece391_write (1, data, cnt))
+                return 3;
+            left -= cnt;
+        }
+        return 0;
+    }
+
     if (-1 == (fd = ece391_open (buf))) {
         ece391_fdputs (1, (uint8_t*)"file not found\n");
 	return 2;
     }
 
+    /* Regular files can be written straight out of a read-only mapping */
+    if (-1 != (cnt = ece391_mmap (fd, &map))) {
+        if (0 != cnt && -1 == ece391_write (1, map, cnt))
+            return 3;
+        return 0;
+    }
+
     while (0 != (cnt = ece391_read (fd, buf, 1024))) {
         if (-1 == cnt) {
     	    ece391_fdputs (1, (uint8_t*)"file read failed\n");
@@ -0,0 +1,192 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+/*
+ * Reads files straight out of the image mapped by ece391_fsmap. This keeps
+ * the mapping in per-process variables, so unlike the rest of the support
+ * library it is linked into each program rather than the shared runtime.
+ */
+
+/* Layout of the file system image, as kept by the kernel in drivers/fs.h */
+#define FS_BLOCK_SIZE 4096
+#define FS_NAME_LEN 32
+#define FS_MAX_DENTRIES 63
+#define FS_MAX_DEPTH 16
+#define FS_DENTRY_SIZE 64
+#define FS_TYPE_DIR 1
+#define FS_TYPE_FILE 2
+#define FS_VERSION_INDIRECT 2
+#define FS_INODE_BLOCKS 1023
+#define FS_DIRECT_BLOCKS 1021
+#define FS_POINTERS (FS_BLOCK_SIZE / 4)
+#define FS_MAX_INODES 256 /* inodes with a bit in fs_boot_t.compressed */
+#define FS_ROOT 0xFFFFFFFF
+#define FS_NO_BLOCK 0xFFFFFFFF
+
+typedef struct {
+    uint32_t dir_entry_num;
+    uint32_t inode_num;
+    uint32_t data_block_num;
+    uint32_t version;
+    uint32_t compressed[8];
+    uint8_t reserved[16];
+} fs_boot_t;
+
+typedef struct {
+    uint8_t name[FS_NAME_LEN];
+    uint32_t type;
+    uint32_t inode;
+    uint8_t reserved[24];
+} fs_dentry_t;
+
+typedef struct {
+    uint32_t length;
+    uint32_t data[FS_INODE_BLOCKS];
+} fs_inode_t;
+
+/* The image, mapped by the first ece391_fs_open; fs_len is -1 if that failed */
+static const uint8_t* fs_image;
+static int32_t fs_len;
+
+/* Data block by number, 0 if it lies outside the mapping */
+static const uint8_t* fs_data(uint32_t block)
+{
+    const fs_boot_t* boot = (const fs_boot_t*)fs_image;
+    uint32_t first = 1 + boot->inode_num;
+
+    if ((uint32_t)fs_len / FS_BLOCK_SIZE <= first ||
+        block >= (uint32_t)fs_len / FS_BLOCK_SIZE - first)
+        return 0;
+    return fs_image + (first + block) * FS_BLOCK_SIZE;
+}
+
+/* Data block number of one block of a file, going through the indirect
+   tables of version 2 images */
+static uint32_t fs_bmap(uint32_t inode, uint32_t block)
+{
+    const fs_boot_t* boot = (const fs_boot_t*)fs_image;
+    const fs_inode_t* in = (const fs_inode_t*)(fs_image + (1 + inode) * FS_BLOCK_SIZE);
+    const uint32_t* table;
+
+    if (boot->version != FS_VERSION_INDIRECT)
+        return block < FS_INODE_BLOCKS ? in->data[block] : FS_NO_BLOCK;
+    if (block < FS_DIRECT_BLOCKS)
+        return in->data[block];
+
+    block -= FS_DIRECT_BLOCKS;
+    if (block < FS_POINTERS) {
+        table = (const uint32_t*)fs_data(in->data[FS_DIRECT_BLOCKS]);
+    } else {
+        block -= FS_POINTERS;
+        if (block / FS_POINTERS >= FS_POINTERS)
+            return FS_NO_BLOCK;
+        table = (const uint32_t*)fs_data(in->data[FS_DIRECT_BLOCKS + 1]);
+        if (0 == table)
+            return FS_NO_BLOCK;
+        table = (const uint32_t*)fs_data(table[block / FS_POINTERS]);
+        block %= FS_POINTERS;
+    }
+    return 0 == table ? FS_NO_BLOCK : table[block];
+}
+
+/* Finds the entry called name (len bytes) in a directory */
+static const fs_dentry_t* fs_lookup(uint32_t dir, const uint8_t* name, uint32_t len)
+{
+    const fs_boot_t* boot = (const fs_boot_t*)fs_image;
+    const fs_dentry_t* ent;
+    const uint8_t* block = 0;
+    uint32_t i, count;
+
+    if (FS_ROOT == dir) {
+        count = boot->dir_entry_num;
+        if (count > FS_MAX_DENTRIES)
+            count = FS_MAX_DENTRIES;
+    } else {
+        count = ((const fs_inode_t*)(fs_image + (1 + dir) * FS_BLOCK_SIZE))->length / FS_DENTRY_SIZE;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (FS_ROOT == dir) {
+            ent = (const fs_dentry_t*)(boot + 1) + i;
+        } else {
+            /* Entries never straddle blocks, so one lookup serves a whole block */
+            if (0 == i % (FS_BLOCK_SIZE / FS_DENTRY_SIZE) &&
+                0 == (block = fs_data(fs_bmap(dir, i / (FS_BLOCK_SIZE / FS_DENTRY_SIZE)))))
+                return 0;
+            ent = (const fs_dentry_t*)block + i % (FS_BLOCK_SIZE / FS_DENTRY_SIZE);
+        }
+        if (0 == ece391_strncmp(ent->name, name, len) &&
+            (FS_NAME_LEN == len || '\0' == ent->name[len]))
+            return ent;
+    }
+    return 0;
+}
+
+/* Opens a regular file by walking the mapped image the way the kernel walks
+   paths; nothing but the first call makes a system call */
+int32_t ece391_fs_open(const uint8_t* path, ece391_fsfile_t* file)
+{
+    const fs_boot_t* boot;
+    const fs_dentry_t* ent = 0;
+    uint32_t parents[FS_MAX_DEPTH];
+    uint32_t depth = 0, dir = FS_ROOT, len;
+    const uint8_t* next;
+    uint8_t* image;
+
+    if (0 == fs_image && 0 == fs_len) {
+        fs_len = ece391_fsmap(&image);
+        fs_image = image;
+    }
+    if (-1 == fs_len)
+        return -1;
+    boot = (const fs_boot_t*)fs_image;
+
+    while (1) {
+        while ('/' == *path)
+            path++;
+        if ('\0' == *path)
+            break;
+        for (len = 0; '\0' != path[len] && '/' != path[len]; len++);
+        if (len > FS_NAME_LEN)
+            return -1;
+
+        if (1 == len && '.' == path[0]) {
+            ent = 0;
+        } else if (2 == len && '.' == path[0] && '.' == path[1]) {
+            if (0 != depth)
+                dir = parents[--depth];
+            ent = 0;
+        } else {
+            if (0 == (ent = fs_lookup(dir, path, len)))
+                return -1;
+            for (next = path + len; '/' == *next; next++);
+            if ('\0' == *next)
+                break;
+            /* Only a directory can have more of the path after it */
+            if (FS_TYPE_DIR != ent->type || ent->inode >= boot->inode_num ||
+                FS_MAX_DEPTH == depth)
+                return -1;
+            parents[depth++] = dir;
+            dir = ent->inode;
+        }
+        path += len;
+    }
+
+    /* Compressed files have to be read through the kernel */
+    if (0 == ent || FS_TYPE_FILE != ent->type || ent->inode >= boot->inode_num ||
+        (ent->inode < FS_MAX_INODES && (boot->compressed[ent->inode / 32] & (1 << (ent->inode % 32)))))
+        return -1;
+
+    file->inode = ent->inode;
+    file->length = ((const fs_inode_t*)(fs_image + (1 + ent->inode) * FS_BLOCK_SIZE))->length;
+    return 0;
+}
+
+const uint8_t* ece391_fs_block(const ece391_fsfile_t* file, uint32_t block)
+{
+    if (block >= (file->length + FS_BLOCK_SIZE - 1) / FS_BLOCK_SIZE)
+        return 0;
+    return fs_data(fs_bmap(file->inode, block));
+}
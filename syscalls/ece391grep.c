@@ -4,21 +4,107 @@
 #include "ece391syscall.h"
 
 #define BUFSIZE 1024
-#define SBUFSIZE 33
+#define DBUFSIZE 1024
+#define PATHSIZE 128
+
+/* Search one line of len bytes; it is written out in place since it may
+   sit in a read-only mapping and cannot be NUL terminated */
+void
+do_one_line (const char* s, const char* fname, const uint8_t* line, int32_t len)
+{
+    int32_t check, s_len;
+
+    s_len = ece391_strlen ((uint8_t*)s);
+    for (check = 0; check + s_len <= len; check++) {
+	if (s[0] == line[check] && 
+	    0 == ece391_strncmp (line + check, (uint8_t*)s, s_len)) {
+	    ece391_fdputs (1, (uint8_t*)fname);
+	    ece391_fdputs (1, (uint8_t*)":");
+	    ece391_write (1, line, len);
+	    ece391_fdputs (1, (uint8_t*)"\n");
+	    break;
+	}
+    }
+}
+
+/* Scan a file mapped with ece391_mmap */
+void
+do_one_mapping (const char* s, const char* fname, const uint8_t* map, int32_t len)
+{
+    int32_t line_start, line_end;
+
+    for (line_start = 0; line_start < len; line_start = line_end + 1) {
+	line_end = line_start;
+	while (line_end < len && '\n' != map[line_end])
+	    line_end++;
+	do_one_line (s, fname, map + line_start, line_end - line_start);
+    }
+}
+
+/* Scan a file straight out of the image mapped with ece391_fsmap. Its
+   blocks are not contiguous, so a line running from one block into the
+   next is gathered into a buffer (cut at BUFSIZE bytes, as when reading) */
+int32_t
+do_one_image (const char* s, const char* fname, const ece391_fsfile_t* file)
+{
+    uint8_t line[BUFSIZE];
+    const uint8_t* data;
+    uint32_t block, left;
+    int32_t len, line_start, line_end, kept, i;
+
+    kept = 0;
+    left = file->length;
+    for (block = 0; 0 != left; block++) {
+        if (0 == (data = ece391_fs_block (file, block)))
+	    return -1;
+	len = left < ECE391_FS_BLOCK ? left : ECE391_FS_BLOCK;
+	left -= len;
+	for (line_start = 0; line_start < len; line_start = line_end + 1) {
+	    line_end = line_start;
+	    while (line_end < len && '\n' != data[line_end])
+		line_end++;
+	    if (0 == kept && (line_end < len || 0 == left)) {
+		do_one_line (s, fname, data + line_start, line_end - line_start);
+		continue;
+	    }
+	    for (i = line_start; i < line_end && kept < BUFSIZE; i++)
+		line[kept++] = data[i];
+	    if (line_end < len || 0 == left) {
+		do_one_line (s, fname, line, kept);
+		kept = 0;
+	    }
+	}
+    }
+    return 0;
+}
 
 int32_t
 do_one_file (const char* s, const char* fname) 
 {
     int32_t fd, cnt, last, line_start, line_end, check, s_len;
     uint8_t data[BUFSIZE+1];
+    uint8_t* map;
+    ece391_fsfile_t file;
+
+    /* Files in the mapped image are scanned without any system calls */
+    if (0 == ece391_fs_open ((uint8_t*)fname, &file)) {
+        if (0 == do_one_image (s, fname, &file))
+	    return 0;
+	ece391_fdputs (1, (uint8_t*)"file read failed\n");
+	return -1;
+    }
 
     s_len = ece391_strlen ((uint8_t*)s);
     if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
         ece391_fdputs (1, (uint8_t*)"file open failed\n");
         return -1;
     }
+    /* Fall back to reading when the file cannot be mapped */
+    map = 0;
+    if (-1 != (cnt = ece391_mmap (fd, &map)))
+	do_one_mapping (s, fname, map, cnt);
     last = 0;
-    while (1) {
+    while (0 == map) {
         cnt = ece391_read (fd, data + last, BUFSIZE - last);
 	if (-1 == cnt) {
             ece391_fdputs (1, (uint8_t*)"file read failed\n");
@@ -65,32 +151,74 @@ do_one_file (const char* s, const char* fname)
     return 0;
 }
 
+/* Opens the directory named after the last space of the arguments, cutting it
+   off the search string. Without one (or if that word is not a directory) the
+   whole argument is the search string and the root is searched. */
+int32_t
+open_dir (uint8_t* search, uint8_t* dir)
+{
+    int32_t fd, i, last_space = -1;
+    uint8_t buf[DBUFSIZE];
+
+    for (i = 0; '\0' != search[i]; i++)
+        if (' ' == search[i])
+	    last_space = i;
+
+    if (-1 != last_space && ece391_strlen (search + last_space + 1) < PATHSIZE - 1) {
+        ece391_strcpy (dir, search + last_space + 1);
+	if (-1 != (fd = ece391_open (dir))) {
+	    /* Only a directory has entries to read */
+	    if (-1 != ece391_getdents (fd, buf, DBUFSIZE) &&
+	        -1 != ece391_lseek (fd, 0, SEEK_SET)) {
+	        search[last_space] = '\0';
+		return fd;
+	    }
+	    ece391_close (fd);
+	}
+    }
+
+    dir[0] = '\0';
+    return ece391_open ((uint8_t*)".");
+}
+
 int main ()
 {
-    int32_t fd, cnt;
-    uint8_t buf[SBUFSIZE];
+    int32_t fd, cnt, pos, dir_len;
+    uint8_t buf[DBUFSIZE];
     uint8_t search[BUFSIZE];
+    uint8_t dir[PATHSIZE];
+    uint8_t path[PATHSIZE + 32 + 1];
+    ece391_dirent_t* ent;
 
     if (0 != ece391_getargs (search, BUFSIZE)) {
         ece391_fdputs (1, (uint8_t*)"could not read argument\n");
         return 3;
     }
 
-    if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
+    if (-1 == (fd = open_dir (search, dir))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
 	return 2;
     }
 
-    while (0 != (cnt = ece391_read (fd, buf, SBUFSIZE-1))) {
+    /* Files are opened as dir/name, and printed that way too */
+    ece391_strcpy (path, dir);
+    dir_len = ece391_strlen (path);
+    if (0 != dir_len && '/' != path[dir_len - 1])
+        path[dir_len++] = '/';
+
+    while (0 != (cnt = ece391_getdents (fd, buf, DBUFSIZE))) {
         if (-1 == cnt) {
 	    ece391_fdputs (1, (uint8_t*)"directory entry read failed\n");
 	    return 3;
 	}
-	if ('.' == buf[0]) /* a directory... */
-	    continue;
-	buf[cnt] = '\0';
-	if (0 != do_one_file ((char*)search, (char*)buf))
-	    return 3;
+	for (pos = 0; pos < cnt; pos += ent->rec_len) {
+	    ent = (ece391_dirent_t*)(buf + pos);
+	    if (ECE391_TYPE_FILE != ent->type) /* a directory or the RTC... */
+	        continue;
+	    ece391_strcpy (path + dir_len, (uint8_t*)ent->name);
+	    if (0 != do_one_file ((char*)search, (char*)path))
+	        return 3;
+	}
     }
 
     return 0;
@@ -3,26 +3,37 @@
 #include "ece391support.h"
 #include "ece391syscall.h"
 
-#define SBUFSIZE 33
+#define DBUFSIZE 1024
+#define ARGSIZE 128
 
 int main ()
 {
-    int32_t fd, cnt;
-    uint8_t buf[SBUFSIZE];
+    int32_t fd, cnt, pos;
+    uint8_t buf[DBUFSIZE];
+    uint8_t dir[ARGSIZE];
+    ece391_dirent_t* ent;
 
-    if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
+    /* List the directory given as the argument, or the root */
+    if (0 != ece391_getargs (dir, ARGSIZE) || '\0' == dir[0])
+        ece391_strcpy (dir, (uint8_t*)".");
+
+    if (-1 == (fd = ece391_open (dir))) {
         ece391_fdputs (1, (uint8_t*)"directory open failed\n");
         return 2;
     }
 
-    while (0 != (cnt = ece391_read (fd, buf, SBUFSIZE-1))) {
+    /* Each call returns a batch of entries rather than a single name */
+    while (0 != (cnt = ece391_getdents (fd, buf, DBUFSIZE))) {
         if (-1 == cnt) {
 	        ece391_fdputs (1, (uint8_t*)"directory entry read failed\n");
 	        return 3;
 	    }
-	    buf[cnt] = '\n';
-	    if (-1 == ece391_write (1, buf, cnt + 1))
-	        return 3;
+	    for (pos = 0; pos < cnt; pos += ent->rec_len) {
+	        ent = (ece391_dirent_t*)(buf + pos);
+	        ent->name[ent->name_len] = '\n';
+	        if (-1 == ece391_write (1, ent->name, ent->name_len + 1))
+	            return 3;
+	    }
     }
 
     return 0;
@@ -0,0 +1,50 @@
+#if !defined(ECE391RUNTIME_H)
+#define ECE391RUNTIME_H
+
+/*
+ * The shared runtime: the support library and system call wrappers,
+ * linked once at RUNTIME_START and mapped read-only into every process by
+ * the kernel. It starts with a table of entry points, in this order;
+ * programs call through it (ece391stubs.S). New entries go at the end so
+ * programs built earlier keep working.
+ */
+#define RUNTIME_START 0x9000000
+
+#define RUNTIME_ENTRIES(E)         \
+	E(0, ece391_halt)          \
+	E(1, ece391_execute)       \
+	E(2, ece391_read)          \
+	E(3, ece391_write)         \
+	E(4, ece391_open)          \
+	E(5, ece391_close)         \
+	E(6, ece391_getargs)       \
+	E(7, ece391_vidmap)        \
+	E(8, ece391_set_handler)   \
+	E(9, ece391_sigreturn)     \
+	E(10, ece391_mmap)         \
+	E(11, ece391_truncate)     \
+	E(12, ece391_getdents)     \
+	E(13, ece391_lseek)        \
+	E(14, ece391_pread)        \
+	E(15, ece391_pwrite)       \
+	E(16, ece391_readv)        \
+	E(17, ece391_writev)       \
+	E(18, ece391_sync)         \
+	E(19, ece391_fsync)        \
+	E(20, ece391_mkdir)        \
+	E(21, ece391_fsmap)        \
+	E(22, ece391_fork)         \
+	E(23, ece391_brk)          \
+	E(24, ece391_sbrk)         \
+	E(25, ece391_shm_create)   \
+	E(26, ece391_shm_attach)   \
+	E(27, ece391_shm_detach)   \
+	E(28, ece391_strlen)       \
+	E(29, ece391_strcpy)       \
+	E(30, ece391_fdputs)       \
+	E(31, ece391_strcmp)       \
+	E(32, ece391_strncmp)      \
+	E(33, ece391_itoa)         \
+	E(34, ece391_strrev)
+
+#endif /* ECE391RUNTIME_H */
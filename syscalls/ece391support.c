@@ -48,7 +48,7 @@ int32_t ece391_strncmp(const uint8_t* s1, const uint8_t* s2, uint32_t n)
 /* Convert a number to its ASCII representation, with base "radix" */
 uint8_t* ece391_itoa(uint32_t value, uint8_t* buf, int32_t radix)
 {
-        static int8_t lookup[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+        static const int8_t lookup[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
 
         uint8_t *newbuf = buf;
         int32_t i;
@@ -9,5 +9,19 @@ extern int32_t ece391_strncmp(const uint8_t* s1, const uint8_t* s2, uint32_t n);
 extern uint8_t *ece391_itoa(uint32_t value, uint8_t* buf, int32_t radix);
 extern uint8_t *ece391_strrev(uint8_t* s);
 
+#define ECE391_FS_BLOCK 4096
+
+/* A regular file found in the image mapped by ece391_fsmap */
+typedef struct {
+    uint32_t inode;
+    uint32_t length;
+} ece391_fsfile_t;
+
+/* Looks up a path in the mapped image; 0 on success, -1 if there is no
+   mapping, no such file, or it is not a regular uncompressed file */
+extern int32_t ece391_fs_open(const uint8_t* path, ece391_fsfile_t* file);
+/* Address of one 4 KB block of the file, 0 past its end */
+extern const uint8_t* ece391_fs_block(const ece391_fsfile_t* file, uint32_t block);
+
 #endif /* ECE391SUPPORT_H */
 
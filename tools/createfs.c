@@ -0,0 +1,506 @@
+/*
+ * createfs - builds a file system image from a directory tree
+ *
+ * Usage: createfs <directory> -o <output file> [-i <inodes>] [-s <megabytes>] [-1] [-z]
+ *
+ * The image is a 4 KB boot block, one 4 KB inode per file (plus spare inodes
+ * for files the kernel creates), then 4 KB data blocks. By default it uses the
+ * indirect layout (boot block version 2): the first 1021 blocks of a file are
+ * listed in its inode, the next 1024 in a table the inode points at, and the
+ * rest in tables listed by a table of tables. The tables are written just
+ * ahead of the blocks they list, so files read back in order. -1 writes the
+ * original layout instead, where files are limited to 1023 blocks.
+ *
+ * Subdirectories become directory inodes whose data is an array of 64 byte
+ * directory entries, like the boot block's, which is the root. Only the root
+ * has a "." entry, and the root is limited to 63 entries.
+ *
+ * -s pads the image to the given size, leaving the rest free for new data when
+ * the image is used as a disk (qemu -hdb).
+ *
+ * -z compresses each file whose blocks it can shrink, and flags its inode in
+ * the boot block. The file's blocks then hold a table with the end offset of
+ * each 4 KB block's chunk, followed by the chunks: LZ4 blocks, or the raw 4 KB
+ * when a block does not compress. The kernel decompresses them as they are
+ * read; compressed files are read only.
+ */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BLOCK_SIZE 4096
+#define FILENAME_LEN 32
+#define MAX_DENTRIES 63
+#define DEFAULT_INODES 64
+#define ONE_MB 0x100000
+
+#define RTC_TYPE 0
+#define DIRECTORY_TYPE 1
+#define FILE_TYPE 2
+
+#define VERSION_INDIRECT 2
+#define INODE_MAX_BLOCKS 1023
+#define INODE_DIRECT_BLOCKS 1021
+#define INODE_INDIRECT 1021
+#define INODE_DOUBLE_INDIRECT 1022
+#define BLOCK_POINTERS (BLOCK_SIZE / 4)
+#define INODE_MAX_BLOCKS_INDIRECT (INODE_DIRECT_BLOCKS + BLOCK_POINTERS + BLOCK_POINTERS * BLOCK_POINTERS)
+#define COMPRESSED_INODES 256
+#define MAX_DEPTH 16		/* directories a path may be nested in */
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_RUN_MASK 15
+#define LZ4_LAST_LITERALS 5	/* the format ends every block with at least this many literals */
+#define LZ4_MFLIMIT 12		/* and starts no match closer than this to the end */
+#define LZ4_HASH_BITS 12
+
+typedef struct {
+	char filename[FILENAME_LEN];
+	uint32_t filetype;
+	uint32_t inode_index;
+	uint8_t reserved[24];
+} __attribute__((packed)) dentry_t;
+
+typedef struct {
+	uint32_t dir_entry_num;
+	uint32_t inode_num;
+	uint32_t data_block_num;
+	uint32_t version;
+	uint32_t compressed[COMPRESSED_INODES / 32];
+	uint8_t reserved[16];
+	dentry_t dentry_directory[MAX_DENTRIES];
+} __attribute__((packed)) boot_block_t;
+
+typedef struct {
+	uint32_t length;
+	uint32_t data[INODE_MAX_BLOCKS];
+} __attribute__((packed)) inode_t;
+
+static uint8_t *blocks;		/* data blocks, grown as files are added */
+static uint32_t num_blocks;
+static uint32_t max_blocks;
+
+static boot_block_t boot;
+static inode_t *inodes;
+static uint32_t num_inodes = DEFAULT_INODES;
+static uint32_t next_inode;
+static uint32_t num_compressed;
+static int indirect = 1;
+static int compress;
+
+/* Appends a zeroed data block and returns its index */
+static uint32_t
+block_new(void)
+{
+	if (num_blocks == max_blocks) {
+		max_blocks = max_blocks ? max_blocks * 2 : 256;
+		blocks = realloc(blocks, (size_t) max_blocks * BLOCK_SIZE);
+		if (blocks == NULL) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+
+	memset(blocks + (size_t) num_blocks * BLOCK_SIZE, 0, BLOCK_SIZE);
+	return num_blocks++;
+}
+
+/* The block numbers in a table block; invalid after the next block_new */
+static uint32_t *
+table(uint32_t block)
+{
+	return (uint32_t *) (blocks + (size_t) block * BLOCK_SIZE);
+}
+
+/* Writes an LZ4 length continuation: 255s, then the remainder */
+static uint32_t
+lz4_put_length(uint8_t *dst, uint32_t len)
+{
+	uint32_t n = 0;
+
+	for (; len >= 255; len -= 255)
+		dst[n++] = 255;
+	dst[n++] = len;
+	return n;
+}
+
+/*
+ * Appends one sequence (literals, then a match unless match_len is 0) to dst.
+ * Returns -1 if it would not fit in cap bytes.
+ */
+static int
+lz4_put_sequence(uint8_t *dst, uint32_t *op, uint32_t cap, const uint8_t *lit,
+		 uint32_t lit_len, uint32_t offset, uint32_t match_len)
+{
+	uint32_t ml = match_len ? match_len - LZ4_MIN_MATCH : 0;
+	uint8_t *token;
+
+	if (*op + 1 + lit_len / 255 + 1 + lit_len + 2 + ml / 255 + 1 > cap)
+		return -1;
+
+	token = &dst[(*op)++];
+	*token = (lit_len >= LZ4_RUN_MASK ? LZ4_RUN_MASK : lit_len) << 4;
+	if (lit_len >= LZ4_RUN_MASK)
+		*op += lz4_put_length(dst + *op, lit_len - LZ4_RUN_MASK);
+	memcpy(dst + *op, lit, lit_len);
+	*op += lit_len;
+
+	if (match_len) {
+		dst[(*op)++] = offset & 0xFF;
+		dst[(*op)++] = offset >> 8;
+		*token |= ml >= LZ4_RUN_MASK ? LZ4_RUN_MASK : ml;
+		if (ml >= LZ4_RUN_MASK)
+			*op += lz4_put_length(dst + *op, ml - LZ4_RUN_MASK);
+	}
+	return 0;
+}
+
+static uint32_t
+read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/*
+ * Compresses src into one LZ4 block of at most cap bytes with a greedy hash
+ * table match finder. Returns the compressed size, 0 if it does not fit.
+ */
+static uint32_t
+lz4_compress(const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t cap)
+{
+	int32_t table[1 << LZ4_HASH_BITS];
+	uint32_t ip = 0, anchor = 0, op = 0, ref, match_len, h;
+
+	memset(table, -1, sizeof(table));
+
+	while (len >= LZ4_MFLIMIT && ip + LZ4_MFLIMIT <= len) {
+		h = (read32(src + ip) * 2654435761U) >> (32 - LZ4_HASH_BITS);
+		ref = table[h];
+		table[h] = ip;
+
+		if ((int32_t) ref == -1 || read32(src + ref) != read32(src + ip)) {
+			ip++;
+			continue;
+		}
+
+		match_len = LZ4_MIN_MATCH;
+		while (ip + match_len < len - LZ4_LAST_LITERALS && src[ref + match_len] == src[ip + match_len])
+			match_len++;
+
+		if (lz4_put_sequence(dst, &op, cap, src + anchor, ip - anchor, ip - ref, match_len) == -1)
+			return 0;
+		ip += match_len;
+		anchor = ip;
+	}
+
+	if (lz4_put_sequence(dst, &op, cap, src + anchor, len - anchor, 0, 0) == -1)
+		return 0;
+	return op;
+}
+
+/*
+ * Packs a file into the compressed layout: a table of chunk end offsets, then
+ * one chunk per 4 KB block. Returns the packed size, or 0 if it would not take
+ * fewer blocks than the file itself.
+ */
+static uint32_t
+pack_file(const uint8_t *data, uint32_t length, uint8_t **packed)
+{
+	uint32_t count = length / BLOCK_SIZE + (length % BLOCK_SIZE != 0);
+	uint32_t b, size, chunk, pos = count * sizeof(uint32_t);
+	uint8_t *out = malloc((size_t) pos + (size_t) count * BLOCK_SIZE);
+
+	if (out == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	for (b = 0; b < count; b++) {
+		size = length - b * BLOCK_SIZE < BLOCK_SIZE ? length - b * BLOCK_SIZE : BLOCK_SIZE;
+
+		/* A chunk must be shorter than its block to be read as compressed */
+		chunk = lz4_compress(data + (size_t) b * BLOCK_SIZE, size, out + pos, size - 1);
+		if (chunk == 0) {
+			memcpy(out + pos, data + (size_t) b * BLOCK_SIZE, size);
+			chunk = size;
+		}
+		pos += chunk;
+		memcpy(out + b * sizeof(uint32_t), &pos, sizeof(uint32_t));
+	}
+
+	if (pos / BLOCK_SIZE + (pos % BLOCK_SIZE != 0) >= count) {
+		free(out);
+		return 0;
+	}
+
+	*packed = out;
+	return pos;
+}
+
+/*
+ * Copies data into new data blocks and lists them in an inode, which must
+ * already have its length set. Returns -1 if it is too large for the layout.
+ */
+static int
+store_data(inode_t *inode, const uint8_t *data, uint32_t stored)
+{
+	uint32_t count = stored / BLOCK_SIZE + (stored % BLOCK_SIZE != 0);
+	uint32_t b, i, block, leaf;
+
+	if (count > (indirect ? INODE_MAX_BLOCKS_INDIRECT : INODE_MAX_BLOCKS))
+		return -1;
+
+	for (b = 0; b < count; b++) {
+		/* A table comes just ahead of the first block it lists */
+		if (indirect && b == INODE_DIRECT_BLOCKS)
+			inode->data[INODE_INDIRECT] = block_new();
+
+		if (indirect && b >= INODE_DIRECT_BLOCKS + BLOCK_POINTERS &&
+		    (b - INODE_DIRECT_BLOCKS - BLOCK_POINTERS) % BLOCK_POINTERS == 0) {
+			if (b == INODE_DIRECT_BLOCKS + BLOCK_POINTERS)
+				inode->data[INODE_DOUBLE_INDIRECT] = block_new();
+			leaf = block_new();
+			table(inode->data[INODE_DOUBLE_INDIRECT])[(b - INODE_DIRECT_BLOCKS - BLOCK_POINTERS) / BLOCK_POINTERS] = leaf;
+		}
+
+		block = block_new();
+		memcpy(blocks + (size_t) block * BLOCK_SIZE, data + (size_t) b * BLOCK_SIZE,
+		       stored - b * BLOCK_SIZE < BLOCK_SIZE ? stored - b * BLOCK_SIZE : BLOCK_SIZE);
+
+		if (!indirect || b < INODE_DIRECT_BLOCKS) {
+			inode->data[b] = block;
+		} else if (b < INODE_DIRECT_BLOCKS + BLOCK_POINTERS) {
+			table(inode->data[INODE_INDIRECT])[b - INODE_DIRECT_BLOCKS] = block;
+		} else {
+			i = b - INODE_DIRECT_BLOCKS - BLOCK_POINTERS;
+			leaf = table(inode->data[INODE_DOUBLE_INDIRECT])[i / BLOCK_POINTERS];
+			table(leaf)[i % BLOCK_POINTERS] = block;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Copies a file into new data blocks and lists them in its inode, packed if
+ * -z was given and it saves blocks. Returns -1 if the file cannot be read or
+ * is too large for the layout.
+ */
+static int
+add_file(uint32_t ino, const char *path, uint32_t length)
+{
+	inode_t *inode = &inodes[ino];
+	uint8_t *data, *packed = NULL;
+	uint32_t stored = length;
+	FILE *in;
+
+	if ((in = fopen(path, "rb")) == NULL) {
+		perror(path);
+		return -1;
+	}
+	if ((data = malloc(length ? length : 1)) == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	if (fread(data, 1, length, in) != length) {
+		perror(path);
+		fclose(in);
+		free(data);
+		return -1;
+	}
+	fclose(in);
+
+	inode->length = length;
+
+	/* Only the first COMPRESSED_INODES inodes have a flag */
+	if (compress && ino < COMPRESSED_INODES && (stored = pack_file(data, length, &packed)) != 0) {
+		free(data);
+		data = packed;
+		boot.compressed[ino / 32] |= 1U << (ino % 32);
+		num_compressed++;
+	} else {
+		stored = length;
+	}
+
+	if (store_data(inode, data, stored) == -1) {
+		fprintf(stderr, "%s is too large for this layout\n", path);
+		free(data);
+		return -1;
+	}
+
+	free(data);
+	return 0;
+}
+
+/*
+ * Makes an entry for every file, device and subdirectory in dir_name, up to
+ * max of them, adding the files and subdirectories below it to the image.
+ * Returns the entries in a new array and sets *count.
+ */
+static dentry_t *
+add_dir(const char *dir_name, uint32_t *count, uint32_t max, int depth)
+{
+	dentry_t *entries = NULL, *dentry;
+	uint32_t max_entries = 0, sub_count, ino;
+	char path[4096];
+	struct dirent *ent;
+	struct stat st;
+	DIR *dir;
+
+	*count = 0;
+	if ((dir = opendir(dir_name)) == NULL) {
+		perror(dir_name);
+		return NULL;
+	}
+
+	while ((ent = readdir(dir)) != NULL) {
+		if (ent->d_name[0] == '.')
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", dir_name, ent->d_name);
+		if (stat(path, &st) == -1) {
+			perror(path);
+			continue;
+		}
+		if (!S_ISREG(st.st_mode) && !S_ISCHR(st.st_mode) && !S_ISDIR(st.st_mode))
+			continue;
+
+		if (strlen(ent->d_name) > FILENAME_LEN || *count == max ||
+		    (!S_ISCHR(st.st_mode) && next_inode == num_inodes) ||
+		    (S_ISDIR(st.st_mode) && depth == MAX_DEPTH)) {
+			fprintf(stderr, "Could not create an entry for %s, skipping it...\n", path);
+			continue;
+		}
+
+		if (*count == max_entries) {
+			max_entries = max_entries ? max_entries * 2 : 16;
+			if ((entries = realloc(entries, max_entries * sizeof(dentry_t))) == NULL) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+		dentry = &entries[*count];
+		memset(dentry, 0, sizeof(dentry_t));
+		memcpy(dentry->filename, ent->d_name, strlen(ent->d_name));
+
+		if (S_ISCHR(st.st_mode)) {
+			dentry->filetype = RTC_TYPE;
+		} else if (S_ISDIR(st.st_mode)) {
+			/* The directory's own entries go after everything below it */
+			ino = next_inode++;
+			dentry->filetype = DIRECTORY_TYPE;
+			dentry->inode_index = ino;
+
+			dentry = add_dir(path, &sub_count, UINT32_MAX, depth + 1);
+			inodes[ino].length = sub_count * sizeof(dentry_t);
+			if (store_data(&inodes[ino], (uint8_t *) dentry, inodes[ino].length) == -1)
+				fprintf(stderr, "%s has too many entries for this layout\n", path);
+			free(dentry);
+		} else {
+			ino = next_inode;
+			if (add_file(ino, path, st.st_size) == -1)
+				continue;
+			next_inode++;
+			dentry->filetype = FILE_TYPE;
+			dentry->inode_index = ino;
+		}
+		(*count)++;
+	}
+	closedir(dir);
+
+	return entries;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: createfs <directory> -o <output file> [-i <inodes>] [-s <megabytes>] [-1] [-z]\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *dir_name = NULL, *out_name = NULL;
+	uint32_t size_mb = 0, total, count, i;
+	dentry_t *dentry, *entries;
+	FILE *out;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			out_name = argv[++i];
+		else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+			num_inodes = strtoul(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+			size_mb = strtoul(argv[++i], NULL, 0);
+		else if (strcmp(argv[i], "-1") == 0)
+			indirect = 0;
+		else if (strcmp(argv[i], "-z") == 0)
+			compress = 1;
+		else if (argv[i][0] != '-' && dir_name == NULL)
+			dir_name = argv[i];
+		else
+			usage();
+	}
+	if (dir_name == NULL || out_name == NULL || num_inodes == 0)
+		usage();
+
+	memset(&boot, 0, sizeof(boot));
+	boot.version = indirect ? VERSION_INDIRECT : 0;
+	inodes = calloc(num_inodes, sizeof(inode_t));
+	if (inodes == NULL) {
+		perror("calloc");
+		return 1;
+	}
+
+	/* The directory itself comes first, as in the original images */
+	dentry = &boot.dentry_directory[boot.dir_entry_num++];
+	strcpy(dentry->filename, ".");
+	dentry->filetype = DIRECTORY_TYPE;
+
+	if (access(dir_name, R_OK) == -1) {
+		perror(dir_name);
+		return 1;
+	}
+	/* The root lives in the boot block, which has room for MAX_DENTRIES */
+	entries = add_dir(dir_name, &count, MAX_DENTRIES - boot.dir_entry_num, 1);
+	for (i = 0; i < count; i++)
+		boot.dentry_directory[boot.dir_entry_num++] = entries[i];
+	free(entries);
+
+	boot.inode_num = num_inodes;
+	boot.data_block_num = num_blocks;
+
+	/* Pad with free blocks up to the requested size */
+	total = 1 + num_inodes + num_blocks;
+	if ((uint64_t) size_mb * ONE_MB / BLOCK_SIZE > total) {
+		while (1 + num_inodes + num_blocks < (uint64_t) size_mb * ONE_MB / BLOCK_SIZE)
+			block_new();
+	}
+
+	if ((out = fopen(out_name, "wb")) == NULL) {
+		perror(out_name);
+		return 1;
+	}
+	if (fwrite(&boot, sizeof(boot), 1, out) != 1 ||
+	    fwrite(inodes, sizeof(inode_t), num_inodes, out) != num_inodes ||
+	    (num_blocks && fwrite(blocks, BLOCK_SIZE, num_blocks, out) != num_blocks)) {
+		perror(out_name);
+		fclose(out);
+		return 1;
+	}
+	fclose(out);
+
+	printf("%s: %u entries, %u inodes, %u data blocks (%u free), %u files compressed\n", out_name,
+	       boot.dir_entry_num, num_inodes, boot.data_block_num, num_blocks - boot.data_block_num,
+	       num_compressed);
+	return 0;
+}